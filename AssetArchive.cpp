@@ -0,0 +1,350 @@
+#include "AssetArchive.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+	static const char MAGIC[4] = { 'G', 'P', 'S', 'A' };
+
+	struct ArchiveHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t slotCount;
+		uint64_t tableOffset;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	// One table of contents slot; nameLength 0 marks an empty slot
+	struct ArchiveSlot
+	{
+		uint64_t hash;
+		uint64_t offset;
+		uint64_t size;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+	};
+
+	const unsigned char* AssetArchive::mapping = NULL;
+	size_t AssetArchive::mappingSize = 0;
+	size_t AssetArchive::entryCount = 0;
+	size_t AssetArchive::slotCount = 0;
+
+#if defined(_WIN32)
+	static HANDLE mappedFile = INVALID_HANDLE_VALUE;
+	static HANDLE fileMapping = NULL;
+#endif
+
+	// Forward slashes and no leading "./", so the loaders' paths match the packed names
+	static std::string NormalizePath(const std::string& path)
+	{
+		std::string normalized = path;
+		std::replace(normalized.begin(), normalized.end(), '\\', '/');
+		while (normalized.compare(0, 2, "./") == 0)
+			normalized.erase(0, 2);
+		return normalized;
+	}
+
+	// FNV-1a, 64 bit
+	static uint64_t HashPath(const std::string& path)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < path.size(); i++)
+			hash = (hash ^ (unsigned char)path[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	static size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	static const ArchiveHeader& Header(const unsigned char* mapping)
+	{
+		return *(const ArchiveHeader*)mapping;
+	}
+
+	static const ArchiveSlot* Slots(const unsigned char* mapping)
+	{
+		return (const ArchiveSlot*)(mapping + Header(mapping).tableOffset);
+	}
+
+	bool AssetArchive::Mount(const std::string& fileName)
+	{
+		PROFILE_ZONE("MountArchive");
+		Unmount();
+
+		const unsigned char* view = NULL;
+		size_t size = 0;
+#if defined(_WIN32)
+		mappedFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (mappedFile == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (GetFileSizeEx(mappedFile, &fileSize) && fileSize.QuadPart > 0) {
+			size = (size_t)fileSize.QuadPart;
+			fileMapping = CreateFileMappingA(mappedFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (fileMapping)
+				view = (const unsigned char*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+#else
+		int file = open(fileName.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat status;
+		if (fstat(file, &status) == 0 && status.st_size > 0) {
+			size = (size_t)status.st_size;
+			void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (address != MAP_FAILED)
+				view = (const unsigned char*)address;
+		}
+		// the mapping keeps the file alive
+		close(file);
+#endif
+		mapping = view;
+		mappingSize = size;
+		if (!mapping) {
+			fprintf(stderr, "ERROR: could not map asset archive %s\n", fileName.c_str());
+			Unmount();
+			return false;
+		}
+
+		bool valid = mappingSize >= sizeof(ArchiveHeader);
+		if (valid) {
+			const ArchiveHeader& header = Header(mapping);
+			uint64_t tableEnd = header.tableOffset + (uint64_t)header.slotCount * sizeof(ArchiveSlot);
+			valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+				header.slotCount > 0 && (header.slotCount & (header.slotCount - 1)) == 0 &&
+				header.tableOffset % sizeof(uint64_t) == 0 && tableEnd <= mappingSize &&
+				header.namesOffset + header.namesSize <= mappingSize;
+		}
+		if (valid) {
+			const ArchiveHeader& header = Header(mapping);
+			const ArchiveSlot* slots = Slots(mapping);
+			for (uint32_t i = 0; i < header.slotCount && valid; i++) {
+				valid = slots[i].nameLength == 0 || (slots[i].nameOffset + (uint64_t)slots[i].nameLength <= header.namesSize &&
+					slots[i].offset + slots[i].size <= mappingSize);
+			}
+		}
+		if (!valid) {
+			fprintf(stderr, "ERROR: %s is not a version %u asset archive\n", fileName.c_str(), VERSION);
+			Unmount();
+			return false;
+		}
+
+		entryCount = Header(mapping).entryCount;
+		slotCount = Header(mapping).slotCount;
+		printf("Mounted %s: %zu files, %.1f MB\n", fileName.c_str(), entryCount, mappingSize / (1024.0 * 1024.0));
+		return true;
+	}
+
+	void AssetArchive::Unmount()
+	{
+#if defined(_WIN32)
+		if (mapping)
+			UnmapViewOfFile(mapping);
+		if (fileMapping)
+			CloseHandle(fileMapping);
+		if (mappedFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mappedFile);
+		fileMapping = NULL;
+		mappedFile = INVALID_HANDLE_VALUE;
+#else
+		if (mapping)
+			munmap((void*)mapping, mappingSize);
+#endif
+		mapping = NULL;
+		mappingSize = 0;
+		entryCount = 0;
+		slotCount = 0;
+	}
+
+	bool AssetArchive::IsMounted()
+	{
+		return mapping != NULL;
+	}
+
+	size_t AssetArchive::GetEntryCount()
+	{
+		return entryCount;
+	}
+
+	bool AssetArchive::Find(const std::string& path, const unsigned char** data, size_t* size)
+	{
+		if (!mapping)
+			return false;
+
+		std::string name = NormalizePath(path);
+		uint64_t hash = HashPath(name);
+		const ArchiveSlot* slots = Slots(mapping);
+		const char* names = (const char*)(mapping + Header(mapping).namesOffset);
+		// linear probing; the table is at most half full, so an empty slot ends the search quickly
+		for (size_t probe = 0; probe < slotCount; probe++) {
+			const ArchiveSlot& slot = slots[(hash + probe) & (slotCount - 1)];
+			if (slot.nameLength == 0)
+				return false;
+			if (slot.hash == hash && slot.nameLength == name.size() && memcmp(names + slot.nameOffset, name.data(), name.size()) == 0) {
+				*data = mapping + slot.offset;
+				*size = (size_t)slot.size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Appends the files below directory, recursively, as directory/relative/path
+	static void ListFiles(const std::string& directory, std::vector<std::string>& files)
+	{
+#if defined(_WIN32)
+		WIN32_FIND_DATAA found;
+		HANDLE search = FindFirstFileA((directory + "/*").c_str(), &found);
+		if (search == INVALID_HANDLE_VALUE)
+			return;
+		do {
+			std::string name = found.cFileName;
+			if (name == "." || name == "..")
+				continue;
+			if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				ListFiles(directory + "/" + name, files);
+			else
+				files.push_back(directory + "/" + name);
+		} while (FindNextFileA(search, &found));
+		FindClose(search);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (!dir)
+			return;
+		while (struct dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name == "." || name == "..")
+				continue;
+			std::string path = directory + "/" + name;
+			struct stat status;
+			if (stat(path.c_str(), &status) != 0)
+				continue;
+			if (S_ISDIR(status.st_mode))
+				ListFiles(path, files);
+			else if (S_ISREG(status.st_mode))
+				files.push_back(path);
+		}
+		closedir(dir);
+#endif
+	}
+
+	static bool ReadWholeFile(const std::string& path, std::vector<unsigned char>& contents)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		contents.resize(size > 0 ? (size_t)size : 0);
+		bool read = contents.empty() || fread(&contents[0], 1, contents.size(), file) == contents.size();
+		fclose(file);
+		return read;
+	}
+
+	bool AssetArchive::Pack(const std::string& fileName, const std::vector<std::string>& directories)
+	{
+		PROFILE_ZONE("PackArchive");
+		std::vector<std::string> files;
+		for (size_t i = 0; i < directories.size(); i++)
+			ListFiles(NormalizePath(directories[i]), files);
+		// sorted, so the same tree always packs to the same bytes
+		std::sort(files.begin(), files.end());
+		if (files.empty()) {
+			fprintf(stderr, "ERROR: nothing to pack\n");
+			return false;
+		}
+
+		uint32_t slots = 1;
+		while (slots < files.size() * 2)
+			slots *= 2;
+
+		std::vector<ArchiveSlot> table(slots);
+		memset(&table[0], 0, table.size() * sizeof(ArchiveSlot));
+		std::string names;
+		ArchiveHeader header;
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.entryCount = (uint32_t)files.size();
+		header.slotCount = slots;
+		header.tableOffset = sizeof(ArchiveHeader);
+
+		// the names go first so the data offsets are known before anything is written
+		std::vector<uint32_t> slotOfFile(files.size());
+		for (size_t i = 0; i < files.size(); i++) {
+			std::string name = NormalizePath(files[i]);
+			uint64_t hash = HashPath(name);
+			uint32_t slot = (uint32_t)(hash & (slots - 1));
+			while (table[slot].nameLength != 0)
+				slot = (slot + 1) & (slots - 1);
+			table[slot].hash = hash;
+			table[slot].nameOffset = (uint32_t)names.size();
+			table[slot].nameLength = (uint32_t)name.size();
+			names += name;
+			slotOfFile[i] = slot;
+		}
+		header.namesOffset = header.tableOffset + table.size() * sizeof(ArchiveSlot);
+		header.namesSize = names.size();
+
+		FILE* archive = fopen(fileName.c_str(), "wb");
+		if (!archive) {
+			fprintf(stderr, "ERROR: could not create %s\n", fileName.c_str());
+			return false;
+		}
+
+		size_t offset = AlignUp((size_t)(header.namesOffset + header.namesSize), ENTRY_ALIGNMENT);
+		std::vector<unsigned char> contents;
+		std::vector<unsigned char> padding(ENTRY_ALIGNMENT, 0);
+		bool written = fseek(archive, (long)offset, SEEK_SET) == 0;
+		for (size_t i = 0; i < files.size() && written; i++) {
+			if (!ReadWholeFile(files[i], contents)) {
+				fprintf(stderr, "ERROR: could not read %s\n", files[i].c_str());
+				written = false;
+				break;
+			}
+			ArchiveSlot& slot = table[slotOfFile[i]];
+			slot.offset = offset;
+			slot.size = contents.size();
+			size_t aligned = AlignUp(contents.size(), ENTRY_ALIGNMENT);
+			written = (contents.empty() || fwrite(&contents[0], 1, contents.size(), archive) == contents.size()) &&
+				fwrite(&padding[0], 1, aligned - contents.size(), archive) == aligned - contents.size();
+			offset += aligned;
+		}
+
+		// the table of contents last, now that it holds every offset
+		if (written) {
+			written = fseek(archive, 0, SEEK_SET) == 0 &&
+				fwrite(&header, sizeof(header), 1, archive) == 1 &&
+				fwrite(&table[0], sizeof(ArchiveSlot), table.size(), archive) == table.size() &&
+				fwrite(names.data(), 1, names.size(), archive) == names.size();
+		}
+		written = fclose(archive) == 0 && written;
+		if (!written) {
+			fprintf(stderr, "ERROR: could not write %s\n", fileName.c_str());
+			remove(fileName.c_str());
+			return false;
+		}
+		printf("Packed %zu files into %s, %.1f MB\n", files.size(), fileName.c_str(), offset / (1024.0 * 1024.0));
+		return true;
+	}
+}
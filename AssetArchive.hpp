@@ -0,0 +1,43 @@
+#ifndef AssetArchive_hpp
+#define AssetArchive_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Single-file pack of the loose assets, memory-mapped once at startup
+    // Layout: header, hashed table of contents (open addressing, power-of-two slots), entry names, then the
+    // file contents, each starting on a 4 KB boundary so it can be paged in without touching its neighbours
+    // Paths are relative to the working directory with forward slashes, e.g. "objects/quad/quad.obj"
+    class AssetArchive
+    {
+    public:
+        static const uint32_t VERSION = 1;
+        static const size_t ENTRY_ALIGNMENT = 4096;
+
+        // Maps the archive read-only; Find looks in it until Unmount. Mount before any loader runs,
+        // the lookups themselves are safe from any thread
+        static bool Mount(const std::string& fileName);
+        static void Unmount();
+        static bool IsMounted();
+        static size_t GetEntryCount();
+
+        // Points data at the file's bytes inside the mapping, valid until Unmount; false when the archive is not
+        // mounted or does not hold the file, in which case the caller reads the loose file
+        static bool Find(const std::string& path, const unsigned char** data, size_t* size);
+
+        // Writes every file under the directories, recursively, into a new archive
+        static bool Pack(const std::string& fileName, const std::vector<std::string>& directories);
+
+    private:
+        static const unsigned char* mapping;
+        static size_t mappingSize;
+        static size_t entryCount;
+        static size_t slotCount;
+    };
+}
+
+#endif /* AssetArchive_hpp */
@@ -0,0 +1,172 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace gps {
+
+	Benchmark::Benchmark()
+	{
+		this->warmupFrames = 0;
+		this->framesFinished = 0;
+	}
+
+	void Benchmark::BeginPhase(const std::string& name)
+	{
+		EndPhase();
+		currentPhase = name;
+		phaseStart = Clock::now();
+	}
+
+	void Benchmark::EndPhase()
+	{
+		if (currentPhase.empty())
+			return;
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - phaseStart).count();
+		phases.push_back(std::make_pair(currentPhase, ms));
+		currentPhase.clear();
+	}
+
+	void Benchmark::Start(int warmupFrames)
+	{
+		this->warmupFrames = warmupFrames;
+		this->framesFinished = 0;
+		this->frameTimes.clear();
+		this->lastFrameEnd = Clock::now();
+	}
+
+	void Benchmark::FrameFinished()
+	{
+		Clock::time_point now = Clock::now();
+		// the frame time is the interval between completions, so queueing ahead is not counted as free
+		if (framesFinished >= warmupFrames)
+			frameTimes.push_back(std::chrono::duration<double, std::milli>(now - lastFrameEnd).count());
+		lastFrameEnd = now;
+		framesFinished++;
+	}
+
+	size_t Benchmark::GetMeasuredFrames()
+	{
+		return frameTimes.size();
+	}
+
+	void Benchmark::SetInfo(const std::string& name, const std::string& value)
+	{
+		for (size_t i = 0; i < info.size(); i++) {
+			if (info[i].first == name) {
+				info[i].second = value;
+				return;
+			}
+		}
+		info.push_back(std::make_pair(name, value));
+	}
+
+	void Benchmark::SetCounter(const std::string& name, double value)
+	{
+		for (size_t i = 0; i < counters.size(); i++) {
+			if (counters[i].first == name) {
+				counters[i].second = value;
+				return;
+			}
+		}
+		counters.push_back(std::make_pair(name, value));
+	}
+
+	FrameTimeStats Benchmark::GetFrameTimeStats()
+	{
+		FrameTimeStats stats = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, frameTimes.size() };
+		if (frameTimes.empty())
+			return stats;
+
+		std::vector<double> sorted(frameTimes);
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++)
+			sum += sorted[i];
+
+		stats.minMs = sorted.front();
+		stats.p50Ms = sorted[(size_t)((sorted.size() - 1) * 0.50)];
+		stats.p95Ms = sorted[(size_t)((sorted.size() - 1) * 0.95)];
+		stats.p99Ms = sorted[(size_t)((sorted.size() - 1) * 0.99)];
+		stats.maxMs = sorted.back();
+		stats.avgMs = sum / sorted.size();
+		return stats;
+	}
+
+	static std::string JsonString(const std::string& value)
+	{
+		std::string escaped = "\"";
+		for (size_t i = 0; i < value.size(); i++) {
+			char c = value[i];
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			if ((unsigned char)c >= 0x20)
+				escaped += c;
+		}
+		return escaped + "\"";
+	}
+
+	bool Benchmark::WriteReport(const std::string& fileName, GpuTimer& gpuTimer)
+	{
+		EndPhase();
+
+		std::ofstream file(fileName.c_str());
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		FrameTimeStats stats = GetFrameTimeStats();
+		file.precision(4);
+		file << std::fixed;
+		file << "{\n";
+
+		for (size_t i = 0; i < info.size(); i++)
+			file << "  " << JsonString(info[i].first) << ": " << JsonString(info[i].second) << ",\n";
+
+		file << "  \"frames\": " << stats.frames << ",\n";
+		file << "  \"warmup_frames\": " << warmupFrames << ",\n";
+		file << "  \"frame_ms\": { \"min\": " << stats.minMs << ", \"p50\": " << stats.p50Ms
+			<< ", \"p95\": " << stats.p95Ms << ", \"p99\": " << stats.p99Ms
+			<< ", \"max\": " << stats.maxMs << ", \"avg\": " << stats.avgMs << " },\n";
+
+		double startupTotal = 0.0;
+		file << "  \"startup_ms\": {";
+		for (size_t i = 0; i < phases.size(); i++) {
+			file << " " << JsonString(phases[i].first) << ": " << phases[i].second << ",";
+			startupTotal += phases[i].second;
+		}
+		file << " \"total\": " << startupTotal << " },\n";
+
+		file << "  \"gpu_ms\": {";
+		std::vector<std::string> passes = gpuTimer.GetPassNames();
+		for (size_t i = 0; i < passes.size(); i++) {
+			GpuTimerStats passStats;
+			if (!gpuTimer.GetStats(passes[i], passStats))
+				continue;
+			file << (i == 0 ? "\n" : ",\n");
+			file << "    " << JsonString(passes[i]) << ": { \"min\": " << passStats.minMs << ", \"avg\": " << passStats.avgMs
+				<< ", \"p95\": " << passStats.p95Ms << ", \"p99\": " << passStats.p99Ms << " }";
+		}
+		file << (passes.empty() ? "},\n" : "\n  },\n");
+
+		file << "  \"counters\": {";
+		for (size_t i = 0; i < counters.size(); i++)
+			file << (i == 0 ? " " : ", ") << JsonString(counters[i].first) << ": " << counters[i].second;
+		file << " }\n";
+
+		file << "}\n";
+		printf("Benchmark: report written to %s\n", fileName.c_str());
+		return true;
+	}
+
+	void Benchmark::PrintSummary()
+	{
+		FrameTimeStats stats = GetFrameTimeStats();
+		printf("Benchmark: %zu frames  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f ms\n",
+			stats.frames, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs);
+		for (size_t i = 0; i < phases.size(); i++)
+			printf("  startup %-16s %9.2f ms\n", phases[i].first.c_str(), phases[i].second);
+	}
+}
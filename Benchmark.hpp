@@ -0,0 +1,66 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include "GpuTimer.hpp"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    struct FrameTimeStats
+    {
+        double minMs;
+        double p50Ms;
+        double p95Ms;
+        double p99Ms;
+        double maxMs;
+        double avgMs;
+        size_t frames;
+    };
+
+    // Collects startup phase times, per-frame times and named counters for a --bench run
+    class Benchmark
+    {
+    public:
+        Benchmark();
+
+        // Phases are sequential; beginning a new one ends the previous one
+        void BeginPhase(const std::string& name);
+        void EndPhase();
+
+        // Frames finished before warmupFrames are not measured
+        void Start(int warmupFrames);
+        // Call once per completed frame on the render thread
+        void FrameFinished();
+        size_t GetMeasuredFrames();
+
+        void SetInfo(const std::string& name, const std::string& value);
+        void SetCounter(const std::string& name, double value);
+
+        FrameTimeStats GetFrameTimeStats();
+
+        // JSON report: frame time percentiles, startup phases, GPU passes and counters
+        bool WriteReport(const std::string& fileName, GpuTimer& gpuTimer);
+        void PrintSummary();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        std::vector<std::pair<std::string, double> > phases;
+        std::string currentPhase;
+        Clock::time_point phaseStart;
+
+        int warmupFrames;
+        int framesFinished;
+        Clock::time_point lastFrameEnd;
+        std::vector<double> frameTimes;
+
+        std::vector<std::pair<std::string, std::string> > info;
+        std::vector<std::pair<std::string, double> > counters;
+    };
+}
+
+#endif /* Benchmark_hpp */
@@ -60,4 +60,11 @@ namespace gps {
 		this->cameraFrontDirection = glm::normalize(cameraTarget - cameraPosition);
 		this->cameraRightDirection = glm::normalize(glm::cross(cameraFrontDirection, glm::vec3(0.0f, 1.0f, 0.0f)));
 	}
+
+	//place the camera directly
+	void Camera::setPose(glm::vec3 position, glm::vec3 frontDirection) {
+		this->cameraPosition = position;
+		this->cameraFrontDirection = glm::normalize(frontDirection);
+		this->cameraRightDirection = glm::normalize(glm::cross(cameraFrontDirection, glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
 }
\ No newline at end of file
@@ -25,6 +25,8 @@ namespace gps {
         void rotate(float pitch, float yaw);
         //camera animation
         void scenePreview(float angle);
+        //place the camera directly - used by replays and camera splines
+        void setPose(glm::vec3 position, glm::vec3 frontDirection);
         
     //private:
         glm::vec3 cameraPosition;
@@ -0,0 +1,146 @@
+#include "CameraSpline.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace gps {
+
+	// arc-length table resolution; plenty for paths of a few dozen keys
+	static const int SAMPLES_PER_SEGMENT = 32;
+
+	static glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+	{
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return 0.5f * ((2.0f * p1) + (-p0 + p2) * t
+			+ (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+			+ (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+	}
+
+	CameraSpline::CameraSpline()
+	{
+	}
+
+	bool CameraSpline::Load(const std::string& fileName)
+	{
+		std::ifstream file(fileName.c_str());
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		keys.clear();
+		std::string line;
+		while (std::getline(file, line)) {
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+
+			std::istringstream stream(line);
+			glm::vec3 position, target;
+			if (stream >> position.x >> position.y >> position.z >> target.x >> target.y >> target.z)
+				AddKey(position, target);
+		}
+
+		if (keys.size() < 2) {
+			fprintf(stderr, "ERROR: %s needs at least two camera keys\n", fileName.c_str());
+			keys.clear();
+			return false;
+		}
+
+		Build();
+		printf("Camera spline: %zu keys, %.2f units long\n", keys.size(), GetLength());
+		return true;
+	}
+
+	void CameraSpline::AddKey(glm::vec3 position, glm::vec3 target)
+	{
+		Key key;
+		key.position = position;
+		key.target = target;
+		keys.push_back(key);
+	}
+
+	void CameraSpline::Build()
+	{
+		arcTable.clear();
+		if (keys.size() < 2)
+			return;
+
+		int segments = (int)keys.size() - 1;
+		int sampleCount = segments * SAMPLES_PER_SEGMENT;
+		glm::vec3 previous, target;
+		EvaluateParameter(0.0f, previous, target);
+
+		ArcSample sample = { 0.0f, 0.0f };
+		arcTable.push_back(sample);
+		for (int i = 1; i <= sampleCount; i++) {
+			float t = (float)i / SAMPLES_PER_SEGMENT;
+			glm::vec3 position;
+			EvaluateParameter(t, position, target);
+			sample.distance += glm::length(position - previous);
+			sample.parameter = t;
+			arcTable.push_back(sample);
+			previous = position;
+		}
+	}
+
+	bool CameraSpline::IsEmpty()
+	{
+		return arcTable.empty();
+	}
+
+	float CameraSpline::GetLength()
+	{
+		return arcTable.empty() ? 0.0f : arcTable.back().distance;
+	}
+
+	void CameraSpline::Evaluate(float distance, glm::vec3& position, glm::vec3& target)
+	{
+		if (arcTable.empty()) {
+			position = keys.empty() ? glm::vec3(0.0f) : keys[0].position;
+			target = keys.empty() ? glm::vec3(0.0f, 0.0f, -1.0f) : keys[0].target;
+			return;
+		}
+
+		distance = glm::clamp(distance, 0.0f, GetLength());
+
+		// first table entry at or past the distance, then interpolate the parameter inside that step
+		size_t low = 0;
+		size_t high = arcTable.size() - 1;
+		while (low < high) {
+			size_t middle = (low + high) / 2;
+			if (arcTable[middle].distance < distance)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		float t = arcTable[low].parameter;
+		if (low > 0) {
+			const ArcSample& a = arcTable[low - 1];
+			const ArcSample& b = arcTable[low];
+			float span = b.distance - a.distance;
+			float f = span > 0.0f ? (distance - a.distance) / span : 0.0f;
+			t = a.parameter + (b.parameter - a.parameter) * f;
+		}
+		EvaluateParameter(t, position, target);
+	}
+
+	// t runs from 0 to keys.size() - 1, one unit per segment; the end keys are repeated as phantom neighbours
+	void CameraSpline::EvaluateParameter(float t, glm::vec3& position, glm::vec3& target)
+	{
+		int last = (int)keys.size() - 1;
+		int segment = glm::clamp((int)t, 0, last - 1);
+		float local = t - segment;
+
+		const Key& k0 = keys[glm::max(segment - 1, 0)];
+		const Key& k1 = keys[segment];
+		const Key& k2 = keys[segment + 1];
+		const Key& k3 = keys[glm::min(segment + 2, last)];
+
+		position = CatmullRom(k0.position, k1.position, k2.position, k3.position, local);
+		target = CatmullRom(k0.target, k1.target, k2.target, k3.target, local);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef CameraSpline_hpp
+#define CameraSpline_hpp
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Authored camera path: Catmull-Rom curves through position and look-at keys,
+    // sampled by arc length so the camera moves at constant speed between unevenly spaced keys
+    class CameraSpline
+    {
+    public:
+        CameraSpline();
+
+        // Text file, one key per line: "px py pz tx ty tz"; '#' starts a comment
+        bool Load(const std::string& fileName);
+        void AddKey(glm::vec3 position, glm::vec3 target);
+        // Rebuilds the arc-length table; call after adding keys
+        void Build();
+
+        bool IsEmpty();
+        float GetLength();
+
+        // distance is clamped to [0, GetLength()]
+        void Evaluate(float distance, glm::vec3& position, glm::vec3& target);
+
+    private:
+        struct Key
+        {
+            glm::vec3 position;
+            glm::vec3 target;
+        };
+
+        struct ArcSample
+        {
+            float distance;
+            float parameter;
+        };
+
+        std::vector<Key> keys;
+        std::vector<ArcSample> arcTable;
+
+        void EvaluateParameter(float t, glm::vec3& position, glm::vec3& target);
+    };
+}
+
+#endif /* CameraSpline_hpp */
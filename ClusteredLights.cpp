@@ -0,0 +1,218 @@
+#include "ClusteredLights.hpp"
+#include "Profiler.hpp"
+#include "RenderStats.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+	// Tiles covered by [low, high] along one screen axis; the sphere spans depths [nearest, farthest]
+	// Returns false when the range is off screen
+	static bool TileRange(float low, float high, float nearest, float farthest, float projectionScale, int tiles, int& first, int& last)
+	{
+		// x / depth is smallest at the nearest depth for negative x and at the farthest for positive x
+		float ndcLow = projectionScale * (low < 0.0f ? low / nearest : low / farthest);
+		float ndcHigh = projectionScale * (high > 0.0f ? high / nearest : high / farthest);
+		if (ndcHigh < -1.0f || ndcLow > 1.0f)
+			return false;
+		first = glm::clamp((int)std::floor((ndcLow * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+		last = glm::clamp((int)std::floor((ndcHigh * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+		return true;
+	}
+
+	ClusteredLights::ClusteredLights()
+	{
+		this->lightDataTexture = 0;
+		this->lightGridTexture = 0;
+		this->lightDataOffset = 0;
+		this->lightGridOffset = 0;
+		this->nearPlane = 0.1f;
+		this->farPlane = 1000.0f;
+	}
+
+	void ClusteredLights::Build(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float nearPlane, float farPlane, gps::JobSystem& jobSystem, LightClusters& clusters)
+	{
+		PROFILE_ZONE("BuildLightClusters");
+		const int tilesPerSlice = LightClusters::CLUSTERS_X * LightClusters::CLUSTERS_Y;
+		size_t lightCount = lights.size();
+		clusters.nearPlane = nearPlane;
+		clusters.farPlane = farPlane;
+
+		// view space; the bounding spheres also go to plain arrays so the per-slice depth test vectorizes
+		clusters.lights.resize(lightCount * 3);
+		std::vector<float> x(lightCount), y(lightCount), depth(lightCount), radius(lightCount);
+		glm::mat3 viewRotation = glm::mat3(view);
+		for (size_t i = 0; i < lightCount; i++) {
+			const Light& light = lights[i];
+			glm::vec3 position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+			bool spot = light.type == LIGHT_SPOT;
+			glm::vec3 direction = spot ? glm::normalize(viewRotation * light.direction) : glm::vec3(0.0f);
+			clusters.lights[i * 3 + 0] = glm::vec4(position, light.range);
+			clusters.lights[i * 3 + 1] = glm::vec4(light.color, spot ? light.cosOuterCone : -2.0f);
+			clusters.lights[i * 3 + 2] = glm::vec4(direction, spot ? light.cosInnerCone : -1.0f);
+			x[i] = position.x;
+			y[i] = position.y;
+			depth[i] = -position.z;
+			radius[i] = light.range;
+		}
+
+		float projectionX = projection[0][0];
+		float projectionY = projection[1][1];
+		float depthRatio = farPlane / nearPlane;
+
+		// a slice owns its clusters, so the workers never touch the same counts
+		std::vector<std::vector<GLuint> > sliceCounts(LightClusters::CLUSTERS_Z);
+		std::vector<std::vector<GLuint> > sliceIndices(LightClusters::CLUSTERS_Z);
+		jobSystem.ParallelFor(LightClusters::CLUSTERS_Z, 1, [&](size_t begin, size_t end) {
+			std::vector<unsigned char> overlaps(lightCount);
+			std::vector<glm::ivec4> tileRanges;
+			std::vector<GLuint> rangeLights;
+			std::vector<GLuint> cursor(tilesPerSlice);
+
+			for (size_t slice = begin; slice < end; slice++) {
+				float sliceNear = nearPlane * std::pow(depthRatio, (float)slice / LightClusters::CLUSTERS_Z);
+				float sliceFar = nearPlane * std::pow(depthRatio, (float)(slice + 1) / LightClusters::CLUSTERS_Z);
+				for (size_t i = 0; i < lightCount; i++)
+					overlaps[i] = (depth[i] + radius[i] >= sliceNear) & (depth[i] - radius[i] <= sliceFar);
+
+				std::vector<GLuint>& counts = sliceCounts[slice];
+				counts.assign(tilesPerSlice, 0);
+				tileRanges.clear();
+				rangeLights.clear();
+				for (size_t i = 0; i < lightCount; i++) {
+					if (!overlaps[i])
+						continue;
+					float nearest = std::max(sliceNear, depth[i] - radius[i]);
+					float farthest = std::min(sliceFar, depth[i] + radius[i]);
+					glm::ivec4 range;
+					if (!TileRange(x[i] - radius[i], x[i] + radius[i], nearest, farthest, projectionX, LightClusters::CLUSTERS_X, range.x, range.y) ||
+						!TileRange(y[i] - radius[i], y[i] + radius[i], nearest, farthest, projectionY, LightClusters::CLUSTERS_Y, range.z, range.w))
+						continue;
+					for (int ty = range.z; ty <= range.w; ty++) {
+						for (int tx = range.x; tx <= range.y; tx++)
+							counts[ty * LightClusters::CLUSTERS_X + tx]++;
+					}
+					tileRanges.push_back(range);
+					rangeLights.push_back((GLuint)i);
+				}
+
+				// indices grouped by cluster, in light order within each
+				GLuint total = 0;
+				for (int c = 0; c < tilesPerSlice; c++) {
+					cursor[c] = total;
+					total += counts[c];
+				}
+				std::vector<GLuint>& indices = sliceIndices[slice];
+				indices.resize(total);
+				for (size_t r = 0; r < tileRanges.size(); r++) {
+					const glm::ivec4& range = tileRanges[r];
+					for (int ty = range.z; ty <= range.w; ty++) {
+						for (int tx = range.x; tx <= range.y; tx++)
+							indices[cursor[ty * LightClusters::CLUSTERS_X + tx]++] = rangeLights[r];
+					}
+				}
+			}
+		});
+
+		size_t indexCount = 0;
+		for (int slice = 0; slice < LightClusters::CLUSTERS_Z; slice++)
+			indexCount += sliceIndices[slice].size();
+		clusters.grid.resize(LightClusters::CLUSTER_COUNT * 2 + indexCount);
+
+		GLuint offset = LightClusters::CLUSTER_COUNT * 2;
+		for (int slice = 0; slice < LightClusters::CLUSTERS_Z; slice++) {
+			const std::vector<GLuint>& counts = sliceCounts[slice];
+			for (int c = 0; c < tilesPerSlice; c++) {
+				int cluster = slice * tilesPerSlice + c;
+				clusters.grid[cluster * 2] = offset;
+				clusters.grid[cluster * 2 + 1] = counts[c];
+				offset += counts[c];
+			}
+			std::copy(sliceIndices[slice].begin(), sliceIndices[slice].end(), clusters.grid.begin() + (offset - sliceIndices[slice].size()));
+		}
+	}
+
+	void ClusteredLights::Create()
+	{
+		// one partition per frame in flight, like the per-draw data
+		ring.Create(GL_TEXTURE_BUFFER, 64 * 1024, 3, "clustered lights");
+		glGenTextures(1, &lightDataTexture);
+		glGenTextures(1, &lightGridTexture);
+		AttachRing();
+	}
+
+	void ClusteredLights::Destroy()
+	{
+		ring.Destroy();
+		if (lightDataTexture)
+			glDeleteTextures(1, &lightDataTexture);
+		if (lightGridTexture)
+			glDeleteTextures(1, &lightGridTexture);
+		lightDataTexture = 0;
+		lightGridTexture = 0;
+	}
+
+	void ClusteredLights::AttachRing()
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, lightDataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ring.GetBuffer());
+		glBindTexture(GL_TEXTURE_BUFFER, lightGridTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, ring.GetBuffer());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void ClusteredLights::Upload(const LightClusters& clusters)
+	{
+		GLsizeiptr lightBytes = clusters.lights.size() * sizeof(glm::vec4);
+		GLsizeiptr gridBytes = clusters.grid.size() * sizeof(GLuint);
+		// the lights start on a texel boundary, which may cost up to one texel of padding
+		// a grown ring is new storage even when it got the old name back, so always re-attach
+		if (ring.BeginFrame(lightBytes + gridBytes + sizeof(glm::vec4)))
+			AttachRing();
+
+		void* pointer;
+		GLintptr offset = ring.Allocate(lightBytes, sizeof(glm::vec4), &pointer);
+		if (pointer && lightBytes > 0)
+			memcpy(pointer, &clusters.lights[0], lightBytes);
+		lightDataOffset = offset < 0 ? 0 : (GLint)(offset / sizeof(glm::vec4));
+
+		offset = ring.Allocate(gridBytes, sizeof(GLuint), &pointer);
+		if (pointer && gridBytes > 0)
+			memcpy(pointer, &clusters.grid[0], gridBytes);
+		lightGridOffset = offset < 0 ? 0 : (GLint)(offset / sizeof(GLuint));
+
+		ring.FinishWrites();
+		gps::RenderStats::Current().bufferBytesUploaded += lightBytes + gridBytes;
+		nearPlane = clusters.nearPlane;
+		farPlane = clusters.farPlane;
+	}
+
+	void ClusteredLights::EndFrame()
+	{
+		ring.EndFrame();
+	}
+
+	void ClusteredLights::Bind(gps::Shader& shader, int lightDataUnit, int lightGridUnit, int framebufferWidth, int framebufferHeight)
+	{
+		GLuint program = shader.shaderProgram;
+		glActiveTexture(GL_TEXTURE0 + lightDataUnit);
+		gl::BindTexture(GL_TEXTURE_BUFFER, lightDataTexture);
+		gl::Uniform1i(glGetUniformLocation(program, "lightData"), lightDataUnit);
+		glActiveTexture(GL_TEXTURE0 + lightGridUnit);
+		gl::BindTexture(GL_TEXTURE_BUFFER, lightGridTexture);
+		gl::Uniform1i(glGetUniformLocation(program, "lightGrid"), lightGridUnit);
+		glActiveTexture(GL_TEXTURE0);
+
+		gl::Uniform1i(glGetUniformLocation(program, "lightDataOffset"), lightDataOffset);
+		gl::Uniform1i(glGetUniformLocation(program, "lightGridOffset"), lightGridOffset);
+		glUniform2f(glGetUniformLocation(program, "clusterTileSize"),
+			(float)framebufferWidth / LightClusters::CLUSTERS_X, (float)framebufferHeight / LightClusters::CLUSTERS_Y);
+		gl::Uniform1f(glGetUniformLocation(program, "clusterNear"), nearPlane);
+		gl::Uniform1f(glGetUniformLocation(program, "clusterDepthScale"), LightClusters::CLUSTERS_Z / std::log(farPlane / nearPlane));
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef ClusteredLights_hpp
+#define ClusteredLights_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "JobSystem.hpp"
+#include "RingBuffer.hpp"
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    enum LIGHT_TYPE { LIGHT_POINT, LIGHT_SPOT };
+
+    // Point or spot light in world space; the light fades out completely at range
+    struct Light
+    {
+        LIGHT_TYPE type;
+        glm::vec3 position;
+        glm::vec3 color;
+        float range;
+        // spot lights only: direction the cone points to and the cosines of its inner and outer angles
+        glm::vec3 direction;
+        float cosInnerCone;
+        float cosOuterCone;
+    };
+
+    // Lights of one frame sorted into a froxel grid: CLUSTERS_X x CLUSTERS_Y screen tiles times
+    // CLUSTERS_Z depth slices spaced exponentially between nearPlane and farPlane
+    struct LightClusters
+    {
+        static const int CLUSTERS_X = 16;
+        static const int CLUSTERS_Y = 9;
+        static const int CLUSTERS_Z = 24;
+        static const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+        float nearPlane;
+        float farPlane;
+        // three texels per light, view space: position and range, color and cos outer cone (-2 for
+        // point lights), direction and cos inner cone
+        std::vector<glm::vec4> lights;
+        // offset and count per cluster, x fastest then y then z, followed by the light indices they refer to
+        std::vector<GLuint> grid;
+    };
+
+    // Clustered forward lighting: lights are assigned to froxels on the CPU and every fragment only
+    // loops over the lights of its own cluster
+    class ClusteredLights
+    {
+    public:
+        ClusteredLights();
+
+        // Bins the lights into the clusters of the view; simulation side, the depth slices are split over the workers
+        static void Build(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection,
+            float nearPlane, float farPlane, gps::JobSystem& jobSystem, LightClusters& clusters);
+
+        void Create();
+        void Destroy();
+
+        // Streams the clusters of this frame; call EndFrame after the last draw that reads them
+        void Upload(const LightClusters& clusters);
+        void EndFrame();
+
+        // Points the shader in use at the uploaded clusters; both buffer textures need a unit of their own
+        void Bind(gps::Shader& shader, int lightDataUnit, int lightGridUnit, int framebufferWidth, int framebufferHeight);
+
+    private:
+        gps::RingBuffer ring;
+        // two views of the ring: RGBA32F for the lights, R32UI for the grid
+        GLuint lightDataTexture;
+        GLuint lightGridTexture;
+        GLint lightDataOffset;
+        GLint lightGridOffset;
+        float nearPlane;
+        float farPlane;
+
+        void AttachRing();
+    };
+}
+
+#endif /* ClusteredLights_hpp */
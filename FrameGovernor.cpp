@@ -0,0 +1,83 @@
+#include "FrameGovernor.hpp"
+
+namespace gps {
+
+	// highest quality first; each rung gives up a little on one axis
+	static const GovernorLevel LEVELS[] = {
+		{ 1.0f, 2048, 1.0f },
+		{ 0.9f, 2048, 1.0f },
+		{ 0.8f, 2048, 1.0f },
+		{ 0.8f, 1024, 1.0f },
+		{ 0.7f, 1024, 1.5f },
+		{ 0.6f, 1024, 1.5f },
+		{ 0.6f, 512, 2.0f },
+		{ 0.5f, 512, 2.0f },
+	};
+	static const int LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+	// GPU timer latency plus enough frames for the average to settle on the new cost
+	static const int COOLDOWN_FRAMES = 30;
+
+	FrameGovernor::FrameGovernor()
+	{
+		this->targetMs = 0.0;
+		this->hysteresis = 0.1;
+		this->smoothedMs = 0.0;
+		this->level = 0;
+		this->cooldownFrames = 0;
+		this->framesSeen = 0;
+	}
+
+	void FrameGovernor::Configure(double targetMs, double hysteresis)
+	{
+		this->targetMs = targetMs;
+		this->hysteresis = hysteresis;
+		this->level = 0;
+		this->cooldownFrames = COOLDOWN_FRAMES;
+	}
+
+	bool FrameGovernor::Update(double gpuFrameMs)
+	{
+		framesSeen++;
+		smoothedMs = framesSeen == 1 ? gpuFrameMs : smoothedMs + (gpuFrameMs - smoothedMs) * 0.1;
+		if (targetMs <= 0.0)
+			return false;
+		if (cooldownFrames > 0) {
+			cooldownFrames--;
+			return false;
+		}
+
+		int next = level;
+		if (smoothedMs > targetMs * (1.0 + hysteresis) && level < LEVEL_COUNT - 1)
+			next = level + 1;
+		// stepping up costs roughly one rung, so only when there is room for it
+		else if (smoothedMs < targetMs * (1.0 - 2.0 * hysteresis) && level > 0)
+			next = level - 1;
+		if (next == level)
+			return false;
+
+		level = next;
+		cooldownFrames = COOLDOWN_FRAMES;
+		return true;
+	}
+
+	const GovernorLevel& FrameGovernor::GetLevel()
+	{
+		return LEVELS[level];
+	}
+
+	int FrameGovernor::GetLevelIndex()
+	{
+		return level;
+	}
+
+	double FrameGovernor::GetSmoothedMs()
+	{
+		return smoothedMs;
+	}
+
+	bool FrameGovernor::IsEnabled()
+	{
+		return targetMs > 0.0;
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef FrameGovernor_hpp
+#define FrameGovernor_hpp
+
+#include <cstdint>
+
+namespace gps {
+
+    // One rung of the quality ladder
+    struct GovernorLevel
+    {
+        // fraction of the framebuffer size the main passes render at
+        float renderScale;
+        int shadowMapSize;
+        // multiplies the projected size at which meshes start dropping LODs
+        float lodBias;
+    };
+
+    // Holds a GPU frame time by stepping along a fixed quality ladder: one rung down when the smoothed
+    // time is over the target, one rung up when it is comfortably under it
+    // Waits after each step until frames rendered with the new settings have been measured
+    class FrameGovernor
+    {
+    public:
+        FrameGovernor();
+
+        // targetMs of 0 disables the governor and keeps the top rung
+        void Configure(double targetMs, double hysteresis = 0.1);
+
+        // Feeds the GPU time of one resolved frame; returns true when the level changed
+        bool Update(double gpuFrameMs);
+
+        const GovernorLevel& GetLevel();
+        int GetLevelIndex();
+        double GetSmoothedMs();
+        bool IsEnabled();
+
+    private:
+        double targetMs;
+        double hysteresis;
+        double smoothedMs;
+        int level;
+        int cooldownFrames;
+        uint64_t framesSeen;
+    };
+}
+
+#endif /* FrameGovernor_hpp */
@@ -0,0 +1,56 @@
+#include "FramePacket.hpp"
+
+namespace gps {
+
+	FramePacketQueue::FramePacketQueue(int slotCount)
+	{
+		this->slots.resize(slotCount < 1 ? 1 : slotCount);
+		this->written = 0;
+		this->released = 0;
+		this->closed = false;
+	}
+
+	FramePacket* FramePacketQueue::BeginWrite()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return written - released < slots.size() || closed; });
+		return &slots[written % slots.size()];
+	}
+
+	void FramePacketQueue::EndWrite()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			written++;
+		}
+		condition.notify_all();
+	}
+
+	const FramePacket* FramePacketQueue::BeginRead()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return written > released || closed; });
+		// packets published before Close are still rendered
+		if (written == released)
+			return NULL;
+		return &slots[released % slots.size()];
+	}
+
+	void FramePacketQueue::EndRead()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			released++;
+		}
+		condition.notify_all();
+	}
+
+	void FramePacketQueue::Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		condition.notify_all();
+	}
+}
@@ -0,0 +1,109 @@
+#ifndef FramePacket_hpp
+#define FramePacket_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+#include "ClusteredLights.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    // One object to draw, with everything the passes need precomputed
+    struct DrawItem
+    {
+        gps::Model3D* object;
+        glm::mat4 model;
+        glm::mat3 normalMatrix;
+        // level of detail per mesh of the object, for the main and the shadow pass
+        std::vector<unsigned char> lods;
+        std::vector<unsigned char> shadowLods;
+        // meshlets of the main-pass levels that survived culling against the camera
+        gps::ClusterDrawList clusters;
+    };
+
+    // GPU layout of one DrawItem in the per-draw ring buffer; normalMatrix columns are padded to vec4
+    struct DrawData
+    {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+    };
+
+    // Snapshot of the simulation handed to the render thread; never modified once published
+    struct FramePacket
+    {
+        uint64_t frameIndex;
+        int framebufferWidth;
+        int framebufferHeight;
+        // area the main passes draw to, framebuffer size times the governor's render scale
+        float renderScale;
+        int renderWidth;
+        int renderHeight;
+
+        //camera
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 cameraPosition;
+
+        //lights
+        glm::vec3 lightColor;
+        glm::vec3 lightDirEye;
+        glm::mat4 lightSpaceTrMatrix;
+        glm::mat4 lightCubeModel;
+        // lamps binned into the froxels of this view
+        gps::LightClusters lightClusters;
+
+        //toggles
+        bool showDepthMap;
+        int initFog;
+        float fogDensity;
+        int initSpotLight;
+        // gps::SHADER_FEATURE bits picking the variant of the lit shaders
+        unsigned int shaderFeatures;
+        GLenum polygonMode;
+        bool multisample;
+        bool deferredShading;
+
+        //visible objects
+        std::vector<DrawItem> drawList;
+        // far trees drawn as impostors: bounds center in world space and scale per instance
+        std::vector<glm::vec4> impostorInstances;
+        glm::mat3 impostorRotation;
+        // bounding boxes of models still streaming in, as model matrices of the light cube
+        std::vector<glm::mat4> placeholders;
+    };
+
+    // Fixed ring of packets between one producer (simulation) and one consumer (render thread)
+    // With 2 slots the simulation builds frame N+1 while frame N is submitted; 3 adds one more frame of slack
+    class FramePacketQueue
+    {
+    public:
+        FramePacketQueue(int slotCount = 2);
+
+        // producer - blocks while every slot is queued or being rendered
+        FramePacket* BeginWrite();
+        void EndWrite();
+
+        // consumer - blocks until a packet is published, returns NULL once the queue is closed and drained
+        const FramePacket* BeginRead();
+        void EndRead();
+
+        // wakes both sides; BeginRead returns NULL once the packets already published are read
+        void Close();
+
+    private:
+        std::vector<FramePacket> slots;
+        uint64_t written;
+        uint64_t released;
+        bool closed;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+}
+
+#endif /* FramePacket_hpp */
@@ -0,0 +1,113 @@
+#include "GBuffer.hpp"
+#include "GpuMemory.hpp"
+#include "RenderStats.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	GBuffer::GBuffer()
+	{
+		this->framebuffer = 0;
+		this->albedoSpecularTexture = 0;
+		this->normalTexture = 0;
+		this->depthTexture = 0;
+		this->width = 0;
+		this->height = 0;
+	}
+
+	static GLuint CreateTexture(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		// the lighting pass reads exactly one texel per pixel
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	bool GBuffer::Create(int width, int height)
+	{
+		this->width = width;
+		this->height = height;
+
+		albedoSpecularTexture = CreateTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+		normalTexture = CreateTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+		depthTexture = CreateTexture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecularTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		GpuMemory::Track(GL_TEXTURE, albedoSpecularTexture, GPU_MEMORY_RENDER_TARGET,
+			GpuMemory::TextureBytes(width, height, 4, false), "g-buffer", "albedo/specular");
+		GpuMemory::Track(GL_TEXTURE, normalTexture, GPU_MEMORY_RENDER_TARGET,
+			GpuMemory::TextureBytes(width, height, 4, false), "g-buffer", "normal");
+		GpuMemory::Track(GL_TEXTURE, depthTexture, GPU_MEMORY_RENDER_TARGET,
+			GpuMemory::TextureBytes(width, height, 4, false), "g-buffer", "depth");
+
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: g-buffer %dx%d is incomplete (0x%x)\n", width, height, status);
+			Destroy();
+			return false;
+		}
+		return true;
+	}
+
+	void GBuffer::Destroy()
+	{
+		if (framebuffer)
+			glDeleteFramebuffers(1, &framebuffer);
+		GLuint textures[] = { albedoSpecularTexture, normalTexture, depthTexture };
+		for (int i = 0; i < 3; i++) {
+			if (textures[i]) {
+				GpuMemory::Release(GL_TEXTURE, textures[i]);
+				glDeleteTextures(1, &textures[i]);
+			}
+		}
+		framebuffer = 0;
+		albedoSpecularTexture = 0;
+		normalTexture = 0;
+		depthTexture = 0;
+		width = 0;
+		height = 0;
+	}
+
+	void GBuffer::BindTextures(gps::Shader& shader, int firstUnit)
+	{
+		GLuint textures[] = { albedoSpecularTexture, normalTexture, depthTexture };
+		const char* names[] = { "gAlbedoSpecular", "gNormal", "gDepth" };
+		for (int i = 0; i < 3; i++) {
+			glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+			gl::BindTexture(GL_TEXTURE_2D, textures[i]);
+			gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, names[i]), firstUnit + i);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	GLuint GBuffer::GetFramebuffer()
+	{
+		return framebuffer;
+	}
+
+	int GBuffer::GetWidth()
+	{
+		return width;
+	}
+
+	int GBuffer::GetHeight()
+	{
+		return height;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef GBuffer_hpp
+#define GBuffer_hpp
+
+#include <GL/glew.h>
+
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Geometry buffer of the deferred path, 10 bytes per pixel:
+    // linear albedo with specular intensity in alpha, octahedral eye space normal in RG16, 24-bit depth
+    // Positions are reconstructed from depth in the lighting pass
+    class GBuffer
+    {
+    public:
+        GBuffer();
+
+        bool Create(int width, int height);
+        void Destroy();
+
+        // Binds the three textures to firstUnit, firstUnit + 1 and firstUnit + 2 for the shader in use
+        void BindTextures(gps::Shader& shader, int firstUnit);
+
+        GLuint GetFramebuffer();
+        int GetWidth();
+        int GetHeight();
+
+    private:
+        GLuint framebuffer;
+        GLuint albedoSpecularTexture;
+        GLuint normalTexture;
+        GLuint depthTexture;
+        int width;
+        int height;
+    };
+}
+
+#endif /* GBuffer_hpp */
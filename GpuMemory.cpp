@@ -0,0 +1,179 @@
+#include "GpuMemory.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+namespace gps {
+
+	static std::mutex registryMutex;
+
+	std::vector<GpuAllocation> GpuMemory::allocations;
+	size_t GpuMemory::total = 0;
+	size_t GpuMemory::highWaterMark = 0;
+
+	static const char* CATEGORY_NAMES[GPU_MEMORY_CATEGORY_COUNT] = {
+		"vertex buffers",
+		"index buffers",
+		"textures",
+		"render targets",
+		"streaming buffers",
+		"uniform buffers",
+	};
+
+	static double ToMegabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	void GpuMemory::Track(GLenum identifier, GLuint name, GPU_MEMORY_CATEGORY category, size_t bytes,
+		const std::string& owner, const std::string& label)
+	{
+		if (!name)
+			return;
+
+		if (GLEW_KHR_debug) {
+			std::string objectLabel = owner + ": " + label;
+			glObjectLabel(identifier, name, -1, objectLabel.c_str());
+		}
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (size_t i = 0; i < allocations.size(); i++) {
+			if (allocations[i].identifier == identifier && allocations[i].name == name) {
+				total -= allocations[i].bytes;
+				allocations.erase(allocations.begin() + i);
+				break;
+			}
+		}
+
+		GpuAllocation allocation;
+		allocation.identifier = identifier;
+		allocation.name = name;
+		allocation.category = category;
+		allocation.bytes = bytes;
+		allocation.owner = owner;
+		allocation.label = label;
+		allocations.push_back(allocation);
+
+		total += bytes;
+		highWaterMark = std::max(highWaterMark, total);
+	}
+
+	void GpuMemory::Release(GLenum identifier, GLuint name)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (size_t i = 0; i < allocations.size(); i++) {
+			if (allocations[i].identifier == identifier && allocations[i].name == name) {
+				total -= allocations[i].bytes;
+				allocations.erase(allocations.begin() + i);
+				return;
+			}
+		}
+	}
+
+	size_t GpuMemory::TextureBytes(int width, int height, int bytesPerTexel, bool mipmapped, int layers)
+	{
+		size_t bytes = 0;
+		while (true) {
+			bytes += (size_t)width * height * bytesPerTexel;
+			if (!mipmapped || (width == 1 && height == 1))
+				break;
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return bytes * layers;
+	}
+
+	size_t GpuMemory::GetTotal()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		return total;
+	}
+
+	size_t GpuMemory::GetHighWaterMark()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		return highWaterMark;
+	}
+
+	size_t GpuMemory::GetCategoryTotal(GPU_MEMORY_CATEGORY category)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		size_t bytes = 0;
+		for (size_t i = 0; i < allocations.size(); i++) {
+			if (allocations[i].category == category)
+				bytes += allocations[i].bytes;
+		}
+		return bytes;
+	}
+
+	size_t GpuMemory::GetOwnerTotal(const std::string& owner)
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		size_t bytes = 0;
+		for (size_t i = 0; i < allocations.size(); i++) {
+			if (allocations[i].owner == owner)
+				bytes += allocations[i].bytes;
+		}
+		return bytes;
+	}
+
+	const char* GpuMemory::GetCategoryName(GPU_MEMORY_CATEGORY category)
+	{
+		return category < GPU_MEMORY_CATEGORY_COUNT ? CATEGORY_NAMES[category] : "unknown";
+	}
+
+	void GpuMemory::PrintSummary()
+	{
+		std::vector<GpuAllocation> snapshot;
+		size_t currentTotal, peak;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			snapshot = allocations;
+			currentTotal = total;
+			peak = highWaterMark;
+		}
+
+		printf("GPU memory: %.2f MB in %zu objects, high-water mark %.2f MB\n", ToMegabytes(currentTotal), snapshot.size(), ToMegabytes(peak));
+
+		size_t categoryBytes[GPU_MEMORY_CATEGORY_COUNT] = {};
+		std::vector<std::pair<std::string, size_t> > owners;
+		for (size_t i = 0; i < snapshot.size(); i++) {
+			categoryBytes[snapshot[i].category] += snapshot[i].bytes;
+
+			size_t o = 0;
+			while (o < owners.size() && owners[o].first != snapshot[i].owner)
+				o++;
+			if (o == owners.size())
+				owners.push_back(std::make_pair(snapshot[i].owner, (size_t)0));
+			owners[o].second += snapshot[i].bytes;
+		}
+
+		for (int c = 0; c < GPU_MEMORY_CATEGORY_COUNT; c++)
+			printf("  %-24s %9.2f MB\n", CATEGORY_NAMES[c], ToMegabytes(categoryBytes[c]));
+
+		std::sort(owners.begin(), owners.end(),
+			[](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) { return a.second > b.second; });
+		printf("  by owner:\n");
+		for (size_t o = 0; o < owners.size(); o++)
+			printf("    %-32s %9.2f MB\n", owners[o].first.c_str(), ToMegabytes(owners[o].second));
+	}
+
+	void GpuMemory::Dump()
+	{
+		std::vector<GpuAllocation> snapshot;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			snapshot = allocations;
+		}
+		std::sort(snapshot.begin(), snapshot.end(),
+			[](const GpuAllocation& a, const GpuAllocation& b) { return a.bytes > b.bytes; });
+
+		printf("GPU allocations (%zu)\n", snapshot.size());
+		for (size_t i = 0; i < snapshot.size(); i++) {
+			printf("  %10.1f KB  %-18s %-24s %s\n", snapshot[i].bytes / 1024.0, CATEGORY_NAMES[snapshot[i].category],
+				snapshot[i].owner.c_str(), snapshot[i].label.c_str());
+		}
+		PrintSummary();
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef GpuMemory_hpp
+#define GpuMemory_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum GPU_MEMORY_CATEGORY {GPU_MEMORY_VERTEX_BUFFER, GPU_MEMORY_INDEX_BUFFER, GPU_MEMORY_TEXTURE, GPU_MEMORY_RENDER_TARGET, GPU_MEMORY_STREAMING_BUFFER, GPU_MEMORY_UNIFORM_BUFFER, GPU_MEMORY_CATEGORY_COUNT};
+
+    // One tracked GL object; bytes is an estimate, drivers add their own padding and alignment
+    struct GpuAllocation
+    {
+        GLenum identifier;
+        GLuint name;
+        GPU_MEMORY_CATEGORY category;
+        size_t bytes;
+        std::string owner;
+        std::string label;
+    };
+
+    // Registry of the GL objects that hold video memory, keyed by (identifier, name)
+    // Track/Release come from the GL thread; the reports may be requested from any thread
+    class GpuMemory
+    {
+    public:
+        // identifier is GL_BUFFER, GL_TEXTURE or GL_RENDERBUFFER; tracking an object again replaces its entry
+        // The label is also attached to the object with glObjectLabel when KHR_debug is available
+        static void Track(GLenum identifier, GLuint name, GPU_MEMORY_CATEGORY category, size_t bytes,
+            const std::string& owner, const std::string& label);
+        static void Release(GLenum identifier, GLuint name);
+
+        // Size of a texture, including the whole mip chain when mipmapped
+        static size_t TextureBytes(int width, int height, int bytesPerTexel, bool mipmapped, int layers = 1);
+
+        static size_t GetTotal();
+        static size_t GetHighWaterMark();
+        static size_t GetCategoryTotal(GPU_MEMORY_CATEGORY category);
+        static size_t GetOwnerTotal(const std::string& owner);
+        static const char* GetCategoryName(GPU_MEMORY_CATEGORY category);
+
+        // Totals per category and per owner
+        static void PrintSummary();
+        // Every live allocation, largest first
+        static void Dump();
+
+    private:
+        static std::vector<GpuAllocation> allocations;
+        static size_t total;
+        static size_t highWaterMark;
+    };
+}
+
+#endif /* GpuMemory_hpp */
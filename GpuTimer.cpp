@@ -0,0 +1,234 @@
+#include "GpuTimer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace gps {
+
+	GpuTimer::GpuTimer()
+	{
+		this->currentSlot = 0;
+		this->recording = false;
+		this->historySize = 0;
+		this->droppedFrames = 0;
+	}
+
+	void GpuTimer::Create(int latency, size_t historySize)
+	{
+		this->slots.resize(latency < 2 ? 2 : latency);
+		for (size_t i = 0; i < slots.size(); i++) {
+			slots[i].frameIndex = 0;
+			slots[i].pending = false;
+			slots[i].queriesUsed = 0;
+			slots[i].lastIssued = 0;
+		}
+		this->historySize = historySize;
+		this->currentSlot = 0;
+	}
+
+	void GpuTimer::Destroy()
+	{
+		for (size_t i = 0; i < slots.size(); i++) {
+			if (!slots[i].queryPool.empty())
+				glDeleteQueries((GLsizei)slots[i].queryPool.size(), &slots[i].queryPool[0]);
+			slots[i].queryPool.clear();
+			slots[i].passes.clear();
+		}
+		slots.clear();
+		CloseLog();
+	}
+
+	void GpuTimer::BeginFrame(uint64_t frameIndex)
+	{
+		// collect whatever the GPU has finished, oldest first
+		for (size_t i = 1; i <= slots.size(); i++) {
+			FrameSlot& slot = slots[(currentSlot + i) % slots.size()];
+			if (slot.pending)
+				Resolve(slot);
+		}
+
+		currentSlot = (currentSlot + 1) % slots.size();
+		FrameSlot& slot = slots[currentSlot];
+		if (slot.pending) {
+			// the GPU is more than `latency` frames behind - skip timing this frame rather than stall
+			recording = false;
+			droppedFrames++;
+			return;
+		}
+
+		slot.frameIndex = frameIndex;
+		slot.passes.clear();
+		slot.queriesUsed = 0;
+		openPasses.clear();
+		recording = true;
+	}
+
+	void GpuTimer::EndFrame()
+	{
+		if (!recording)
+			return;
+		while (!openPasses.empty())
+			EndPass();
+		slots[currentSlot].pending = !slots[currentSlot].passes.empty();
+		recording = false;
+	}
+
+	void GpuTimer::BeginPass(const std::string& name)
+	{
+		if (!recording)
+			return;
+
+		FrameSlot& slot = slots[currentSlot];
+		PassQuery pass;
+		pass.name = name;
+		pass.beginQuery = NextQuery(slot);
+		pass.endQuery = NextQuery(slot);
+		pass.ended = false;
+		glQueryCounter(pass.beginQuery, GL_TIMESTAMP);
+		slot.lastIssued = pass.beginQuery;
+
+		openPasses.push_back(slot.passes.size());
+		slot.passes.push_back(pass);
+	}
+
+	void GpuTimer::EndPass()
+	{
+		if (!recording || openPasses.empty())
+			return;
+
+		FrameSlot& slot = slots[currentSlot];
+		PassQuery& pass = slot.passes[openPasses.back()];
+		openPasses.pop_back();
+		glQueryCounter(pass.endQuery, GL_TIMESTAMP);
+		slot.lastIssued = pass.endQuery;
+		pass.ended = true;
+	}
+
+	GLuint GpuTimer::NextQuery(FrameSlot& slot)
+	{
+		if (slot.queriesUsed == slot.queryPool.size()) {
+			GLuint query;
+			glGenQueries(1, &query);
+			slot.queryPool.push_back(query);
+		}
+		return slot.queryPool[slot.queriesUsed++];
+	}
+
+	bool GpuTimer::Resolve(FrameSlot& slot)
+	{
+		// queries complete in order, so the last one written tells whether the whole frame is done;
+		// that is not the last pass's end query when an outer pass such as "frame" closes after it
+		GLint available = 0;
+		glGetQueryObjectiv(slot.lastIssued, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+
+		for (size_t i = 0; i < slot.passes.size(); i++) {
+			PassQuery& pass = slot.passes[i];
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(pass.beginQuery, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(pass.endQuery, GL_QUERY_RESULT, &end);
+
+			GpuTimerSample sample;
+			sample.frameIndex = slot.frameIndex;
+			sample.pass = pass.name;
+			sample.beginNs = begin;
+			sample.endNs = end > begin ? end : begin;
+			newSamples.push_back(sample);
+
+			double durationMs = (sample.endNs - sample.beginNs) * 1e-6;
+			PassHistory& passHistory = FindHistory(pass.name);
+			passHistory.durations.push_back(durationMs);
+			while (passHistory.durations.size() > historySize)
+				passHistory.durations.pop_front();
+
+			if (log.is_open())
+				log << sample.frameIndex << "," << sample.pass << "," << sample.beginNs << "," << durationMs << "\n";
+		}
+
+		slot.pending = false;
+		return true;
+	}
+
+	GpuTimer::PassHistory& GpuTimer::FindHistory(const std::string& name)
+	{
+		for (size_t i = 0; i < history.size(); i++) {
+			if (history[i].name == name)
+				return history[i];
+		}
+		PassHistory passHistory;
+		passHistory.name = name;
+		history.push_back(passHistory);
+		return history.back();
+	}
+
+	bool GpuTimer::GetStats(const std::string& pass, GpuTimerStats& stats)
+	{
+		for (size_t i = 0; i < history.size(); i++) {
+			if (history[i].name != pass || history[i].durations.empty())
+				continue;
+
+			std::vector<double> sorted(history[i].durations.begin(), history[i].durations.end());
+			std::sort(sorted.begin(), sorted.end());
+
+			double sum = 0.0;
+			for (size_t j = 0; j < sorted.size(); j++)
+				sum += sorted[j];
+
+			stats.lastMs = history[i].durations.back();
+			stats.minMs = sorted.front();
+			stats.avgMs = sum / sorted.size();
+			stats.p95Ms = sorted[(size_t)((sorted.size() - 1) * 0.95)];
+			stats.p99Ms = sorted[(size_t)((sorted.size() - 1) * 0.99)];
+			stats.samples = sorted.size();
+			return true;
+		}
+		return false;
+	}
+
+	std::vector<std::string> GpuTimer::GetPassNames()
+	{
+		std::vector<std::string> names;
+		for (size_t i = 0; i < history.size(); i++)
+			names.push_back(history[i].name);
+		return names;
+	}
+
+	std::vector<GpuTimerSample> GpuTimer::TakeSamples()
+	{
+		std::vector<GpuTimerSample> samples;
+		samples.swap(newSamples);
+		return samples;
+	}
+
+	bool GpuTimer::OpenLog(const std::string& fileName)
+	{
+		log.open(fileName.c_str());
+		if (!log.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+		log << "frame,pass,begin_ns,duration_ms\n";
+		return true;
+	}
+
+	void GpuTimer::CloseLog()
+	{
+		if (log.is_open())
+			log.close();
+	}
+
+	void GpuTimer::PrintStats()
+	{
+		printf("GPU pass timings (ms)         last      min      avg      p95      p99\n");
+		for (size_t i = 0; i < history.size(); i++) {
+			GpuTimerStats stats;
+			if (GetStats(history[i].name, stats))
+				printf("  %-24s %8.3f %8.3f %8.3f %8.3f %8.3f\n", history[i].name.c_str(),
+					stats.lastMs, stats.minMs, stats.avgMs, stats.p95Ms, stats.p99Ms);
+		}
+		if (droppedFrames > 0)
+			printf("  frames not timed because the GPU was too far behind: %llu\n", (unsigned long long)droppedFrames);
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct GpuTimerStats
+    {
+        double lastMs;
+        double minMs;
+        double avgMs;
+        double p95Ms;
+        double p99Ms;
+        size_t samples;
+    };
+
+    // One resolved pass: GPU timestamps in nanoseconds
+    struct GpuTimerSample
+    {
+        uint64_t frameIndex;
+        std::string pass;
+        uint64_t beginNs;
+        uint64_t endNs;
+    };
+
+    // GL_TIMESTAMP queries around render passes, read back `latency` frames later so the CPU never waits
+    // Passes may nest; a pass is identified by its name
+    class GpuTimer
+    {
+    public:
+        GpuTimer();
+
+        void Create(int latency = 4, size_t historySize = 300);
+        void Destroy();
+
+        // Collects every finished frame, then starts recording into the next slot
+        void BeginFrame(uint64_t frameIndex);
+        void EndFrame();
+
+        void BeginPass(const std::string& name);
+        void EndPass();
+
+        // Rolling statistics over the last historySize frames; false if the pass has no samples yet
+        bool GetStats(const std::string& pass, GpuTimerStats& stats);
+        std::vector<std::string> GetPassNames();
+
+        // Samples resolved since the last call
+        std::vector<GpuTimerSample> TakeSamples();
+
+        // Appends "frame,pass,begin_ns,duration_ms" rows as frames resolve
+        bool OpenLog(const std::string& fileName);
+        void CloseLog();
+
+        void PrintStats();
+
+    private:
+        struct PassQuery
+        {
+            std::string name;
+            GLuint beginQuery;
+            GLuint endQuery;
+            bool ended;
+        };
+
+        struct FrameSlot
+        {
+            uint64_t frameIndex;
+            bool pending;
+            std::vector<PassQuery> passes;
+            // query objects owned by the slot, reused from frame to frame
+            std::vector<GLuint> queryPool;
+            size_t queriesUsed;
+            // the query whose timestamp was written last, which completes after all the others
+            GLuint lastIssued;
+        };
+
+        struct PassHistory
+        {
+            std::string name;
+            std::deque<double> durations;
+        };
+
+        std::vector<FrameSlot> slots;
+        int currentSlot;
+        bool recording;
+        std::vector<size_t> openPasses;
+        size_t historySize;
+        std::vector<PassHistory> history;
+        std::vector<GpuTimerSample> newSamples;
+        std::ofstream log;
+        uint64_t droppedFrames;
+
+        GLuint NextQuery(FrameSlot& slot);
+        bool Resolve(FrameSlot& slot);
+        PassHistory& FindHistory(const std::string& name);
+    };
+}
+
+#endif /* GpuTimer_hpp */
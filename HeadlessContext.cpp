@@ -0,0 +1,195 @@
+#include "HeadlessContext.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+#if defined(GPS_HEADLESS_EGL)
+
+	HeadlessContext::HeadlessContext()
+	{
+		this->display = EGL_NO_DISPLAY;
+		this->context = EGL_NO_CONTEXT;
+		this->surface = EGL_NO_SURFACE;
+	}
+
+	static bool HasExtension(const char* extensions, const char* name)
+	{
+		return extensions && strstr(extensions, name) != NULL;
+	}
+
+	bool HeadlessContext::Create()
+	{
+		// prefer a surfaceless display so no X or Wayland server is needed at all
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		bool surfaceless = false;
+		if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay) {
+				display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+				surfaceless = display != EGL_NO_DISPLAY;
+			}
+		}
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			fprintf(stderr, "ERROR: could not initialize an EGL display\n");
+			return false;
+		}
+		// a surfaceless display still needs surfaceless contexts, otherwise fall back to a pbuffer
+		surfaceless = surfaceless && HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			fprintf(stderr, "ERROR: EGL display has no desktop OpenGL\n");
+			Destroy();
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+			fprintf(stderr, "ERROR: no suitable EGL config\n");
+			Destroy();
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+			EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT) {
+			fprintf(stderr, "ERROR: could not create a GL 4.1 core context through EGL\n");
+			Destroy();
+			return false;
+		}
+
+		if (!surfaceless) {
+			// the scene renders into an FBO; the pbuffer only exists to make the context current
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+			if (surface == EGL_NO_SURFACE) {
+				fprintf(stderr, "ERROR: could not create an EGL pbuffer\n");
+				Destroy();
+				return false;
+			}
+		}
+
+		MakeCurrent();
+
+		// glewInit also looks for a GLX display, which does not exist here; the core entry points are enough
+		glewExperimental = GL_TRUE;
+		if (glewContextInit() != GLEW_OK) {
+			fprintf(stderr, "ERROR: could not load GL entry points\n");
+			Destroy();
+			return false;
+		}
+		// glewContextInit can leave a GL_INVALID_ENUM behind on core profiles
+		glGetError();
+
+		printf("Headless context: EGL %d.%d, %s\n", major, minor, surfaceless ? "surfaceless" : "pbuffer");
+		return true;
+	}
+
+	void HeadlessContext::Destroy()
+	{
+		if (display == EGL_NO_DISPLAY)
+			return;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+		surface = EGL_NO_SURFACE;
+	}
+
+	void HeadlessContext::MakeCurrent()
+	{
+		eglMakeCurrent(display, surface, surface, context);
+	}
+
+	void HeadlessContext::ReleaseCurrent()
+	{
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	}
+
+#else
+
+	HeadlessContext::HeadlessContext()
+	{
+		this->window = NULL;
+	}
+
+	bool HeadlessContext::Create()
+	{
+		if (!glfwInit()) {
+			fprintf(stderr, "ERROR: could not start GLFW3\n");
+			return false;
+		}
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		window = glfwCreateWindow(16, 16, "bench", NULL, NULL);
+		if (!window) {
+			fprintf(stderr, "ERROR: could not create a hidden GLFW window\n");
+			glfwTerminate();
+			return false;
+		}
+
+		MakeCurrent();
+		glfwSwapInterval(0);
+
+		glewExperimental = GL_TRUE;
+		if (glewInit() != GLEW_OK) {
+			fprintf(stderr, "ERROR: could not load GL entry points\n");
+			Destroy();
+			return false;
+		}
+		glGetError();
+
+		printf("Headless context: hidden GLFW window\n");
+		return true;
+	}
+
+	void HeadlessContext::Destroy()
+	{
+		if (!window)
+			return;
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		window = NULL;
+	}
+
+	void HeadlessContext::MakeCurrent()
+	{
+		glfwMakeContextCurrent(window);
+	}
+
+	void HeadlessContext::ReleaseCurrent()
+	{
+		glfwMakeContextCurrent(NULL);
+	}
+
+#endif
+}
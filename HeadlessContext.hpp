@@ -0,0 +1,42 @@
+#ifndef HeadlessContext_hpp
+#define HeadlessContext_hpp
+
+#include <GL/glew.h>
+
+// Linux hosts without a display server get their context straight from EGL (Mesa llvmpipe works);
+// everywhere else a hidden GLFW window stands in
+#if defined(__linux__)
+#define GPS_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+namespace gps {
+
+    // A GL 4.1 core context with no visible surface; rendering goes to framebuffer objects
+    class HeadlessContext
+    {
+    public:
+        HeadlessContext();
+
+        // Creates the context, makes it current and loads the GL entry points
+        bool Create();
+        void Destroy();
+
+        void MakeCurrent();
+        void ReleaseCurrent();
+
+    private:
+#if defined(GPS_HEADLESS_EGL)
+        EGLDisplay display;
+        EGLContext context;
+        EGLSurface surface;
+#else
+        GLFWwindow* window;
+#endif
+    };
+}
+
+#endif /* HeadlessContext_hpp */
@@ -0,0 +1,201 @@
+#include "Impostor.hpp"
+#include "GpuMemory.hpp"
+#include "Profiler.hpp"
+#include "RenderStats.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstdio>
+
+namespace gps {
+
+	// Hemi-octahedral mapping with y up; must match impostor.vert
+	static glm::vec3 DecodeHemiOctahedron(glm::vec2 e)
+	{
+		glm::vec2 t = glm::vec2(e.x + e.y, e.x - e.y) * 0.5f;
+		glm::vec3 direction(t.x, 1.0f - glm::abs(t.x) - glm::abs(t.y), t.y);
+		return glm::normalize(direction);
+	}
+
+	// Up vector of the view along direction, also used for the billboards
+	static glm::vec3 FrameUp(const glm::vec3& direction)
+	{
+		return glm::abs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, -1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	Impostor::Impostor()
+	{
+		this->albedoTexture = 0;
+		this->normalDepthTexture = 0;
+		this->vertexArray = 0;
+		this->framesPerSide = 0;
+		this->center = glm::vec3(0.0f);
+		this->radius = 0.0f;
+	}
+
+	static GLuint CreateAtlasTexture(GLenum internalFormat, int size)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+
+	bool Impostor::Bake(gps::Model3D& model, gps::Shader& bakeShader, int framesPerSide, int frameSize, const std::string& owner)
+	{
+		PROFILE_ZONE("BakeImpostor");
+		Destroy();
+
+		glm::vec3 boundsMin, boundsMax;
+		model.GetBounds(boundsMin, boundsMax);
+		this->center = (boundsMin + boundsMax) * 0.5f;
+		this->radius = glm::length(boundsMax - boundsMin) * 0.5f;
+		this->framesPerSide = framesPerSide;
+		if (this->radius <= 0.0f || framesPerSide < 2) {
+			fprintf(stderr, "ERROR: cannot bake an impostor of an empty model\n");
+			return false;
+		}
+
+		int atlasSize = framesPerSide * frameSize;
+		albedoTexture = CreateAtlasTexture(GL_RGBA8, atlasSize);
+		normalDepthTexture = CreateAtlasTexture(GL_RGBA8, atlasSize);
+
+		GLuint depthRenderbuffer;
+		glGenRenderbuffers(1, &depthRenderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		GLuint framebuffer;
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+		GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		glDrawBuffers(2, drawBuffers);
+
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		if (complete) {
+			GLint viewport[4];
+			GLfloat clearColor[4];
+			glGetIntegerv(GL_VIEWPORT, viewport);
+			glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			bakeShader.useShaderProgram();
+			GLint viewLoc = glGetUniformLocation(bakeShader.shaderProgram, "view");
+			GLint projectionLoc = glGetUniformLocation(bakeShader.shaderProgram, "projection");
+			// orthographic through the bounding sphere: depth 0 at its front, 1 at its back
+			glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+			glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+
+			for (int y = 0; y < framesPerSide; y++) {
+				for (int x = 0; x < framesPerSide; x++) {
+					glm::vec2 grid = glm::vec2((float)x, (float)y) / (float)(framesPerSide - 1) * 2.0f - 1.0f;
+					glm::vec3 direction = DecodeHemiOctahedron(grid);
+					glm::mat4 view = glm::lookAt(center + direction * (2.0f * radius), center, FrameUp(direction));
+					glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+
+					glViewport(x * frameSize, y * frameSize, frameSize, frameSize);
+					model.Draw(bakeShader);
+				}
+			}
+
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+			glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &depthRenderbuffer);
+
+		if (!complete) {
+			fprintf(stderr, "ERROR: impostor framebuffer is incomplete\n");
+			Destroy();
+			return false;
+		}
+
+		GLuint textures[] = { albedoTexture, normalDepthTexture };
+		const char* labels[] = { "albedo atlas", "normal/depth atlas" };
+		for (int i = 0; i < 2; i++) {
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			GpuMemory::Track(GL_TEXTURE, textures[i], GPU_MEMORY_TEXTURE, GpuMemory::TextureBytes(atlasSize, atlasSize, 4, true), owner, labels[i]);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		// corners come from gl_VertexID, the only attribute is the per-instance vec4
+		glGenVertexArrays(1, &vertexArray);
+		return true;
+	}
+
+	void Impostor::Destroy()
+	{
+		GLuint textures[] = { albedoTexture, normalDepthTexture };
+		for (int i = 0; i < 2; i++) {
+			if (textures[i]) {
+				GpuMemory::Release(GL_TEXTURE, textures[i]);
+				glDeleteTextures(1, &textures[i]);
+			}
+		}
+		if (vertexArray)
+			glDeleteVertexArrays(1, &vertexArray);
+		albedoTexture = 0;
+		normalDepthTexture = 0;
+		vertexArray = 0;
+	}
+
+	bool Impostor::IsBaked()
+	{
+		return vertexArray != 0;
+	}
+
+	void Impostor::Draw(gps::Shader& shader, GLintptr instanceOffset, GLsizei instanceCount)
+	{
+		if (!vertexArray || instanceCount == 0)
+			return;
+
+		shader.useShaderProgram();
+		glActiveTexture(GL_TEXTURE0);
+		gl::BindTexture(GL_TEXTURE_2D, albedoTexture);
+		gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "albedoAtlas"), 0);
+		glActiveTexture(GL_TEXTURE1);
+		gl::BindTexture(GL_TEXTURE_2D, normalDepthTexture);
+		gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "normalDepthAtlas"), 1);
+		gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "framesPerSide"), framesPerSide);
+		gl::Uniform1f(glGetUniformLocation(shader.shaderProgram, "radius"), radius);
+		gl::Uniform3fv(glGetUniformLocation(shader.shaderProgram, "boundsCenter"), 1, glm::value_ptr(center));
+
+		gl::BindVertexArray(vertexArray);
+		// the instance stream moves every frame, so the pointer is set per draw
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)instanceOffset);
+		glVertexAttribDivisor(0, 1);
+		gl::DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+		gl::BindVertexArray(0);
+
+		glActiveTexture(GL_TEXTURE1);
+		gl::BindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		gl::BindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glm::vec3 Impostor::GetCenter()
+	{
+		return center;
+	}
+
+	float Impostor::GetRadius()
+	{
+		return radius;
+	}
+}
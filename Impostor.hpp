@@ -0,0 +1,44 @@
+#ifndef Impostor_hpp
+#define Impostor_hpp
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Model3D.hpp"
+#include "Shader.hpp"
+
+namespace gps {
+
+    // Octahedral impostor of a model: an atlas of views over the upper hemisphere, drawn as one camera-facing
+    // quad per instance that blends the four views closest to the viewing direction
+    // Atlases: linear albedo with coverage in alpha, object space normal with depth through the bounds in alpha
+    class Impostor
+    {
+    public:
+        Impostor();
+
+        // Renders the model into a framesPerSide x framesPerSide grid of frameSize pixel views
+        // GL thread only; leaves framebuffer 0 bound and restores the viewport and clear color
+        bool Bake(gps::Model3D& model, gps::Shader& bakeShader, int framesPerSide = 8, int frameSize = 128, const std::string& owner = "impostor");
+        void Destroy();
+        bool IsBaked();
+
+        // Draws instanceCount instances read as vec4(bounds center in world space, scale) from the bound
+        // GL_ARRAY_BUFFER at instanceOffset; the caller sets the view, lighting and objectRotation uniforms
+        void Draw(gps::Shader& shader, GLintptr instanceOffset, GLsizei instanceCount);
+
+        // Bounding sphere the views were framed on, object space
+        glm::vec3 GetCenter();
+        float GetRadius();
+
+    private:
+        GLuint albedoTexture;
+        GLuint normalDepthTexture;
+        GLuint vertexArray;
+        int framesPerSide;
+        glm::vec3 center;
+        float radius;
+    };
+}
+
+#endif /* Impostor_hpp */
@@ -0,0 +1,202 @@
+#include "InputRecording.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+	// file layout: header, then events as (u32 tick, u8 type, payload), then poses as 6 floats
+	// key payload is i16 key + u8 action, cursor payload is two doubles
+	static const char RECORDING_MAGIC[4] = { 'G', 'P', 'S', 'R' };
+	static const uint32_t RECORDING_VERSION = 1;
+
+	template <typename T>
+	static void WriteValue(std::ofstream& file, T value)
+	{
+		file.write((const char*)&value, sizeof(T));
+	}
+
+	template <typename T>
+	static bool ReadValue(std::ifstream& file, T& value)
+	{
+		file.read((char*)&value, sizeof(T));
+		return file.good();
+	}
+
+	InputRecording::InputRecording()
+	{
+		this->mode = RECORD_INPUT;
+		this->tickCount = 0;
+	}
+
+	void InputRecording::Clear(RECORDING_MODE mode)
+	{
+		this->mode = mode;
+		this->tickCount = 0;
+		this->events.clear();
+		this->poses.clear();
+	}
+
+	void InputRecording::AddKey(uint32_t tick, int key, int action)
+	{
+		InputEvent event;
+		event.tick = tick;
+		event.type = INPUT_KEY;
+		event.key = key;
+		event.action = action;
+		event.x = 0.0;
+		event.y = 0.0;
+		events.push_back(event);
+	}
+
+	void InputRecording::AddCursor(uint32_t tick, double x, double y)
+	{
+		InputEvent event;
+		event.tick = tick;
+		event.type = INPUT_CURSOR;
+		event.key = 0;
+		event.action = 0;
+		event.x = x;
+		event.y = y;
+		events.push_back(event);
+	}
+
+	void InputRecording::AddPose(const CameraPose& pose)
+	{
+		poses.push_back(pose);
+	}
+
+	void InputRecording::SetTickCount(uint32_t tickCount)
+	{
+		this->tickCount = tickCount;
+	}
+
+	bool InputRecording::Save(const std::string& fileName)
+	{
+		std::ofstream file(fileName.c_str(), std::ios::binary);
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+		WriteValue<uint32_t>(file, RECORDING_VERSION);
+		WriteValue<uint8_t>(file, (uint8_t)mode);
+		WriteValue<uint32_t>(file, tickCount);
+		WriteValue<uint32_t>(file, (uint32_t)events.size());
+		WriteValue<uint32_t>(file, (uint32_t)poses.size());
+
+		for (size_t i = 0; i < events.size(); i++) {
+			const InputEvent& event = events[i];
+			WriteValue<uint32_t>(file, event.tick);
+			WriteValue<uint8_t>(file, (uint8_t)event.type);
+			if (event.type == INPUT_KEY) {
+				WriteValue<int16_t>(file, (int16_t)event.key);
+				WriteValue<uint8_t>(file, (uint8_t)event.action);
+			}
+			else {
+				WriteValue<double>(file, event.x);
+				WriteValue<double>(file, event.y);
+			}
+		}
+
+		for (size_t i = 0; i < poses.size(); i++) {
+			for (int c = 0; c < 3; c++)
+				WriteValue<float>(file, poses[i].position[c]);
+			for (int c = 0; c < 3; c++)
+				WriteValue<float>(file, poses[i].frontDirection[c]);
+		}
+
+		printf("Recording: %u ticks, %zu events, %zu poses saved to %s\n", tickCount, events.size(), poses.size(), fileName.c_str());
+		return file.good();
+	}
+
+	bool InputRecording::Load(const std::string& fileName)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		char magic[4];
+		uint32_t version;
+		uint8_t fileMode;
+		uint32_t eventCount, poseCount;
+		file.read(magic, sizeof(magic));
+		if (!file.good() || memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0
+			|| !ReadValue(file, version) || version != RECORDING_VERSION) {
+			fprintf(stderr, "ERROR: %s is not a recording this build can read\n", fileName.c_str());
+			return false;
+		}
+		if (!ReadValue(file, fileMode) || !ReadValue(file, tickCount) || !ReadValue(file, eventCount) || !ReadValue(file, poseCount)) {
+			fprintf(stderr, "ERROR: %s is truncated\n", fileName.c_str());
+			return false;
+		}
+		mode = fileMode == RECORD_CAMERA_POSE ? RECORD_CAMERA_POSE : RECORD_INPUT;
+
+		events.clear();
+		events.reserve(eventCount);
+		for (uint32_t i = 0; i < eventCount; i++) {
+			uint32_t tick;
+			uint8_t type;
+			if (!ReadValue(file, tick) || !ReadValue(file, type))
+				break;
+			if (type == INPUT_KEY) {
+				int16_t key;
+				uint8_t action;
+				if (!ReadValue(file, key) || !ReadValue(file, action))
+					break;
+				AddKey(tick, key, action);
+			}
+			else {
+				double x, y;
+				if (!ReadValue(file, x) || !ReadValue(file, y))
+					break;
+				AddCursor(tick, x, y);
+			}
+		}
+
+		poses.clear();
+		poses.reserve(poseCount);
+		for (uint32_t i = 0; i < poseCount; i++) {
+			CameraPose pose;
+			bool ok = true;
+			for (int c = 0; c < 3; c++)
+				ok = ok && ReadValue(file, pose.position[c]);
+			for (int c = 0; c < 3; c++)
+				ok = ok && ReadValue(file, pose.frontDirection[c]);
+			if (!ok)
+				break;
+			poses.push_back(pose);
+		}
+
+		if (events.size() != eventCount || poses.size() != poseCount) {
+			fprintf(stderr, "ERROR: %s is truncated\n", fileName.c_str());
+			return false;
+		}
+		printf("Recording: %u ticks, %zu events, %zu poses loaded from %s\n", tickCount, events.size(), poses.size(), fileName.c_str());
+		return true;
+	}
+
+	RECORDING_MODE InputRecording::GetMode()
+	{
+		return mode;
+	}
+
+	uint32_t InputRecording::GetTickCount()
+	{
+		return tickCount;
+	}
+
+	const std::vector<InputEvent>& InputRecording::GetEvents()
+	{
+		return events;
+	}
+
+	const std::vector<CameraPose>& InputRecording::GetPoses()
+	{
+		return poses;
+	}
+}
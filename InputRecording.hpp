@@ -0,0 +1,63 @@
+#ifndef InputRecording_hpp
+#define InputRecording_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum RECORDING_MODE {RECORD_INPUT, RECORD_CAMERA_POSE};
+    enum INPUT_EVENT_TYPE {INPUT_KEY, INPUT_CURSOR};
+
+    // A raw GLFW event, stamped with the simulation tick it was applied before
+    struct InputEvent
+    {
+        uint32_t tick;
+        INPUT_EVENT_TYPE type;
+        int key;
+        int action;
+        double x;
+        double y;
+    };
+
+    struct CameraPose
+    {
+        glm::vec3 position;
+        glm::vec3 frontDirection;
+    };
+
+    // Input events or per-tick camera poses, saved as a compact binary file in host byte order
+    // The simulation advances a fixed step per tick, so replaying the same events on the same ticks is exact
+    class InputRecording
+    {
+    public:
+        InputRecording();
+
+        void Clear(RECORDING_MODE mode);
+
+        void AddKey(uint32_t tick, int key, int action);
+        void AddCursor(uint32_t tick, double x, double y);
+        // one pose per tick, in tick order
+        void AddPose(const CameraPose& pose);
+        void SetTickCount(uint32_t tickCount);
+
+        bool Save(const std::string& fileName);
+        bool Load(const std::string& fileName);
+
+        RECORDING_MODE GetMode();
+        uint32_t GetTickCount();
+        const std::vector<InputEvent>& GetEvents();
+        const std::vector<CameraPose>& GetPoses();
+
+    private:
+        RECORDING_MODE mode;
+        uint32_t tickCount;
+        std::vector<InputEvent> events;
+        std::vector<CameraPose> poses;
+    };
+}
+
+#endif /* InputRecording_hpp */
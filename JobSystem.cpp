@@ -0,0 +1,404 @@
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	// index into JobSystem::workers for the calling thread, -1 for threads without a deque
+	static thread_local int tlsWorkerIndex = -1;
+	static thread_local uint32_t tlsRandomState = 0;
+
+	WorkStealingQueue::WorkStealingQueue(size_t capacity) : top(0), bottom(0)
+	{
+		// capacity must be a power of two so the ring can be indexed with a mask
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		this->mask = (int64_t)size - 1;
+		this->jobs = new std::atomic<Job*>[size];
+		for (size_t i = 0; i < size; i++)
+			this->jobs[i].store(NULL, std::memory_order_relaxed);
+	}
+
+	WorkStealingQueue::~WorkStealingQueue()
+	{
+		delete[] this->jobs;
+	}
+
+	bool WorkStealingQueue::Push(Job* job)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t > mask) {
+			//full
+			return false;
+		}
+		jobs[b & mask].store(job, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Job* WorkStealingQueue::Pop()
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		Job* job = NULL;
+		if (t <= b) {
+			job = jobs[b & mask].load(std::memory_order_relaxed);
+			if (t == b) {
+				// last element - race against thieves
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					job = NULL;
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+		}
+		else {
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	Job* WorkStealingQueue::Steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t < b) {
+			Job* job = jobs[t & mask].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				return NULL;
+			return job;
+		}
+		return NULL;
+	}
+
+	JobSystem::~JobSystem()
+	{
+		Shutdown();
+	}
+
+	void JobSystem::Init(unsigned int workerCount)
+	{
+		if (running)
+			return;
+
+		if (workerCount == 0) {
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
+			workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+
+		mainThreadId = std::this_thread::get_id();
+		running = true;
+
+		// slot 0 belongs to the main thread so it can push and help while waiting
+		for (unsigned int i = 0; i <= workerCount; i++)
+			workers.push_back(new Worker());
+		tlsWorkerIndex = 0;
+
+		for (unsigned int i = 1; i <= workerCount; i++)
+			workers[i]->thread = std::thread(&JobSystem::WorkerLoop, this, i);
+
+		ResetStats();
+		printf("Job system: %u worker threads\n", workerCount);
+	}
+
+	void JobSystem::Shutdown()
+	{
+		if (!running)
+			return;
+
+		// drain everything that is still queued so no counter is left hanging
+		while (pendingJobs.load() > 0) {
+			Job* job = FindJob(CurrentWorkerIndex());
+			if (job)
+				Execute(job, 0);
+			ExecuteMainThreadJobs();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		sleepCondition.notify_all();
+
+		for (size_t i = 1; i < workers.size(); i++)
+			workers[i]->thread.join();
+		for (size_t i = 0; i < workers.size(); i++)
+			delete workers[i];
+		workers.clear();
+		tlsWorkerIndex = -1;
+	}
+
+	void JobSystem::Run(JobFunction function, JobCounter* counter, JobCounter* dependency)
+	{
+		Job* job = new Job();
+		job->function = function;
+		job->counter = counter;
+		job->mainThreadOnly = false;
+
+		if (counter)
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+
+		if (dependency) {
+			std::lock_guard<std::mutex> lock(dependency->continuationsMutex);
+			if (!dependency->IsDone()) {
+				dependency->continuations.push_back(job);
+				return;
+			}
+		}
+		Submit(job);
+	}
+
+	void JobSystem::RunOnMainThread(JobFunction function, JobCounter* counter, JobCounter* dependency)
+	{
+		Job* job = new Job();
+		job->function = function;
+		job->counter = counter;
+		job->mainThreadOnly = true;
+
+		if (counter)
+			counter->value.fetch_add(1, std::memory_order_relaxed);
+
+		if (dependency) {
+			std::lock_guard<std::mutex> lock(dependency->continuationsMutex);
+			if (!dependency->IsDone()) {
+				dependency->continuations.push_back(job);
+				return;
+			}
+		}
+		Submit(job);
+	}
+
+	void JobSystem::ParallelFor(size_t count, size_t grainSize, std::function<void(size_t begin, size_t end)> body, JobCounter* counter)
+	{
+		if (count == 0)
+			return;
+		if (grainSize == 0)
+			grainSize = 1;
+
+		// without a caller counter the call is synchronous
+		JobCounter localCounter;
+		JobCounter* target = counter ? counter : &localCounter;
+
+		for (size_t begin = 0; begin < count; begin += grainSize) {
+			size_t end = begin + grainSize < count ? begin + grainSize : count;
+			Run([body, begin, end]() { body(begin, end); }, target);
+		}
+
+		if (!counter)
+			Wait(&localCounter);
+	}
+
+	void JobSystem::Wait(JobCounter* counter)
+	{
+		int index = CurrentWorkerIndex();
+		while (!counter->IsDone()) {
+			if (IsMainThread())
+				ExecuteMainThreadJobs();
+
+			Job* job = FindJob(index);
+			if (job)
+				Execute(job, index < 0 ? (unsigned int)workers.size() : (unsigned int)index);
+			else
+				std::this_thread::yield();
+		}
+
+		// Finish() may still hold the lock after the last decrement; the counter must outlive it
+		std::lock_guard<std::mutex> lock(counter->continuationsMutex);
+	}
+
+	void JobSystem::ExecuteMainThreadJobs()
+	{
+		std::vector<Job*> jobs;
+		{
+			std::lock_guard<std::mutex> lock(mainThreadMutex);
+			jobs.swap(mainThreadQueue);
+		}
+		for (size_t i = 0; i < jobs.size(); i++)
+			Execute(jobs[i], 0);
+	}
+
+	void JobSystem::SetMainThread(std::thread::id id)
+	{
+		mainThreadId = id;
+	}
+
+	unsigned int JobSystem::GetWorkerCount()
+	{
+		return workers.empty() ? 0 : (unsigned int)workers.size() - 1;
+	}
+
+	bool JobSystem::IsMainThread()
+	{
+		return std::this_thread::get_id() == mainThreadId;
+	}
+
+	std::vector<WorkerStats> JobSystem::GetWorkerStats()
+	{
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - statsStart).count();
+
+		std::vector<WorkerStats> stats;
+		for (size_t i = 0; i < workers.size(); i++) {
+			WorkerStats s;
+			s.busySeconds = workers[i]->busyNanoseconds.load() * 1e-9;
+			s.totalSeconds = elapsed;
+			s.jobsExecuted = workers[i]->jobsExecuted.load();
+			s.jobsStolen = workers[i]->jobsStolen.load();
+			stats.push_back(s);
+		}
+		return stats;
+	}
+
+	void JobSystem::ResetStats()
+	{
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i]->busyNanoseconds = 0;
+			workers[i]->jobsExecuted = 0;
+			workers[i]->jobsStolen = 0;
+		}
+		statsStart = std::chrono::steady_clock::now();
+	}
+
+	void JobSystem::PrintUtilization()
+	{
+		std::vector<WorkerStats> stats = GetWorkerStats();
+		double total = 0.0;
+		printf("Job system utilization over %.2f s:\n", stats.empty() ? 0.0 : stats[0].totalSeconds);
+		for (size_t i = 0; i < stats.size(); i++) {
+			double utilization = stats[i].totalSeconds > 0.0 ? stats[i].busySeconds / stats[i].totalSeconds : 0.0;
+			total += utilization;
+			printf("  %s %2zu: %5.1f%%  jobs = %llu  stolen = %llu\n", i == 0 ? "main  " : "worker", i, utilization * 100.0,
+				(unsigned long long)stats[i].jobsExecuted, (unsigned long long)stats[i].jobsStolen);
+		}
+		printf("  effective cores busy: %.2f of %zu\n", total, stats.size());
+	}
+
+	void JobSystem::WorkerLoop(unsigned int index)
+	{
+		tlsWorkerIndex = (int)index;
+		tlsRandomState = 0x9E3779B9u * (index + 1);
+		PROFILE_THREAD(("worker " + std::to_string(index)).c_str());
+
+		while (true) {
+			Job* job = FindJob(index);
+			if (job) {
+				Execute(job, index);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait(lock, [this]() { return pendingJobs.load() > 0 || !running; });
+			if (!running)
+				break;
+		}
+	}
+
+	void JobSystem::Submit(Job* job)
+	{
+		if (job->mainThreadOnly) {
+			std::lock_guard<std::mutex> lock(mainThreadMutex);
+			mainThreadQueue.push_back(job);
+			return;
+		}
+		Enqueue(job);
+	}
+
+	void JobSystem::Enqueue(Job* job)
+	{
+		pendingJobs.fetch_add(1);
+
+		int index = CurrentWorkerIndex();
+		if (index < 0 || !workers[index]->queue.Push(job)) {
+			std::lock_guard<std::mutex> lock(injectMutex);
+			injectQueue.push_back(job);
+		}
+
+		// take the lock so a worker can't miss the wakeup between its check and its wait
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		sleepCondition.notify_one();
+	}
+
+	Job* JobSystem::FindJob(unsigned int index)
+	{
+		Job* job = NULL;
+
+		if ((int)index >= 0 && index < workers.size())
+			job = workers[index]->queue.Pop();
+
+		if (!job) {
+			std::lock_guard<std::mutex> lock(injectMutex);
+			if (!injectQueue.empty()) {
+				job = injectQueue.back();
+				injectQueue.pop_back();
+			}
+		}
+
+		if (!job && !workers.empty()) {
+			// steal from a random victim, then scan the rest
+			tlsRandomState = tlsRandomState * 1664525u + 1013904223u;
+			size_t count = workers.size();
+			size_t start = tlsRandomState % count;
+			for (size_t i = 0; i < count && !job; i++) {
+				size_t victim = (start + i) % count;
+				if (victim == index)
+					continue;
+				job = workers[victim]->queue.Steal();
+				if (job && (int)index >= 0 && index < workers.size())
+					workers[index]->jobsStolen.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (job)
+			pendingJobs.fetch_sub(1);
+		return job;
+	}
+
+	void JobSystem::Execute(Job* job, unsigned int index)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			PROFILE_ZONE("job");
+			job->function();
+		}
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		if (index < workers.size()) {
+			workers[index]->busyNanoseconds.fetch_add(
+				(uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+			workers[index]->jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Finish(job->counter);
+		delete job;
+	}
+
+	void JobSystem::Finish(JobCounter* counter)
+	{
+		if (!counter)
+			return;
+
+		std::vector<Job*> ready;
+		{
+			// the continuation list is only drained under the lock, after the final decrement
+			std::lock_guard<std::mutex> lock(counter->continuationsMutex);
+			if (counter->value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+			ready.swap(counter->continuations);
+		}
+		for (size_t i = 0; i < ready.size(); i++)
+			Submit(ready[i]);
+	}
+
+	int JobSystem::CurrentWorkerIndex()
+	{
+		return tlsWorkerIndex;
+	}
+}
@@ -0,0 +1,139 @@
+#ifndef JobSystem_hpp
+#define JobSystem_hpp
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    typedef std::function<void()> JobFunction;
+
+    struct Job;
+
+    // Counts outstanding jobs; jobs that depend on it are queued once it drops to zero
+    struct JobCounter
+    {
+        std::atomic<int> value{ 0 };
+        std::mutex continuationsMutex;
+        std::vector<Job*> continuations;
+
+        bool IsDone() const { return value.load(std::memory_order_acquire) == 0; }
+    };
+
+    struct Job
+    {
+        JobFunction function;
+        // decremented when the job has finished
+        JobCounter* counter;
+        // main-thread-only jobs never enter the worker deques
+        bool mainThreadOnly;
+    };
+
+    // Chase-Lev work-stealing deque: the owner pushes/pops at the bottom, thieves steal from the top
+    class WorkStealingQueue
+    {
+    public:
+        WorkStealingQueue(size_t capacity = 4096);
+        ~WorkStealingQueue();
+
+        // owner thread only
+        bool Push(Job* job);
+        Job* Pop();
+        // any thread
+        Job* Steal();
+
+    private:
+        std::atomic<int64_t> top;
+        std::atomic<int64_t> bottom;
+        std::atomic<Job*>* jobs;
+        int64_t mask;
+    };
+
+    struct WorkerStats
+    {
+        double busySeconds;
+        double totalSeconds;
+        uint64_t jobsExecuted;
+        uint64_t jobsStolen;
+    };
+
+    class JobSystem
+    {
+    public:
+        ~JobSystem();
+
+        // workerCount == 0 uses one worker per hardware thread, minus the main thread
+        void Init(unsigned int workerCount = 0);
+        void Shutdown();
+
+        // Queues a job on the calling thread's deque; runs after `dependency` reaches zero if given
+        void Run(JobFunction function, JobCounter* counter = NULL, JobCounter* dependency = NULL);
+
+        // Queues a job that only the main thread executes (GL calls)
+        void RunOnMainThread(JobFunction function, JobCounter* counter = NULL, JobCounter* dependency = NULL);
+
+        // Splits [0, count) into chunks of at most grainSize indices and runs them in parallel
+        void ParallelFor(size_t count, size_t grainSize, std::function<void(size_t begin, size_t end)> body, JobCounter* counter = NULL);
+
+        // Executes other jobs until the counter reaches zero; the main thread also drains its own queue
+        void Wait(JobCounter* counter);
+
+        // Runs queued main-thread jobs; called once per frame from the main loop
+        void ExecuteMainThreadJobs();
+
+        // Makes the calling thread the one that owns the GL context and drains the main-thread queue
+        // A default id leaves the queue to no thread until the next owner claims it
+        void SetMainThread(std::thread::id id = std::this_thread::get_id());
+
+        unsigned int GetWorkerCount();
+        bool IsMainThread();
+
+        // index 0 is the main thread, 1..N are the workers
+        std::vector<WorkerStats> GetWorkerStats();
+        void ResetStats();
+        void PrintUtilization();
+
+    private:
+        struct Worker
+        {
+            WorkStealingQueue queue;
+            std::thread thread;
+            std::atomic<uint64_t> busyNanoseconds{ 0 };
+            std::atomic<uint64_t> jobsExecuted{ 0 };
+            std::atomic<uint64_t> jobsStolen{ 0 };
+        };
+
+        std::vector<Worker*> workers;
+        std::atomic<bool> running{ false };
+        // written by the thread taking the context over while others test it in Wait
+        std::atomic<std::thread::id> mainThreadId{ std::thread::id() };
+        std::chrono::steady_clock::time_point statsStart;
+
+        // jobs queued from threads that don't own a deque
+        std::mutex injectMutex;
+        std::vector<Job*> injectQueue;
+
+        std::mutex mainThreadMutex;
+        std::vector<Job*> mainThreadQueue;
+
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+        std::atomic<int> pendingJobs{ 0 };
+
+        void WorkerLoop(unsigned int index);
+        void Submit(Job* job);
+        void Enqueue(Job* job);
+        Job* FindJob(unsigned int index);
+        void Execute(Job* job, unsigned int index);
+        void Finish(JobCounter* counter);
+        int CurrentWorkerIndex();
+    };
+}
+
+#endif /* JobSystem_hpp */
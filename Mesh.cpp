@@ -1,41 +1,245 @@
 #include "Mesh.hpp"
+#include "RenderStats.hpp"
+#include "GpuMemory.hpp"
+#include "MeshSimplifier.hpp"
+
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
 namespace gps {
 
+	// unorm16 fraction of the bounding box, shared by both streams so they dequantize to the same positions
+	static void QuantizePosition(const glm::vec3& position, const glm::vec3& boundsMin, const glm::vec3& extent, GLushort* packed)
+	{
+		for (int c = 0; c < 3; c++) {
+			float t = extent[c] > 0.0f ? (position[c] - boundsMin[c]) / extent[c] : 0.0f;
+			packed[c] = (GLushort)std::lround(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+		}
+		packed[3] = 0;
+	}
+
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const MeshLoadOptions& options, std::vector<MeshLod> lods, std::vector<Meshlet> meshlets)
+	{
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->lods = std::move(lods);
+		this->meshlets = std::move(meshlets);
+		if (this->lods.empty()) {
+			MeshLod lod = { 0, (GLsizei)this->indices.size(), 0.0f, 0, (GLuint)this->meshlets.size() };
+			this->lods.push_back(lod);
+		}
+		this->indexCount = this->lods[0].indexCount;
+		this->indexType = GL_UNSIGNED_INT;
+		this->vertexFormat = options.vertexFormat;
+		this->positionScale = glm::vec3(1.0f);
+		this->positionOffset = glm::vec3(0.0f);
+		this->depthBuffers.VAO = this->depthBuffers.VBO = this->depthBuffers.EBO = 0;
+		this->depthVertexBufferBytes = 0;
+		this->depthIndexBufferBytes = 0;
+		this->depthVertexCount = 0;
+
+		this->boundsMin = glm::vec3(0.0f);
+		this->boundsMax = glm::vec3(0.0f);
+		if (!this->vertices.empty()) {
+			this->boundsMin = this->boundsMax = this->vertices[0].Position;
+			for (size_t i = 1; i < this->vertices.size(); i++) {
+				this->boundsMin = glm::min(this->boundsMin, this->vertices[i].Position);
+				this->boundsMax = glm::max(this->boundsMax, this->vertices[i].Position);
+			}
+		}
+
+		if (this->vertexFormat == VERTEX_FORMAT_QUANTIZED)
+			this->setupQuantizedMesh();
+		else
+			this->setupMesh();
+		this->setupDepthStream(options.depthStream);
+		this->releaseGeometry(options.retention);
+	}
+
+	Mesh::~Mesh()
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		deleteBuffers();
+	}
 
-		this->setupMesh();
+	Mesh::Mesh(Mesh&& other) noexcept
+	{
+		this->buffers.VAO = this->buffers.VBO = this->buffers.EBO = 0;
+		this->depthBuffers.VAO = this->depthBuffers.VBO = this->depthBuffers.EBO = 0;
+		*this = std::move(other);
+	}
+
+	Mesh& Mesh::operator=(Mesh&& other) noexcept
+	{
+		if (this != &other) {
+			deleteBuffers();
+			this->vertices = std::move(other.vertices);
+			this->indices = std::move(other.indices);
+			this->textures = std::move(other.textures);
+			this->positions = std::move(other.positions);
+			this->buffers = other.buffers;
+			this->depthBuffers = other.depthBuffers;
+			this->indexCount = other.indexCount;
+			this->lods = std::move(other.lods);
+			this->meshlets = std::move(other.meshlets);
+			this->indexType = other.indexType;
+			this->boundsMin = other.boundsMin;
+			this->boundsMax = other.boundsMax;
+			this->vertexFormat = other.vertexFormat;
+			this->vertexBufferBytes = other.vertexBufferBytes;
+			this->indexBufferBytes = other.indexBufferBytes;
+			this->depthVertexBufferBytes = other.depthVertexBufferBytes;
+			this->depthIndexBufferBytes = other.depthIndexBufferBytes;
+			this->depthVertexCount = other.depthVertexCount;
+			this->positionScale = other.positionScale;
+			this->positionOffset = other.positionOffset;
+			this->quantizationError = other.quantizationError;
+			other.buffers.VAO = other.buffers.VBO = other.buffers.EBO = 0;
+			other.depthBuffers.VAO = other.depthBuffers.VBO = other.depthBuffers.EBO = 0;
+			other.indexCount = 0;
+		}
+		return *this;
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	Buffers Mesh::getDepthBuffers() {
+		return this->depthBuffers;
+	}
+
+	GLsizei Mesh::getIndexCount() {
+		return this->indexCount;
+	}
+
+	int Mesh::getLodCount() {
+		return (int)this->lods.size();
+	}
+
+	MeshLod Mesh::getLod(int lod) {
+		return this->lods[lod];
+	}
+
+	const std::vector<Meshlet>& Mesh::getMeshlets() {
+		return this->meshlets;
+	}
+
+	size_t Mesh::getIndexSize() {
+		return this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
+	glm::vec3 Mesh::getBoundsMin() {
+		return this->boundsMin;
+	}
+
+	glm::vec3 Mesh::getBoundsMax() {
+		return this->boundsMax;
+	}
+
+	VERTEX_FORMAT Mesh::getVertexFormat() {
+		return this->vertexFormat;
+	}
+
+	GLenum Mesh::getIndexType() {
+		return this->indexType;
+	}
+
+	size_t Mesh::getVertexBufferBytes() {
+		return this->vertexBufferBytes;
+	}
+
+	size_t Mesh::getIndexBufferBytes() {
+		return this->indexBufferBytes;
+	}
+
+	size_t Mesh::getDepthVertexBufferBytes() {
+		return this->depthVertexBufferBytes;
+	}
+
+	size_t Mesh::getDepthIndexBufferBytes() {
+		return this->depthIndexBufferBytes;
+	}
+
+	size_t Mesh::getDepthVertexCount() {
+		return this->depthVertexCount;
+	}
+
+	QuantizationError Mesh::getQuantizationError() {
+		return this->quantizationError;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader shader, int lod, bool depthOnly)
+	{
+		bindForDraw(shader, depthOnly);
+		const MeshLod& level = this->lods[glm::clamp(lod, 0, (int)this->lods.size() - 1)];
+		gl::DrawElements(GL_TRIANGLES, level.indexCount, this->indexType, (GLvoid*)(level.indexOffset * getIndexSize()));
+		unbindAfterDraw(depthOnly);
+	}
+
+	void Mesh::DrawRanges(gps::Shader shader, const GLsizei* counts, const GLvoid* const* offsets, GLsizei drawCount, bool depthOnly)
+	{
+		bindForDraw(shader, depthOnly);
+		gl::MultiDrawElements(GL_TRIANGLES, counts, this->indexType, offsets, drawCount);
+		unbindAfterDraw(depthOnly);
+	}
+
+	void Mesh::setMaterialIndex(GLuint buffer, GLuint index)
+	{
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glEnableVertexAttribArray(3);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)(index * sizeof(GLuint)));
+		// every draw is instance 0, which reads the first element after the offset
+		glVertexAttribDivisor(3, 1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void Mesh::bindForDraw(gps::Shader& shader, bool depthOnly)
 	{
 		shader.useShaderProgram();
 
 		//set textures
-		for (GLuint i = 0; i < textures.size(); i++)
+		for (GLuint i = 0; i < textures.size() && !depthOnly; i++)
 		{
+			// array layers are bound by Model3D::Draw, which switches arrays only when a mesh needs another
+			if (this->textures[i].layer >= 0)
+				continue;
+			// the shader finds resident handles in the material table
+			if (this->textures[i].handle)
+				continue;
 			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
+			gl::BindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		//identity for float meshes
+		GLint positionScaleLoc = glGetUniformLocation(shader.shaderProgram, "positionScale");
+		if (positionScaleLoc != -1) {
+			gl::Uniform3fv(positionScaleLoc, 1, &this->positionScale[0]);
+			gl::Uniform3fv(glGetUniformLocation(shader.shaderProgram, "positionOffset"), 1, &this->positionOffset[0]);
+		}
+
+		gl::BindVertexArray(depthOnly && this->depthBuffers.VAO ? this->depthBuffers.VAO : this->buffers.VAO);
+	}
+
+	void Mesh::unbindAfterDraw(bool depthOnly)
+	{
+		gl::BindVertexArray(0);
 
-        for(GLuint i = 0; i < this->textures.size(); i++)
+        for(GLuint i = 0; i < this->textures.size() && !depthOnly; i++)
         {
+            if (this->textures[i].layer >= 0 || this->textures[i].handle)
+                continue;
             glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            gl::BindTexture(GL_TEXTURE_2D, 0);
         }
 
     }
@@ -67,5 +271,177 @@ namespace gps {
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
 
 		glBindVertexArray(0);
+
+		this->vertexBufferBytes = this->vertices.size() * sizeof(Vertex);
+		this->indexBufferBytes = this->indices.size() * sizeof(GLuint);
+	}
+
+	// Same buffers as setupMesh, packed into gps::PackedVertex
+	void Mesh::setupQuantizedMesh() {
+		// positions become fractions of the bounding box; a flat axis keeps scale 0
+		glm::vec3 extent = this->boundsMax - this->boundsMin;
+		this->positionScale = extent;
+		this->positionOffset = this->boundsMin;
+
+		std::vector<PackedVertex> packed(this->vertices.size());
+		QuantizationError error;
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+			const Vertex& vertex = this->vertices[i];
+
+			QuantizePosition(vertex.Position, this->boundsMin, extent, packed[i].Position);
+			glm::vec3 dequantized;
+			for (int c = 0; c < 3; c++)
+				dequantized[c] = this->positionOffset[c] + packed[i].Position[c] / 65535.0f * extent[c];
+			error.position = std::max(error.position, glm::length(dequantized - vertex.Position));
+
+			float normalLength = glm::length(vertex.Normal);
+			glm::vec3 normal = normalLength > 0.0f ? vertex.Normal / normalLength : glm::vec3(0.0f);
+			packed[i].Normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+			glm::vec3 unpacked = glm::vec3(glm::unpackSnorm3x10_1x2(packed[i].Normal));
+			if (normalLength > 0.0f && glm::length(unpacked) > 0.0f) {
+				float cosine = glm::clamp(glm::dot(normal, glm::normalize(unpacked)), -1.0f, 1.0f);
+				error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+			}
+
+			packed[i].TexCoords = glm::packHalf2x16(vertex.TexCoords);
+			glm::vec2 texCoordError = glm::abs(glm::unpackHalf2x16(packed[i].TexCoords) - vertex.TexCoords);
+			error.texCoord = std::max(error.texCoord, std::max(texCoordError.x, texCoordError.y));
+		}
+		this->quantizationError = error;
+
+		glGenVertexArrays(1, &this->buffers.VAO);
+		glGenBuffers(1, &this->buffers.VBO);
+		glGenBuffers(1, &this->buffers.EBO);
+
+		glBindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+		this->vertexBufferBytes = packed.size() * sizeof(PackedVertex);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+		if (this->vertices.size() <= 65536) {
+			std::vector<GLushort> shortIndices(this->indices.begin(), this->indices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+			this->indexType = GL_UNSIGNED_SHORT;
+			this->indexBufferBytes = shortIndices.size() * sizeof(GLushort);
+		}
+		else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->indices.data(), GL_STATIC_DRAW);
+			this->indexBufferBytes = this->indices.size() * sizeof(GLuint);
+		}
+
+		// the shaders keep their float inputs, normalized fetch does the conversion
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+
+		glBindVertexArray(0);
+	}
+
+	void Mesh::setupDepthStream(DEPTH_STREAM stream) {
+		if (stream == DEPTH_STREAM_NONE || this->vertices.empty())
+			return;
+
+		std::vector<glm::vec3> positions;
+		std::vector<GLuint> remap;
+		if (stream == DEPTH_STREAM_WELDED) {
+			MeshSimplifier::WeldPositions(this->vertices, positions, remap);
+		}
+		else {
+			positions.reserve(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++)
+				positions.push_back(this->vertices[i].Position);
+		}
+		this->depthVertexCount = positions.size();
+
+		glGenVertexArrays(1, &this->depthBuffers.VAO);
+		glGenBuffers(1, &this->depthBuffers.VBO);
+		glBindVertexArray(this->depthBuffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->depthBuffers.VBO);
+
+		// the packed positions round exactly like the full vertices, so the depth passes produce the same depths
+		glEnableVertexAttribArray(0);
+		if (this->vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+			std::vector<GLushort> packed(positions.size() * 4);
+			for (size_t i = 0; i < positions.size(); i++)
+				QuantizePosition(positions[i], this->boundsMin, this->positionScale, &packed[i * 4]);
+			glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(GLushort), packed.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), (GLvoid*)0);
+			this->depthVertexBufferBytes = packed.size() * sizeof(GLushort);
+		}
+		else {
+			glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+			this->depthVertexBufferBytes = positions.size() * sizeof(glm::vec3);
+		}
+
+		if (stream == DEPTH_STREAM_WELDED) {
+			// index for index the same ranges as the mesh, so the LOD and meshlet offsets apply unchanged
+			glGenBuffers(1, &this->depthBuffers.EBO);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->depthBuffers.EBO);
+			if (this->indexType == GL_UNSIGNED_SHORT) {
+				std::vector<GLushort> shortIndices(this->indices.size());
+				for (size_t i = 0; i < this->indices.size(); i++)
+					shortIndices[i] = (GLushort)remap[this->indices[i]];
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+			}
+			else {
+				std::vector<GLuint> weldedIndices(this->indices.size());
+				for (size_t i = 0; i < this->indices.size(); i++)
+					weldedIndices[i] = remap[this->indices[i]];
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, weldedIndices.size() * sizeof(GLuint), weldedIndices.data(), GL_STATIC_DRAW);
+			}
+			this->depthIndexBufferBytes = this->indices.size() * getIndexSize();
+		}
+		else {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	void Mesh::releaseGeometry(MESH_RETENTION retention) {
+		if (retention == RETAIN_ALL)
+			return;
+
+		if (retention == RETAIN_PICKING) {
+			this->positions.reserve(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++)
+				this->positions.push_back(this->vertices[i].Position);
+		}
+		else {
+			std::vector<GLuint>().swap(this->indices);
+		}
+		// swap with an empty vector - clear() alone keeps the capacity
+		std::vector<Vertex>().swap(this->vertices);
+	}
+
+	void Mesh::deleteBuffers() {
+		if (this->buffers.VBO) {
+			GpuMemory::Release(GL_BUFFER, this->buffers.VBO);
+			glDeleteBuffers(1, &this->buffers.VBO);
+		}
+		if (this->buffers.EBO) {
+			GpuMemory::Release(GL_BUFFER, this->buffers.EBO);
+			glDeleteBuffers(1, &this->buffers.EBO);
+		}
+		if (this->buffers.VAO)
+			glDeleteVertexArrays(1, &this->buffers.VAO);
+		this->buffers.VAO = this->buffers.VBO = this->buffers.EBO = 0;
+
+		if (this->depthBuffers.VBO) {
+			GpuMemory::Release(GL_BUFFER, this->depthBuffers.VBO);
+			glDeleteBuffers(1, &this->depthBuffers.VBO);
+		}
+		if (this->depthBuffers.EBO) {
+			GpuMemory::Release(GL_BUFFER, this->depthBuffers.EBO);
+			glDeleteBuffers(1, &this->depthBuffers.EBO);
+		}
+		if (this->depthBuffers.VAO)
+			glDeleteVertexArrays(1, &this->depthBuffers.VAO);
+		this->depthBuffers.VAO = this->depthBuffers.VBO = this->depthBuffers.EBO = 0;
 	}
 }
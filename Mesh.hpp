@@ -19,12 +19,30 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// Compact 16-byte layout used by VERTEX_FORMAT_QUANTIZED
+struct PackedVertex
+{
+    // unorm16 within the mesh bounds, w is padding
+    GLushort Position[4];
+    // snorm 10_10_10_2, w unused
+    GLuint Normal;
+    // two half floats
+    GLuint TexCoords;
+};
+
 struct Texture
 {
     GLuint id;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
+    // gps::TextureStreaming slot, -1 when every level is resident
+    int streamSlot;
+    // layer of the GL_TEXTURE_2D_ARRAY named by id, -1 for a plain GL_TEXTURE_2D
+    int layer;
+    // resident ARB_bindless_texture handle, read from the model's material table instead of binding a unit;
+    // a layer's handle is its array's. 0 when the texture is bound
+    GLuint64 handle;
 };
 
 struct Material
@@ -40,25 +58,169 @@ struct Buffers {
     GLuint EBO;
 };
 
+// What a mesh keeps in system memory once its buffers are uploaded
+enum MESH_RETENTION {
+    RETAIN_ALL,         // full vertices and indices
+    RETAIN_PICKING,     // positions and indices, enough for ray picking
+    RETAIN_BOUNDS       // only the bounding box, enough for culling
+};
+
+enum VERTEX_FORMAT {
+    VERTEX_FORMAT_FLOAT,        // gps::Vertex and 32-bit indices
+    VERTEX_FORMAT_QUANTIZED     // gps::PackedVertex and 16-bit indices when the mesh has at most 65536 vertices
+};
+
+// Extra vertex stream for the depth-only passes, which read nothing but the position
+enum DEPTH_STREAM {
+    DEPTH_STREAM_NONE,          // depth passes fetch the full vertices
+    DEPTH_STREAM_POSITIONS,     // tightly packed positions in vertex order, sharing the mesh's indices
+    DEPTH_STREAM_WELDED         // positions welded across normal and UV seams, with their own remapped indices
+};
+
+struct MeshLoadOptions
+{
+    MESH_RETENTION retention;
+    VERTEX_FORMAT vertexFormat;
+    // levels of detail to generate, including the full mesh; 1 disables simplification
+    int lodCount;
+    // split every level into meshlets for cluster culling
+    bool buildMeshlets;
+    DEPTH_STREAM depthStream;
+    // textures no larger than this on either side share one GL_TEXTURE_2D_ARRAY per type, 0 keeps every texture separate
+    int textureArrayMaxSize;
+    // give the textures resident bindless handles in a material table per model; needs ARB_bindless_texture and
+    // shaders built with BINDLESS_TEXTURES. Streamed textures keep binding, a handle would freeze their levels
+    bool bindlessTextures;
+
+    MeshLoadOptions() : retention(RETAIN_ALL), vertexFormat(VERTEX_FORMAT_FLOAT), lodCount(1), buildMeshlets(false),
+        depthStream(DEPTH_STREAM_NONE), textureArrayMaxSize(0), bindlessTextures(false) {}
+};
+
+// One level of detail: a range of the mesh's index buffer, all levels share the vertices
+struct MeshLod
+{
+    GLuint indexOffset;
+    GLsizei indexCount;
+    // largest distance the simplification moved the surface, object space
+    float error;
+    // the level's meshlets in Mesh::getMeshlets, covering its index range in order
+    GLuint meshletOffset;
+    GLuint meshletCount;
+};
+
+// A cluster of up to 64 vertices and 124 triangles, contiguous in the index buffer
+struct Meshlet
+{
+    // bounding sphere, object space
+    glm::vec3 center;
+    float radius;
+    // every face normal is within the cone; coneCutoff is the sine of its half angle, 1 when it cannot be culled
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    GLuint indexOffset;
+    GLsizei indexCount;
+};
+
+// Largest error introduced by quantization, measured against the float vertices
+struct QuantizationError
+{
+    float position;         // object space distance
+    float normalDegrees;
+    float texCoord;         // per component
+
+    QuantizationError() : position(0.0f), normalDegrees(0.0f), texCoord(0.0f) {}
+};
+
+// Owns its VAO/VBO/EBO; move-only so the GL objects are deleted exactly once
 class Mesh
 {
 public:
+    // emptied after upload unless retention is RETAIN_ALL
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    // filled only for RETAIN_PICKING
+    std::vector<glm::vec3> positions;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	// Pass the geometry with std::move to build the mesh without copying it
+	// indices holds every level of detail back to back as described by lods; no lods means a single level
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const MeshLoadOptions& options = MeshLoadOptions(), std::vector<MeshLod> lods = std::vector<MeshLod>(),
+		std::vector<Meshlet> meshlets = std::vector<Meshlet>());
+	~Mesh();
 
-	Buffers getBuffers();
+	Mesh(Mesh&& other) noexcept;
+	Mesh& operator=(Mesh&& other) noexcept;
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
 
-	void Draw(gps::Shader shader);
+	Buffers getBuffers();
+	// all 0 without a depth stream; EBO is 0 when the stream shares the mesh's indices
+	Buffers getDepthBuffers();
+	// indices of the full-detail level
+	GLsizei getIndexCount();
+	int getLodCount();
+	MeshLod getLod(int lod);
+	const std::vector<Meshlet>& getMeshlets();
+	// bytes per index, to turn index offsets into the byte offsets GL takes
+	size_t getIndexSize();
+	glm::vec3 getBoundsMin();
+	glm::vec3 getBoundsMax();
+	VERTEX_FORMAT getVertexFormat();
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum getIndexType();
+	size_t getVertexBufferBytes();
+	size_t getIndexBufferBytes();
+	size_t getDepthVertexBufferBytes();
+	size_t getDepthIndexBufferBytes();
+	// vertices in the depth stream, 0 without one
+	size_t getDepthVertexCount();
+	QuantizationError getQuantizationError();
+
+	// lod is clamped to the levels the mesh has
+	// depthOnly draws from the depth stream when there is one and binds no textures
+	void Draw(gps::Shader shader, int lod = 0, bool depthOnly = false);
+	// Draws drawCount index ranges with one glMultiDrawElements; offsets are in bytes
+	// The depth stream's indices keep the same ranges, so the offsets hold for both
+	void DrawRanges(gps::Shader shader, const GLsizei* counts, const GLvoid* const* offsets, GLsizei drawCount, bool depthOnly = false);
+
+	// Feeds attribute 3 the GLuint at index of buffer for every vertex, through an instance divisor, so the VAO
+	// itself tells the shader which material table entry is the mesh's and drawing sets no per-mesh state
+	void setMaterialIndex(GLuint buffer, GLuint index);
 
 private:
     /*  Render data  */
     Buffers buffers;
+    Buffers depthBuffers;
+    GLsizei indexCount;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    GLenum indexType;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    VERTEX_FORMAT vertexFormat;
+    size_t vertexBufferBytes;
+    size_t indexBufferBytes;
+    size_t depthVertexBufferBytes;
+    size_t depthIndexBufferBytes;
+    size_t depthVertexCount;
+    // dequantization applied by the vertex shaders: position = positionOffset + vPosition * positionScale
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+    QuantizationError quantizationError;
+
+	// Program, textures, dequantization and VAO for a draw, and the unbinds after it
+	void bindForDraw(gps::Shader& shader, bool depthOnly);
+	void unbindAfterDraw(bool depthOnly);
 
 	// Initializes all the buffer objects/arrays
 	void setupMesh();
+	void setupQuantizedMesh();
+	// Position-only VAO for the depth passes; after setupMesh or setupQuantizedMesh, which pick the index type
+	void setupDepthStream(DEPTH_STREAM stream);
+	// Drops the CPU geometry the retention mode does not need
+	void releaseGeometry(MESH_RETENTION retention);
+	void deleteBuffers();
 
 };
 
@@ -0,0 +1,317 @@
+#include "MeshSimplifier.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace gps {
+
+	// Symmetric 4x4 plane quadric, upper triangle; weight is the summed triangle area
+	struct Quadric
+	{
+		double a[10];
+		double weight;
+
+		Quadric()
+		{
+			for (int i = 0; i < 10; i++)
+				a[i] = 0.0;
+			weight = 0.0;
+		}
+
+		void AddPlane(const glm::dvec3& n, double d, double w)
+		{
+			a[0] += w * n.x * n.x; a[1] += w * n.x * n.y; a[2] += w * n.x * n.z; a[3] += w * n.x * d;
+			a[4] += w * n.y * n.y; a[5] += w * n.y * n.z; a[6] += w * n.y * d;
+			a[7] += w * n.z * n.z; a[8] += w * n.z * d;
+			a[9] += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& other)
+		{
+			for (int i = 0; i < 10; i++)
+				a[i] += other.a[i];
+			weight += other.weight;
+		}
+
+		// area-weighted mean squared distance from p to the accumulated planes
+		double Error(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+				+ a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+				+ a[7] * z * z + 2.0 * a[8] * z
+				+ a[9];
+			return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+		}
+	};
+
+	// Cost of collapsing onto p: the error of both endpoints' planes together, as the merged vertex keeps them all
+	static double CollapseCost(const Quadric& from, const Quadric& to, const glm::vec3& p)
+	{
+		Quadric merged = from;
+		merged.Add(to);
+		return merged.Error(p);
+	}
+
+	struct Collapse
+	{
+		double cost;
+		GLuint from;
+		GLuint to;
+		uint32_t fromVersion;
+		uint32_t toVersion;
+
+		bool operator<(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	template <size_t FloatCount>
+	struct FloatKey
+	{
+		float values[FloatCount];
+
+		bool operator==(const FloatKey& other) const { return memcmp(values, other.values, sizeof(values)) == 0; }
+	};
+
+	template <size_t FloatCount>
+	struct FloatKeyHash
+	{
+		size_t operator()(const FloatKey<FloatCount>& key) const
+		{
+			uint32_t bits[FloatCount];
+			memcpy(bits, key.values, sizeof(bits));
+			size_t hash = 2166136261u;
+			for (size_t i = 0; i < FloatCount; i++)
+				hash = (hash ^ bits[i]) * 16777619u;
+			return hash;
+		}
+	};
+
+	static FloatKey<3> PositionKey(const Vertex& vertex)
+	{
+		FloatKey<3> key;
+		memcpy(key.values, &vertex.Position, sizeof(key.values));
+		return key;
+	}
+
+	void MeshSimplifier::Weld(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		PROFILE_ZONE("Weld");
+		std::unordered_map<FloatKey<8>, GLuint, FloatKeyHash<8> > unique;
+		unique.reserve(vertices.size());
+		std::vector<Vertex> welded;
+		welded.reserve(vertices.size());
+		std::vector<GLuint> remap(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); i++) {
+			FloatKey<8> key;
+			memcpy(&key.values[0], &vertices[i].Position, sizeof(float) * 3);
+			memcpy(&key.values[3], &vertices[i].Normal, sizeof(float) * 3);
+			memcpy(&key.values[6], &vertices[i].TexCoords, sizeof(float) * 2);
+
+			std::pair<std::unordered_map<FloatKey<8>, GLuint, FloatKeyHash<8> >::iterator, bool> inserted =
+				unique.insert(std::make_pair(key, (GLuint)welded.size()));
+			if (inserted.second)
+				welded.push_back(vertices[i]);
+			remap[i] = inserted.first->second;
+		}
+
+		for (size_t i = 0; i < indices.size(); i++)
+			indices[i] = remap[indices[i]];
+		vertices.swap(welded);
+	}
+
+	void MeshSimplifier::WeldPositions(const std::vector<Vertex>& vertices, std::vector<glm::vec3>& positions, std::vector<GLuint>& remap)
+	{
+		PROFILE_ZONE("WeldPositions");
+		std::unordered_map<FloatKey<3>, GLuint, FloatKeyHash<3> > unique;
+		unique.reserve(vertices.size());
+		positions.clear();
+		remap.resize(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); i++) {
+			std::pair<std::unordered_map<FloatKey<3>, GLuint, FloatKeyHash<3> >::iterator, bool> inserted =
+				unique.insert(std::make_pair(PositionKey(vertices[i]), (GLuint)positions.size()));
+			if (inserted.second)
+				positions.push_back(vertices[i].Position);
+			remap[i] = inserted.first->second;
+		}
+	}
+
+	static glm::vec3 TriangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		return glm::cross(b - a, c - a);
+	}
+
+	std::vector<GLuint> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+		size_t targetIndexCount, float maxError, float* resultError)
+	{
+		PROFILE_ZONE("Simplify");
+		size_t vertexCount = vertices.size();
+		size_t triangleCount = indices.size() / 3;
+		std::vector<GLuint> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+
+		// vertices sharing a position with different normals or UVs sit on a seam
+		std::unordered_map<FloatKey<3>, GLuint, FloatKeyHash<3> > positionIds;
+		std::vector<GLuint> positionId(vertexCount);
+		std::vector<GLuint> positionUsers;
+		for (size_t v = 0; v < vertexCount; v++) {
+			std::pair<std::unordered_map<FloatKey<3>, GLuint, FloatKeyHash<3> >::iterator, bool> inserted =
+				positionIds.insert(std::make_pair(PositionKey(vertices[v]), (GLuint)positionUsers.size()));
+			if (inserted.second)
+				positionUsers.push_back(0);
+			positionId[v] = inserted.first->second;
+		}
+		std::vector<bool> used(vertexCount, false);
+		for (size_t i = 0; i < triangles.size(); i++)
+			used[triangles[i]] = true;
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (used[v])
+				positionUsers[positionId[v]]++;
+		}
+
+		// edges with a single triangle are on the border
+		std::unordered_map<uint64_t, int> edgeUses;
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int e = 0; e < 3; e++) {
+				uint64_t a = positionId[triangles[t * 3 + e]];
+				uint64_t b = positionId[triangles[t * 3 + (e + 1) % 3]];
+				edgeUses[a < b ? (a << 32) | b : (b << 32) | a]++;
+			}
+		}
+		std::vector<bool> border(positionUsers.size(), false);
+		for (std::unordered_map<uint64_t, int>::iterator it = edgeUses.begin(); it != edgeUses.end(); ++it) {
+			if (it->second == 1) {
+				border[it->first >> 32] = true;
+				border[it->first & 0xffffffffu] = true;
+			}
+		}
+
+		std::vector<bool> locked(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			locked[v] = positionUsers[positionId[v]] > 1 || border[positionId[v]];
+
+		std::vector<Quadric> quadrics(vertexCount);
+		std::vector<std::vector<GLuint> > vertexTriangles(vertexCount);
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::vec3& p0 = vertices[triangles[t * 3 + 0]].Position;
+			const glm::vec3& p1 = vertices[triangles[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[triangles[t * 3 + 2]].Position;
+			glm::dvec3 normal = glm::dvec3(TriangleNormal(p0, p1, p2));
+			double length = glm::length(normal);
+			for (int c = 0; c < 3; c++)
+				vertexTriangles[triangles[t * 3 + c]].push_back((GLuint)t);
+			if (length <= 0.0)
+				continue;
+			normal /= length;
+			double d = -glm::dot(normal, glm::dvec3(p0));
+			for (int c = 0; c < 3; c++)
+				quadrics[triangles[t * 3 + c]].AddPlane(normal, d, length * 0.5);
+		}
+
+		std::vector<bool> triangleAlive(triangleCount, true);
+		std::vector<bool> removed(vertexCount, false);
+		std::vector<uint32_t> version(vertexCount, 0);
+		std::priority_queue<Collapse> queue;
+
+		// candidate collapses of v onto its neighbours and of its neighbours onto v
+		auto pushEdges = [&](GLuint v) {
+			for (size_t i = 0; i < vertexTriangles[v].size(); i++) {
+				GLuint t = vertexTriangles[v][i];
+				if (!triangleAlive[t])
+					continue;
+				for (int c = 0; c < 3; c++) {
+					GLuint w = triangles[t * 3 + c];
+					if (w == v)
+						continue;
+					if (!locked[v]) {
+						Collapse collapse = { CollapseCost(quadrics[v], quadrics[w], vertices[w].Position), v, w, version[v], version[w] };
+						queue.push(collapse);
+					}
+					if (!locked[w]) {
+						Collapse collapse = { CollapseCost(quadrics[w], quadrics[v], vertices[v].Position), w, v, version[w], version[v] };
+						queue.push(collapse);
+					}
+				}
+			}
+		};
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (!locked[v])
+				pushEdges((GLuint)v);
+		}
+
+		size_t aliveTriangles = triangleCount;
+		double maxErrorSquared = (double)maxError * maxError;
+		double reachedError = 0.0;
+		while (aliveTriangles * 3 > targetIndexCount && !queue.empty()) {
+			Collapse collapse = queue.top();
+			queue.pop();
+			GLuint u = collapse.from;
+			GLuint v = collapse.to;
+			if (removed[u] || removed[v] || version[u] != collapse.fromVersion || version[v] != collapse.toVersion)
+				continue;
+			if (collapse.cost > maxErrorSquared)
+				break;
+
+			// reject collapses that would flip a remaining triangle
+			bool flips = false;
+			for (size_t i = 0; i < vertexTriangles[u].size() && !flips; i++) {
+				GLuint t = vertexTriangles[u][i];
+				if (!triangleAlive[t])
+					continue;
+				GLuint* corner = &triangles[t * 3];
+				if (corner[0] == v || corner[1] == v || corner[2] == v)
+					continue;
+				glm::vec3 p[3], q[3];
+				for (int c = 0; c < 3; c++) {
+					p[c] = vertices[corner[c]].Position;
+					q[c] = corner[c] == u ? vertices[v].Position : p[c];
+				}
+				glm::vec3 before = TriangleNormal(p[0], p[1], p[2]);
+				glm::vec3 after = TriangleNormal(q[0], q[1], q[2]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			for (size_t i = 0; i < vertexTriangles[u].size(); i++) {
+				GLuint t = vertexTriangles[u][i];
+				if (!triangleAlive[t])
+					continue;
+				GLuint* corner = &triangles[t * 3];
+				bool degenerate = corner[0] == v || corner[1] == v || corner[2] == v;
+				for (int c = 0; c < 3; c++) {
+					if (corner[c] == u)
+						corner[c] = v;
+				}
+				if (degenerate) {
+					triangleAlive[t] = false;
+					aliveTriangles--;
+				}
+				else
+					vertexTriangles[v].push_back(t);
+			}
+			vertexTriangles[u].clear();
+			quadrics[v].Add(quadrics[u]);
+			removed[u] = true;
+			version[v]++;
+			reachedError = std::max(reachedError, collapse.cost);
+			pushEdges(v);
+		}
+
+		std::vector<GLuint> result;
+		result.reserve(aliveTriangles * 3);
+		for (size_t t = 0; t < triangleCount; t++) {
+			if (triangleAlive[t])
+				result.insert(result.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+		}
+		if (resultError)
+			*resultError = (float)std::sqrt(reachedError);
+		return result;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Quadric-error-metric simplification by half-edge collapse (Garland & Heckbert)
+    // Collapses only move a vertex onto a neighbour, so every LOD indexes the original vertex buffer
+    class MeshSimplifier
+    {
+    public:
+        // Merges vertices with identical position, normal and UV; the .obj reader emits one per face corner
+        static void Weld(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Unique positions of the vertices, ignoring normal and UV seams; vertex i became positions[remap[i]]
+        static void WeldPositions(const std::vector<Vertex>& vertices, std::vector<glm::vec3>& positions, std::vector<GLuint>& remap);
+
+        // Removes triangles until at most targetIndexCount indices remain or the next collapse would move
+        // the surface further than maxError (object space); returns the new index list
+        // Vertices on a UV/normal seam or on the mesh border (the material border, one material per mesh) never move
+        static std::vector<GLuint> Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+            size_t targetIndexCount, float maxError, float* resultError = NULL);
+    };
+}
+
+#endif /* MeshSimplifier_hpp */
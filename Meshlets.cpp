@@ -0,0 +1,176 @@
+#include "Meshlets.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace gps {
+
+	static int NewVertexCount(const GLuint* triangle, const std::vector<GLuint>& meshletVertices)
+	{
+		int count = 0;
+		for (int c = 0; c < 3; c++) {
+			if (std::find(meshletVertices.begin(), meshletVertices.end(), triangle[c]) == meshletVertices.end())
+				count++;
+		}
+		return count;
+	}
+
+	static glm::vec3 TriangleCenter(const std::vector<Vertex>& vertices, const GLuint* triangle)
+	{
+		return (vertices[triangle[0]].Position + vertices[triangle[1]].Position + vertices[triangle[2]].Position) / 3.0f;
+	}
+
+	static void FinishMeshlet(const std::vector<Vertex>& vertices, const std::vector<GLuint>& meshletVertices,
+		const GLuint* triangles, GLuint indexOffset, GLsizei indexCount, std::vector<Meshlet>& meshlets)
+	{
+		Meshlet meshlet;
+		meshlet.indexOffset = indexOffset;
+		meshlet.indexCount = indexCount;
+
+		glm::vec3 boundsMin = vertices[meshletVertices[0]].Position;
+		glm::vec3 boundsMax = boundsMin;
+		for (size_t i = 1; i < meshletVertices.size(); i++) {
+			boundsMin = glm::min(boundsMin, vertices[meshletVertices[i]].Position);
+			boundsMax = glm::max(boundsMax, vertices[meshletVertices[i]].Position);
+		}
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+		meshlet.radius = 0.0f;
+		for (size_t i = 0; i < meshletVertices.size(); i++)
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[meshletVertices[i]].Position - meshlet.center));
+
+		// normal cone from the face normals; the axis is their area-weighted average
+		glm::vec3 axis(0.0f);
+		for (GLsizei t = 0; t < indexCount; t += 3) {
+			const glm::vec3& a = vertices[triangles[t]].Position;
+			axis += glm::cross(vertices[triangles[t + 1]].Position - a, vertices[triangles[t + 2]].Position - a);
+		}
+		float axisLength = glm::length(axis);
+		meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+
+		float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+		for (GLsizei t = 0; t < indexCount && minDot > 0.0f; t += 3) {
+			const glm::vec3& a = vertices[triangles[t]].Position;
+			glm::vec3 normal = glm::cross(vertices[triangles[t + 1]].Position - a, vertices[triangles[t + 2]].Position - a);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+				minDot = std::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+		}
+		// a cone of 90 degrees or wider can always be seen from somewhere; cutoff 1 never culls
+		meshlet.coneCutoff = minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+
+		meshlets.push_back(meshlet);
+	}
+
+	void MeshletBuilder::Build(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+		GLuint indexOffset, GLsizei indexCount, std::vector<Meshlet>& meshlets)
+	{
+		PROFILE_ZONE("BuildMeshlets");
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+			return;
+		const GLuint* source = &indices[indexOffset];
+
+		// triangles around each vertex of the range
+		std::unordered_map<GLuint, std::vector<GLuint> > vertexTriangles;
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int c = 0; c < 3; c++)
+				vertexTriangles[source[t * 3 + c]].push_back((GLuint)t);
+		}
+
+		std::vector<bool> assigned(triangleCount, false);
+		std::vector<GLuint> ordered;
+		ordered.reserve(triangleCount * 3);
+		std::vector<GLuint> meshletVertices;
+		std::vector<GLuint> candidates;
+		size_t seed = 0;
+
+		while (true) {
+			while (seed < triangleCount && assigned[seed])
+				seed++;
+			if (seed == triangleCount)
+				break;
+
+			GLuint meshletStart = (GLuint)ordered.size();
+			meshletVertices.clear();
+			candidates.clear();
+			candidates.push_back((GLuint)seed);
+			int meshletTriangles = 0;
+
+			// grow over shared vertices: fewest new vertices first, then closest to the seed so the
+			// meshlet stays round and its normal cone narrow
+			glm::vec3 seedCenter = TriangleCenter(vertices, &source[seed * 3]);
+			while (meshletTriangles < MAX_TRIANGLES) {
+				int best = -1;
+				int bestNew = 4;
+				float bestDistance = 0.0f;
+				for (size_t i = 0; i < candidates.size(); i++) {
+					int added = NewVertexCount(&source[candidates[i] * 3], meshletVertices);
+					if ((int)meshletVertices.size() + added > MAX_VERTICES || added > bestNew)
+						continue;
+					float distance = glm::length(TriangleCenter(vertices, &source[candidates[i] * 3]) - seedCenter);
+					if (added < bestNew || distance < bestDistance) {
+						best = (int)i;
+						bestNew = added;
+						bestDistance = distance;
+					}
+				}
+				if (best < 0)
+					break;
+
+				GLuint t = candidates[best];
+				assigned[t] = true;
+				meshletTriangles++;
+				for (int c = 0; c < 3; c++) {
+					GLuint v = source[t * 3 + c];
+					ordered.push_back(v);
+					if (std::find(meshletVertices.begin(), meshletVertices.end(), v) == meshletVertices.end()) {
+						meshletVertices.push_back(v);
+						const std::vector<GLuint>& around = vertexTriangles[v];
+						for (size_t i = 0; i < around.size(); i++) {
+							if (!assigned[around[i]])
+								candidates.push_back(around[i]);
+						}
+					}
+				}
+				// drop the taken and already assigned candidates so the scan stays short
+				candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+					[&assigned](GLuint c) { return assigned[c]; }), candidates.end());
+			}
+
+			FinishMeshlet(vertices, meshletVertices, &ordered[meshletStart], indexOffset + meshletStart,
+				(GLsizei)(ordered.size() - meshletStart), meshlets);
+		}
+
+		std::copy(ordered.begin(), ordered.end(), indices.begin() + indexOffset);
+	}
+
+	ClusterCullView MeshletBuilder::MakeCullView(const glm::mat4& viewProjection, const glm::mat4& model, const glm::vec3& cameraPosition)
+	{
+		ClusterCullView view;
+		// Gribb-Hartmann: the rows of the clip matrix give the planes in the space it is applied to
+		glm::mat4 clip = viewProjection * model;
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++)
+			rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+		for (int p = 0; p < 6; p++) {
+			glm::vec4 plane = p % 2 == 0 ? rows[3] + rows[p / 2] : rows[3] - rows[p / 2];
+			float length = glm::length(glm::vec3(plane));
+			view.planes[p] = length > 0.0f ? plane / length : plane;
+		}
+		view.cameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+		return view;
+	}
+
+	bool MeshletBuilder::IsCulled(const Meshlet& meshlet, const ClusterCullView& view)
+	{
+		for (int p = 0; p < 6; p++) {
+			if (glm::dot(glm::vec3(view.planes[p]), meshlet.center) + view.planes[p].w < -meshlet.radius)
+				return true;
+		}
+
+		glm::vec3 toCenter = meshlet.center - view.cameraPosition;
+		return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef Meshlets_hpp
+#define Meshlets_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Frustum and camera in the object space of the mesh being culled
+    struct ClusterCullView
+    {
+        // normalized planes, inside where dot(plane.xyz, p) + plane.w >= 0
+        glm::vec4 planes[6];
+        glm::vec3 cameraPosition;
+    };
+
+    // Splits index ranges into meshlets and culls them
+    class MeshletBuilder
+    {
+    public:
+        static const int MAX_VERTICES = 64;
+        static const int MAX_TRIANGLES = 124;
+
+        // Partitions indices [indexOffset, indexOffset + indexCount) into meshlets, grown over shared vertices
+        // Reorders the triangles of that range so every meshlet is contiguous and appends the meshlets
+        static void Build(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+            GLuint indexOffset, GLsizei indexCount, std::vector<Meshlet>& meshlets);
+
+        // planes and camera of clip = projection * view * model, moved into object space
+        static ClusterCullView MakeCullView(const glm::mat4& viewProjection, const glm::mat4& model, const glm::vec3& cameraPosition);
+
+        // true when the meshlet is outside the frustum or faces away from the camera
+        static bool IsCulled(const Meshlet& meshlet, const ClusterCullView& view);
+    };
+}
+
+#endif /* Meshlets_hpp */
@@ -1,36 +1,645 @@
 #include "Model3D.hpp"
+#include "AssetArchive.hpp"
+#include "Profiler.hpp"
+#include "RenderStats.hpp"
+#include "GpuMemory.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "TextureStreaming.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <istream>
+#include <utility>
 
 namespace gps {
 
+	// Square root of the texture area over the surface area, from the triangles of the full level
+	static float UvDensity(const gps::MeshData& meshData)
+	{
+		double surfaceArea = 0.0;
+		double uvArea = 0.0;
+		for (size_t i = 0; i + 2 < meshData.indices.size(); i += 3) {
+			const gps::Vertex& a = meshData.vertices[meshData.indices[i]];
+			const gps::Vertex& b = meshData.vertices[meshData.indices[i + 1]];
+			const gps::Vertex& c = meshData.vertices[meshData.indices[i + 2]];
+			surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position)) * 0.5;
+			glm::vec2 u = b.TexCoords - a.TexCoords;
+			glm::vec2 v = c.TexCoords - a.TexCoords;
+			uvArea += std::abs(u.x * v.y - u.y * v.x) * 0.5;
+		}
+		return surfaceArea > 0.0 ? (float)std::sqrt(uvArea / surfaceArea) : 0.0f;
+	}
+
+	// Texture types ReadOBJ assigns, the ones BuildTextureArrays may pack and the material table lists
+	// The arrays of type t are bound to TEXTURE_ARRAY_FIRST_UNIT + t, one at a time
+	static const char* const MATERIAL_TEXTURE_TYPES[] = { "diffuseTexture", "specularTexture" };
+	static const int MATERIAL_TEXTURE_TYPE_COUNT = 2;
+	// past the mesh textures, the shadow map, the draw data, the lights and the g-buffer
+	static const GLuint TEXTURE_ARRAY_FIRST_UNIT = 10;
+	// the smallest GL_MAX_ARRAY_TEXTURE_LAYERS a driver may report
+	static const size_t MAX_ARRAY_LAYERS = 256;
+
+	// Entries in the Materials block of the lit shaders, MAX_MATERIALS there; 16 KB, the smallest
+	// GL_MAX_UNIFORM_BLOCK_SIZE a driver may report
+	static const size_t MAX_MATERIALS = 512;
+	static const GLuint MATERIAL_BLOCK_BINDING = 0;
+
+	// One mesh's entry in the material table, std140 layout of Material in the lit shaders
+	// A 0 handle leaves the type to the texture bound to its unit; layers are -1 unless the handle is an array's
+	struct MaterialData
+	{
+		GLuint64 handles[MATERIAL_TEXTURE_TYPE_COUNT];
+		GLint layers[MATERIAL_TEXTURE_TYPE_COUNT];
+		GLint padding[2];
+	};
+
+	// Resident bindless handle of a finished texture; GL refuses any later change to the texture
+	static GLuint64 MakeTextureHandleResident(GLuint texture)
+	{
+		GLuint64 handle = glGetTextureHandleARB(texture);
+		if (handle)
+			glMakeTextureHandleResidentARB(handle);
+		return handle;
+	}
+
+	// Smallest power of two not below size; images of one size class share an array
+	static int SizeClass(int size)
+	{
+		int sizeClass = 1;
+		while (sizeClass < size)
+			sizeClass *= 2;
+		return sizeClass;
+	}
+
+	// Bilinear resize of RGBA8 pixels, so smaller images fit the layers of a larger array
+	static void ResampleRgba(const unsigned char* source, int sourceWidth, int sourceHeight,
+		unsigned char* destination, int width, int height)
+	{
+		for (int y = 0; y < height; y++) {
+			float sy = std::max((y + 0.5f) * sourceHeight / height - 0.5f, 0.0f);
+			int y0 = std::min((int)sy, sourceHeight - 1);
+			int y1 = std::min(y0 + 1, sourceHeight - 1);
+			float fy = sy - y0;
+			for (int x = 0; x < width; x++) {
+				float sx = std::max((x + 0.5f) * sourceWidth / width - 0.5f, 0.0f);
+				int x0 = std::min((int)sx, sourceWidth - 1);
+				int x1 = std::min(x0 + 1, sourceWidth - 1);
+				float fx = sx - x0;
+				for (int c = 0; c < 4; c++) {
+					float top = source[(y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y0 * sourceWidth + x1) * 4 + c] * fx;
+					float bottom = source[(y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y1 * sourceWidth + x1) * 4 + c] * fx;
+					destination[(y * width + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+				}
+			}
+		}
+	}
+
+	// Read-only stream over bytes that live in the asset archive
+	class MemoryStreamBuffer : public std::streambuf
+	{
+	public:
+		MemoryStreamBuffer(const unsigned char* data, size_t size)
+		{
+			char* begin = (char*)data;
+			setg(begin, begin, begin + size);
+		}
+	};
+
+	// Looks for the .mtl files in the asset archive first, then next to the .obj
+	class ArchiveMaterialReader : public tinyobj::MaterialReader
+	{
+	public:
+		explicit ArchiveMaterialReader(const std::string& basePath)
+			: basePath(basePath), fileReader(basePath) {}
+
+		virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+			std::map<std::string, int>* matMap, std::string* err)
+		{
+			const unsigned char* data;
+			size_t size;
+			if (!AssetArchive::Find(basePath + matId, &data, &size))
+				return fileReader(matId, materials, matMap, err);
+			MemoryStreamBuffer buffer(data, size);
+			std::istream stream(&buffer);
+			tinyobj::LoadMtl(matMap, materials, &stream);
+			return true;
+		}
+
+	private:
+		std::string basePath;
+		tinyobj::MaterialFileReader fileReader;
+	};
+
+	Model3D::Model3D()
+	{
+		this->materialBuffer = 0;
+		this->materialIndexBuffer = 0;
+		this->loadState = MODEL_UNLOADED;
+		this->loadBoundsMin = glm::vec3(0.0f);
+		this->loadBoundsMax = glm::vec3(0.0f);
+	}
+
+	Model3D::Model3D(Model3D&& other) noexcept
+	{
+		this->name = std::move(other.name);
+		this->meshes = std::move(other.meshes);
+		this->loadedTextures = std::move(other.loadedTextures);
+		this->textureArrays = std::move(other.textureArrays);
+		this->materialBuffer = other.materialBuffer;
+		this->materialIndexBuffer = other.materialIndexBuffer;
+		this->loadOptions = other.loadOptions;
+		this->lodHistory = std::move(other.lodHistory);
+		this->uvDensities = std::move(other.uvDensities);
+		this->pendingMeshes = std::move(other.pendingMeshes);
+		this->pendingImages = std::move(other.pendingImages);
+		this->pendingArrays = std::move(other.pendingArrays);
+		this->loadState = other.loadState.load();
+		this->loadBoundsMin = other.loadBoundsMin;
+		this->loadBoundsMax = other.loadBoundsMax;
+		other.loadedTextures.clear();
+		other.textureArrays.clear();
+		other.materialBuffer = 0;
+		other.materialIndexBuffer = 0;
+		other.pendingImages.clear();
+		other.loadState = MODEL_UNLOADED;
+	}
+
+	Model3D& Model3D::operator=(Model3D&& other) noexcept
+	{
+		if (this != &other) {
+			DeleteTextures();
+			this->name = std::move(other.name);
+			this->meshes = std::move(other.meshes);
+			this->loadedTextures = std::move(other.loadedTextures);
+			this->textureArrays = std::move(other.textureArrays);
+			this->materialBuffer = other.materialBuffer;
+			this->materialIndexBuffer = other.materialIndexBuffer;
+			this->loadOptions = other.loadOptions;
+			this->lodHistory = std::move(other.lodHistory);
+			this->uvDensities = std::move(other.uvDensities);
+			this->pendingMeshes = std::move(other.pendingMeshes);
+			this->pendingImages = std::move(other.pendingImages);
+			this->pendingArrays = std::move(other.pendingArrays);
+			this->loadState = other.loadState.load();
+			this->loadBoundsMin = other.loadBoundsMin;
+			this->loadBoundsMax = other.loadBoundsMax;
+			other.loadedTextures.clear();
+			other.textureArrays.clear();
+			other.materialBuffer = 0;
+			other.materialIndexBuffer = 0;
+			other.pendingImages.clear();
+			other.loadState = MODEL_UNLOADED;
+		}
+		return *this;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		ParseModel(fileName, basePath);
+		UploadModel();
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
+		ParseModel(fileName, basePath);
+		UploadModel();
+	}
+
+	void Model3D::ParseModel(std::string fileName, std::string basePath, gps::JobSystem* jobSystem,
+		const gps::MeshLoadOptions& options)
+	{
+		PROFILE_ZONE("ParseModel");
+		this->name = fileName;
+		this->loadOptions = options;
 		ReadOBJ(fileName, basePath);
+
+		bool first = true;
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			const std::vector<gps::Vertex>& vertices = pendingMeshes[m].vertices;
+			for (size_t v = 0; v < vertices.size(); v++) {
+				loadBoundsMin = first ? vertices[v].Position : glm::min(loadBoundsMin, vertices[v].Position);
+				loadBoundsMax = first ? vertices[v].Position : glm::max(loadBoundsMax, vertices[v].Position);
+				first = false;
+			}
+			pendingMeshes[m].uvDensity = UvDensity(pendingMeshes[m]);
+		}
+		loadState.store(MODEL_GEOMETRY_READ, std::memory_order_release);
+
+		if (options.lodCount > 1 || options.buildMeshlets) {
+			auto processMeshes = [this, &options](size_t begin, size_t end) {
+				for (size_t m = begin; m < end; m++) {
+					if (options.lodCount > 1)
+						GenerateLods(pendingMeshes[m], options.lodCount);
+					if (options.buildMeshlets)
+						BuildMeshlets(pendingMeshes[m]);
+				}
+			};
+			if (jobSystem)
+				jobSystem->ParallelFor(pendingMeshes.size(), 1, processMeshes);
+			else
+				processMeshes(0, pendingMeshes.size());
+		}
+
+		// every texture file referenced by the model, decoded once
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			for (size_t t = 0; t < pendingMeshes[m].texturePaths.size(); t++) {
+				bool found = false;
+				for (size_t i = 0; i < pendingImages.size() && !found; i++)
+					found = pendingImages[i].path == pendingMeshes[m].texturePaths[t];
+				if (!found) {
+					gps::ImageData image;
+					image.path = pendingMeshes[m].texturePaths[t];
+					image.width = 0;
+					image.height = 0;
+					image.pixels = NULL;
+					pendingImages.push_back(image);
+				}
+			}
+		}
+
+		if (jobSystem) {
+			jobSystem->ParallelFor(pendingImages.size(), 1, [this](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					DecodeTexture(pendingImages[i]);
+			});
+		}
+		else {
+			for (size_t i = 0; i < pendingImages.size(); i++)
+				DecodeTexture(pendingImages[i]);
+		}
+		if (options.textureArrayMaxSize > 0)
+			BuildTextureArrays(options.textureArrayMaxSize);
+		loadState.store(MODEL_PARSED, std::memory_order_release);
+	}
+
+	void Model3D::UploadModel()
+	{
+		PROFILE_ZONE("UploadModel");
+		meshes.reserve(meshes.size() + pendingMeshes.size());
+		size_t floatBytes = 0;
+		size_t packedBytes = 0;
+		gps::QuantizationError maxError;
+		size_t vertexCount = 0;
+		size_t depthVertexCount = 0;
+		size_t depthBytes = 0;
+		if (loadOptions.bindlessTextures && meshes.size() + pendingMeshes.size() > MAX_MATERIALS) {
+			printf("Material table %s: %zu meshes, more than %zu, textures stay bound\n",
+				name.c_str(), meshes.size() + pendingMeshes.size(), MAX_MATERIALS);
+			loadOptions.bindlessTextures = false;
+		}
+		UploadTextureArrays();
+		for (size_t m = 0; m < pendingMeshes.size(); m++) {
+			gps::MeshData& pending = pendingMeshes[m];
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < pending.texturePaths.size(); t++)
+				textures.push_back(LoadTexture(pending.texturePaths[t], pending.textureTypes[t]));
+
+			// size as floats first, the geometry is moved into the mesh
+			floatBytes += pending.vertices.size() * sizeof(gps::Vertex) + pending.indices.size() * sizeof(GLuint);
+			vertexCount += pending.vertices.size();
+			uvDensities.push_back(pending.uvDensity);
+			meshes.emplace_back(std::move(pending.vertices), std::move(pending.indices), std::move(textures), loadOptions, std::move(pending.lods), std::move(pending.meshlets));
+
+			gps::Mesh& mesh = meshes.back();
+			gps::Buffers buffers = mesh.getBuffers();
+			std::string label = "mesh " + std::to_string(m);
+			gps::GpuMemory::Track(GL_BUFFER, buffers.VBO, gps::GPU_MEMORY_VERTEX_BUFFER,
+				mesh.getVertexBufferBytes(), name, label + " vertices");
+			gps::GpuMemory::Track(GL_BUFFER, buffers.EBO, gps::GPU_MEMORY_INDEX_BUFFER,
+				mesh.getIndexBufferBytes(), name, label + " indices");
+			gps::Buffers depthBuffers = mesh.getDepthBuffers();
+			if (depthBuffers.VBO)
+				gps::GpuMemory::Track(GL_BUFFER, depthBuffers.VBO, gps::GPU_MEMORY_VERTEX_BUFFER,
+					mesh.getDepthVertexBufferBytes(), name, label + " depth positions");
+			if (depthBuffers.EBO)
+				gps::GpuMemory::Track(GL_BUFFER, depthBuffers.EBO, gps::GPU_MEMORY_INDEX_BUFFER,
+					mesh.getDepthIndexBufferBytes(), name, label + " depth indices");
+			depthVertexCount += mesh.getDepthVertexCount();
+			depthBytes += mesh.getDepthVertexBufferBytes() + mesh.getDepthIndexBufferBytes();
+
+			packedBytes += mesh.getVertexBufferBytes() + mesh.getIndexBufferBytes();
+			gps::QuantizationError error = mesh.getQuantizationError();
+			maxError.position = std::max(maxError.position, error.position);
+			maxError.normalDegrees = std::max(maxError.normalDegrees, error.normalDegrees);
+			maxError.texCoord = std::max(maxError.texCoord, error.texCoord);
+		}
+		if (loadOptions.vertexFormat == gps::VERTEX_FORMAT_QUANTIZED && floatBytes > 0) {
+			printf("Quantized %s: %.1f KB -> %.1f KB (%.0f%%), max error position %g, normal %.3f deg, uv %g\n",
+				name.c_str(), floatBytes / 1024.0, packedBytes / 1024.0, 100.0 * packedBytes / floatBytes,
+				maxError.position, maxError.normalDegrees, maxError.texCoord);
+		}
+		if (loadOptions.depthStream != gps::DEPTH_STREAM_NONE && vertexCount > 0) {
+			printf("Depth stream %s: %zu -> %zu vertices, %.1f KB\n",
+				name.c_str(), vertexCount, depthVertexCount, depthBytes / 1024.0);
+		}
+		pendingMeshes.clear();
+		lodHistory.assign(meshes.size(), 0);
+		if (loadOptions.bindlessTextures)
+			UploadMaterials();
+
+		// images no mesh ended up using, or only as array layers
+		for (size_t i = 0; i < pendingImages.size(); i++)
+			stbi_image_free(pendingImages[i].pixels);
+		pendingImages.clear();
+		pendingArrays.clear();
+		loadState.store(MODEL_READY, std::memory_order_release);
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(gps::Shader shaderProgram, const std::vector<unsigned char>* lods, const ClusterDrawList* clusters,
+		bool depthOnly)
+	{
+		// an array stays bound until a mesh samples another of its type, each mesh picks its layers
+		// the array samplers are set even without arrays, they may not share a unit with the 2D samplers
+		GLint layerLocations[MATERIAL_TEXTURE_TYPE_COUNT];
+		GLuint boundArrays[MATERIAL_TEXTURE_TYPE_COUNT];
+		int currentLayers[MATERIAL_TEXTURE_TYPE_COUNT];
+		if (!depthOnly) {
+			shaderProgram.useShaderProgram();
+			// the meshes' VAOs pick their entries, the table is bound once for the whole model
+			GLint tableLocation = glGetUniformLocation(shaderProgram.shaderProgram, "materialTable");
+			if (tableLocation != -1) {
+				gl::Uniform1i(tableLocation, materialBuffer != 0);
+				GLuint block = glGetUniformBlockIndex(shaderProgram.shaderProgram, "Materials");
+				if (materialBuffer && block != GL_INVALID_INDEX) {
+					glUniformBlockBinding(shaderProgram.shaderProgram, block, MATERIAL_BLOCK_BINDING);
+					glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialBuffer);
+				}
+			}
+		}
+		for (int t = 0; t < MATERIAL_TEXTURE_TYPE_COUNT; t++) {
+			layerLocations[t] = -1;
+			boundArrays[t] = 0;
+			currentLayers[t] = -2;
+			if (depthOnly)
+				continue;
+			std::string type = MATERIAL_TEXTURE_TYPES[t];
+			layerLocations[t] = glGetUniformLocation(shaderProgram.shaderProgram, (type + "Layer").c_str());
+			GLint arrayLocation = glGetUniformLocation(shaderProgram.shaderProgram, (type + "Array").c_str());
+			if (arrayLocation != -1)
+				gl::Uniform1i(arrayLocation, TEXTURE_ARRAY_FIRST_UNIT + t);
+		}
+		auto setLayers = [&](const gps::Mesh& mesh) {
+			for (int t = 0; t < MATERIAL_TEXTURE_TYPE_COUNT; t++) {
+				if (layerLocations[t] == -1)
+					continue;
+				// an array with a handle is reached through the material table
+				int layer = -1;
+				GLuint array = 0;
+				for (size_t i = 0; i < mesh.textures.size(); i++) {
+					if (mesh.textures[i].type == MATERIAL_TEXTURE_TYPES[t] && !mesh.textures[i].handle) {
+						layer = mesh.textures[i].layer;
+						array = layer >= 0 ? mesh.textures[i].id : 0;
+					}
+				}
+				if (array && array != boundArrays[t]) {
+					glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + t);
+					gl::BindTexture(GL_TEXTURE_2D_ARRAY, array);
+					boundArrays[t] = array;
+				}
+				if (layer != currentLayers[t]) {
+					gl::Uniform1i(layerLocations[t], layer);
+					currentLayers[t] = layer;
+				}
+			}
+		};
+
+		if (clusters && clusters->meshRanges.size() == meshes.size() + 1) {
+			for (int i = 0; i < meshes.size(); i++) {
+				GLuint first = clusters->meshRanges[i];
+				GLsizei count = (GLsizei)(clusters->meshRanges[i + 1] - first);
+				if (count > 0) {
+					setLayers(meshes[i]);
+					meshes[i].DrawRanges(shaderProgram, &clusters->counts[first], &clusters->offsets[first], count, depthOnly);
+				}
+			}
+		}
+		else {
+			for (int i = 0; i < meshes.size(); i++) {
+				setLayers(meshes[i]);
+				meshes[i].Draw(shaderProgram, lods && i < lods->size() ? (*lods)[i] : 0, depthOnly);
+			}
+		}
+
+		for (int t = 0; t < MATERIAL_TEXTURE_TYPE_COUNT; t++) {
+			if (boundArrays[t]) {
+				glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + t);
+				gl::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			}
+		}
+	}
+
+	void Model3D::RequestTextureLevels(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelScale)
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		float maxScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const std::vector<gps::Texture>& textures = meshes[i].textures;
+			if (textures.empty() || uvDensities[i] <= 0.0f)
+				continue;
+			// the nearest point of the bounding sphere needs the sharpest level
+			glm::vec3 boundsMin = meshes[i].getBoundsMin();
+			glm::vec3 boundsMax = meshes[i].getBoundsMax();
+			glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+			float radius = glm::length(boundsMax - boundsMin) * 0.5f * maxScale;
+			float distance = std::max(glm::length(center - cameraPosition) - radius, 0.01f);
+			float uvPerPixel = uvDensities[i] / maxScale * distance / pixelScale;
+			for (size_t t = 0; t < textures.size(); t++) {
+				if (textures[t].streamSlot >= 0)
+					gps::TextureStreaming::Request(textures[t].streamSlot, uvPerPixel);
+			}
+		}
+	}
+
+	void Model3D::CullClusters(const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+		const std::vector<unsigned char>& lods, ClusterDrawList& clusters)
+	{
+		clusters.counts.clear();
+		clusters.offsets.clear();
+		clusters.meshRanges.clear();
+		clusters.meshRanges.push_back(0);
+
+		gps::ClusterCullView view = gps::MeshletBuilder::MakeCullView(viewProjection, model, cameraPosition);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			gps::Mesh& mesh = meshes[i];
+			gps::MeshLod level = mesh.getLod(glm::clamp(i < lods.size() ? (int)lods[i] : 0, 0, mesh.getLodCount() - 1));
+			size_t indexSize = mesh.getIndexSize();
+
+			if (level.meshletCount == 0) {
+				clusters.counts.push_back(level.indexCount);
+				clusters.offsets.push_back((const GLvoid*)(level.indexOffset * indexSize));
+			}
+			else {
+				const std::vector<gps::Meshlet>& meshlets = mesh.getMeshlets();
+				GLuint rangeEnd = 0;
+				bool open = false;
+				for (GLuint m = level.meshletOffset; m < level.meshletOffset + level.meshletCount; m++) {
+					const gps::Meshlet& meshlet = meshlets[m];
+					if (gps::MeshletBuilder::IsCulled(meshlet, view)) {
+						open = false;
+						continue;
+					}
+					if (open && meshlet.indexOffset == rangeEnd)
+						clusters.counts.back() += meshlet.indexCount;
+					else {
+						clusters.counts.push_back(meshlet.indexCount);
+						clusters.offsets.push_back((const GLvoid*)(meshlet.indexOffset * indexSize));
+						open = true;
+					}
+					rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+				}
+			}
+			clusters.meshRanges.push_back((GLuint)clusters.counts.size());
+		}
+	}
+
+	void Model3D::GetBounds(glm::vec3& boundsMin, glm::vec3& boundsMax)
+	{
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			boundsMin = i == 0 ? meshes[i].getBoundsMin() : glm::min(boundsMin, meshes[i].getBoundsMin());
+			boundsMax = i == 0 ? meshes[i].getBoundsMax() : glm::max(boundsMax, meshes[i].getBoundsMax());
+		}
+	}
+
+	MODEL_LOAD_STATE Model3D::GetLoadState()
+	{
+		return (MODEL_LOAD_STATE)loadState.load(std::memory_order_acquire);
+	}
+
+	bool Model3D::IsReady()
+	{
+		return GetLoadState() == MODEL_READY;
+	}
+
+	void Model3D::GetLoadBounds(glm::vec3& boundsMin, glm::vec3& boundsMax)
+	{
+		boundsMin = loadBoundsMin;
+		boundsMax = loadBoundsMax;
+	}
+
+	void Model3D::SelectLods(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelScale, const LodSettings& settings,
+		std::vector<unsigned char>& lods, std::vector<unsigned char>& shadowLods, std::vector<unsigned char>* history)
+	{
+		lods.resize(meshes.size());
+		shadowLods.resize(meshes.size());
+		std::vector<unsigned char>& previousLods = history ? *history : lodHistory;
+		previousLods.resize(meshes.size(), 0);
+
+		// the sphere radius grows with the largest axis scale of the model matrix
+		float maxScale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			int levels = meshes[i].getLodCount();
+			int previous = previousLods[i];
+			int lod = 0;
+			if (levels > 1) {
+				glm::vec3 boundsMin = meshes[i].getBoundsMin();
+				glm::vec3 boundsMax = meshes[i].getBoundsMax();
+				glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+				float radius = glm::length(boundsMax - boundsMin) * 0.5f * maxScale;
+				float distance = glm::length(center - cameraPosition);
+
+				if (distance > radius && radius > 0.0f) {
+					float projectedSize = 2.0f * radius / distance * pixelScale;
+					// continuous level: 1 at fullDetailSize, +1 for every halving
+					float level = std::log2(settings.fullDetailSize / projectedSize) + 1.0f;
+					if (level >= previous - settings.hysteresis && level < previous + 1 + settings.hysteresis)
+						lod = previous;
+					else
+						lod = glm::clamp((int)std::floor(level), 0, levels - 1);
+				}
+				lod = glm::clamp(lod, 0, levels - 1);
+			}
+			previousLods[i] = (unsigned char)lod;
+			lods[i] = (unsigned char)lod;
+			shadowLods[i] = (unsigned char)glm::clamp(lod + settings.shadowBias, 0, levels - 1);
+		}
+	}
+
+	void Model3D::GenerateLods(gps::MeshData& meshData, int lodCount)
+	{
+		PROFILE_ZONE("GenerateLods");
+		// the simplifier needs the corners of neighbouring faces to share vertices
+		gps::MeshSimplifier::Weld(meshData.vertices, meshData.indices);
+
+		gps::MeshLod full = { 0, (GLsizei)meshData.indices.size(), 0.0f, 0, 0 };
+		meshData.lods.clear();
+		meshData.lods.push_back(full);
+		if (meshData.vertices.empty())
+			return;
+
+		glm::vec3 boundsMin = meshData.vertices[0].Position;
+		glm::vec3 boundsMax = boundsMin;
+		for (size_t v = 1; v < meshData.vertices.size(); v++) {
+			boundsMin = glm::min(boundsMin, meshData.vertices[v].Position);
+			boundsMax = glm::max(boundsMax, meshData.vertices[v].Position);
+		}
+		float diagonal = glm::length(boundsMax - boundsMin);
+
+		std::vector<GLuint> previous = meshData.indices;
+		for (int level = 1; level < lodCount; level++) {
+			// 1% of the mesh size for the first level, doubling with each further one
+			float maxError = diagonal * 0.01f * (float)(1 << (level - 1));
+			float error = 0.0f;
+			std::vector<GLuint> simplified = gps::MeshSimplifier::Simplify(meshData.vertices, previous,
+				previous.size() / 2, maxError, &error);
+			// stop once the seams and borders leave nothing worth another level
+			if (simplified.empty() || simplified.size() > previous.size() * 9 / 10)
+				break;
+
+			// each level is simplified from the previous one, so the errors add up
+			gps::MeshLod lod = { (GLuint)meshData.indices.size(), (GLsizei)simplified.size(),
+				meshData.lods.back().error + error, 0, 0 };
+			meshData.lods.push_back(lod);
+			meshData.indices.insert(meshData.indices.end(), simplified.begin(), simplified.end());
+			previous.swap(simplified);
+		}
+	}
+
+	void Model3D::BuildMeshlets(gps::MeshData& meshData)
+	{
+		if (meshData.lods.empty()) {
+			gps::MeshLod full = { 0, (GLsizei)meshData.indices.size(), 0.0f, 0, 0 };
+			meshData.lods.push_back(full);
+		}
+
+		meshData.meshlets.clear();
+		for (size_t l = 0; l < meshData.lods.size(); l++) {
+			gps::MeshLod& lod = meshData.lods[l];
+			lod.meshletOffset = (GLuint)meshData.meshlets.size();
+			gps::MeshletBuilder::Build(meshData.vertices, meshData.indices, lod.indexOffset, lod.indexCount, meshData.meshlets);
+			lod.meshletCount = (GLuint)meshData.meshlets.size() - lod.meshletOffset;
+		}
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
+		PROFILE_ZONE("ReadOBJ");
 
-        std::cout << "Loading : " << fileName << std::endl;
+        std::cout << "Loading : " + fileName + "\n";
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret;
+		const unsigned char* data;
+		size_t size;
+		if (AssetArchive::Find(fileName, &data, &size)) {
+			// parsed straight out of the mapping, no copy of the file
+			MemoryStreamBuffer buffer(data, size);
+			std::istream stream(&buffer);
+			ArchiveMaterialReader materialReader(basePath);
+			ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &stream, &materialReader, GL_TRUE);
+		}
+		else {
+			ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		}
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -40,14 +649,17 @@ namespace gps {
 			exit(1);
 		}
 
-		std::cout << "# of shapes    : " << shapes.size() << std::endl;
-		std::cout << "# of materials : " << materials.size() << std::endl;
+		// one write per line so output from parallel loads doesn't interleave
+		std::cout << "# of shapes    : " + std::to_string(shapes.size()) + "\n";
+		std::cout << "# of materials : " + std::to_string(materials.size()) + "\n";
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			gps::MeshData meshData;
+			std::vector<gps::Vertex>& vertices = meshData.vertices;
+			std::vector<GLuint>& indices = meshData.indices;
+			vertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -107,40 +719,197 @@ namespace gps {
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 					if (!ambientTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
+						meshData.texturePaths.push_back(basePath + ambientTexturePath);
+						meshData.textureTypes.push_back("ambientTexture");
 					}
 
 					//diffuse texture
 					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
 					if (!diffuseTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
+						meshData.texturePaths.push_back(basePath + diffuseTexturePath);
+						meshData.textureTypes.push_back("diffuseTexture");
 					}
 
 					//specular texture
 					std::string specularTexturePath = materials[materialId].specular_texname;
 					if (!specularTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
+						meshData.texturePaths.push_back(basePath + specularTexturePath);
+						meshData.textureTypes.push_back("specularTexture");
+					}
+				}
+			}
+
+			pendingMeshes.push_back(std::move(meshData));
+		}
+	}
+
+	void Model3D::BuildTextureArrays(int maxSize)
+	{
+		PROFILE_ZONE("BuildTextureArrays");
+		struct Bucket
+		{
+			int widthClass;
+			int heightClass;
+			std::vector<const gps::ImageData*> members;
+		};
+
+		for (int t = 0; t < MATERIAL_TEXTURE_TYPE_COUNT; t++) {
+			// bucketed by power-of-two size class, so a layer is never stretched to twice its size or more
+			std::vector<Bucket> buckets;
+			for (size_t i = 0; i < pendingImages.size(); i++) {
+				const gps::ImageData& image = pendingImages[i];
+				if (!image.pixels || std::max(image.width, image.height) > maxSize)
+					continue;
+				bool used = false;
+				for (size_t m = 0; m < pendingMeshes.size() && !used; m++) {
+					for (size_t k = 0; k < pendingMeshes[m].texturePaths.size() && !used; k++)
+						used = pendingMeshes[m].texturePaths[k] == image.path && pendingMeshes[m].textureTypes[k] == MATERIAL_TEXTURE_TYPES[t];
+				}
+				if (!used)
+					continue;
+
+				int widthClass = SizeClass(image.width);
+				int heightClass = SizeClass(image.height);
+				size_t b = 0;
+				while (b < buckets.size() && (buckets[b].widthClass != widthClass || buckets[b].heightClass != heightClass))
+					b++;
+				if (b == buckets.size()) {
+					Bucket bucket;
+					bucket.widthClass = widthClass;
+					bucket.heightClass = heightClass;
+					buckets.push_back(bucket);
+				}
+				// past the layer limit the image stays a texture of its own
+				if (buckets[b].members.size() < MAX_ARRAY_LAYERS)
+					buckets[b].members.push_back(&image);
+			}
+
+			for (size_t b = 0; b < buckets.size(); b++) {
+				const std::vector<const gps::ImageData*>& members = buckets[b].members;
+				// a single texture saves no binds
+				if (members.size() < 2)
+					continue;
+
+				gps::TextureArrayData array;
+				array.type = MATERIAL_TEXTURE_TYPES[t];
+				array.width = 0;
+				array.height = 0;
+				for (size_t k = 0; k < members.size(); k++) {
+					array.width = std::max(array.width, members[k]->width);
+					array.height = std::max(array.height, members[k]->height);
+				}
+				size_t layerBytes = (size_t)array.width * array.height * 4;
+				array.pixels.resize(layerBytes * members.size());
+				for (size_t k = 0; k < members.size(); k++) {
+					const gps::ImageData& image = *members[k];
+					unsigned char* layer = &array.pixels[k * layerBytes];
+					if (image.width == array.width && image.height == array.height)
+						memcpy(layer, image.pixels, layerBytes);
+					else
+						ResampleRgba(image.pixels, image.width, image.height, layer, array.width, array.height);
+					array.paths.push_back(image.path);
+				}
+				pendingArrays.push_back(std::move(array));
+			}
+		}
+	}
+
+	void Model3D::UploadTextureArrays()
+	{
+		PROFILE_ZONE("UploadTextureArrays");
+		for (size_t a = 0; a < pendingArrays.size(); a++) {
+			const gps::TextureArrayData& array = pendingArrays[a];
+			GLsizei layers = (GLsizei)array.paths.size();
+
+			gps::Texture texture;
+			texture.type = array.type;
+			texture.streamSlot = -1;
+			texture.layer = -1;
+			texture.handle = 0;
+			glGenTextures(1, &texture.id);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_SRGB, array.width, array.height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+				&array.pixels[0]);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			gps::GpuMemory::Track(GL_TEXTURE, texture.id, gps::GPU_MEMORY_TEXTURE,
+				gps::GpuMemory::TextureBytes(array.width, array.height, 4, true, layers), name,
+				array.type + " array " + std::to_string(array.width) + "x" + std::to_string(array.height));
+
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			if (loadOptions.bindlessTextures)
+				texture.handle = MakeTextureHandleResident(texture.id);
+
+			printf("Texture array %s: %s, %d layers of %dx%d\n", name.c_str(), array.type.c_str(), layers, array.width, array.height);
+			textureArrays.push_back(texture);
+		}
+	}
+
+	void Model3D::UploadMaterials()
+	{
+		PROFILE_ZONE("UploadMaterials");
+		DeleteMaterials();
+		std::vector<MaterialData> materials(MAX_MATERIALS);
+		std::vector<GLuint> indices(meshes.size());
+		for (size_t m = 0; m < meshes.size(); m++) {
+			MaterialData& material = materials[m];
+			for (int t = 0; t < MATERIAL_TEXTURE_TYPE_COUNT; t++) {
+				material.handles[t] = 0;
+				material.layers[t] = -1;
+				for (size_t i = 0; i < meshes[m].textures.size(); i++) {
+					const gps::Texture& texture = meshes[m].textures[i];
+					if (texture.type == MATERIAL_TEXTURE_TYPES[t] && texture.handle) {
+						material.handles[t] = texture.handle;
+						material.layers[t] = texture.layer;
 					}
 				}
 			}
+			material.padding[0] = material.padding[1] = 0;
+			indices[m] = (GLuint)m;
+		}
+
+		// sized for the whole block, a smaller buffer would leave the shader reading past its end
+		glGenBuffers(1, &materialBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, materialBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, materials.size() * sizeof(MaterialData), &materials[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		gps::GpuMemory::Track(GL_BUFFER, materialBuffer, gps::GPU_MEMORY_UNIFORM_BUFFER,
+			materials.size() * sizeof(MaterialData), name, "materials");
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+		glGenBuffers(1, &materialIndexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, materialIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		gps::GpuMemory::Track(GL_BUFFER, materialIndexBuffer, gps::GPU_MEMORY_VERTEX_BUFFER,
+			indices.size() * sizeof(GLuint), name, "material indices");
+		for (size_t m = 0; m < meshes.size(); m++)
+			meshes[m].setMaterialIndex(materialIndexBuffer, (GLuint)m);
+	}
+
+	void Model3D::DeleteMaterials()
+	{
+		if (materialBuffer) {
+			gps::GpuMemory::Release(GL_BUFFER, materialBuffer);
+			glDeleteBuffers(1, &materialBuffer);
 		}
+		if (materialIndexBuffer) {
+			gps::GpuMemory::Release(GL_BUFFER, materialIndexBuffer);
+			glDeleteBuffers(1, &materialIndexBuffer);
+		}
+		materialBuffer = 0;
+		materialIndexBuffer = 0;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
 			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
+				if (loadedTextures[i].path == path && (loadedTextures[i].layer < 0 || loadedTextures[i].type == type))
 				{
 					//already loaded texture
 					return loadedTextures[i];
@@ -148,20 +917,68 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = 0;
+			currentTexture.streamSlot = -1;
+			currentTexture.layer = -1;
+			currentTexture.handle = 0;
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
+			//a layer of an array built by ParseModel; the arrays were uploaded last, in the same order
+			size_t firstArray = textureArrays.size() - pendingArrays.size();
+			for (size_t a = 0; a < pendingArrays.size(); a++) {
+				if (pendingArrays[a].type != type)
+					continue;
+				for (size_t k = 0; k < pendingArrays[a].paths.size(); k++) {
+					if (pendingArrays[a].paths[k] == path) {
+						currentTexture.id = textureArrays[firstArray + a].id;
+						currentTexture.layer = (int)k;
+						currentTexture.handle = textureArrays[firstArray + a].handle;
+						loadedTextures.push_back(currentTexture);
+						return currentTexture;
+					}
+				}
+			}
+
+			bool decoded = false;
+			for (size_t i = 0; i < pendingImages.size() && !decoded; i++) {
+				if (pendingImages[i].path == path) {
+					//decoded by ParseModel
+					currentTexture.id = UploadTexture(pendingImages[i], &currentTexture.streamSlot);
+					decoded = true;
+				}
+			}
+			if (!decoded)
+				currentTexture.id = ReadTextureFromFile(path.c_str(), &currentTexture.streamSlot);
+			if (loadOptions.bindlessTextures && currentTexture.id && currentTexture.streamSlot < 0)
+				currentTexture.handle = MakeTextureHandleResident(currentTexture.id);
+
 			loadedTextures.push_back(currentTexture);
 
 			return currentTexture;
 		}
 
 	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+	GLuint Model3D::ReadTextureFromFile(const char* file_name, int* streamSlot) {
+		PROFILE_ZONE("ReadTextureFromFile");
+		gps::ImageData image;
+		image.path = file_name;
+		if (!DecodeTexture(image))
+			return false;
+		return UploadTexture(image, streamSlot);
+	}
+
+	// Decodes an image file into flipped RGBA8 pixels
+	bool Model3D::DecodeTexture(gps::ImageData& image) {
+		PROFILE_ZONE("DecodeTexture");
+		const char* file_name = image.path.c_str();
 		int x, y, n;
 		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+		const unsigned char* data;
+		size_t size;
+		unsigned char* image_data = AssetArchive::Find(image.path, &data, &size) ?
+			stbi_load_from_memory(data, (int)size, &x, &y, &n, force_channels) :
+			stbi_load(file_name, &x, &y, &n, force_channels);
 		if (!image_data) {
 			fprintf(stderr, "ERROR: could not load %s\n", file_name);
 			return false;
@@ -191,21 +1008,47 @@ namespace gps {
 			}
 		}
 
+		image.width = x;
+		image.height = y;
+		image.pixels = image_data;
+		// on the decoding thread, so the GL thread only copies levels
+		if (gps::TextureStreaming::IsEnabled())
+			gps::TextureStreaming::BuildMipChain(image);
+		return true;
+	}
+
+	// Creates the GL texture and its mipmaps; frees the pixels
+	GLuint Model3D::UploadTexture(gps::ImageData& image, int* streamSlot) {
+		PROFILE_ZONE("UploadTexture");
+		*streamSlot = -1;
+		if (!image.pixels)
+			return false;
+
 		GLuint textureID;
+		*streamSlot = gps::TextureStreaming::Create(image, name, &textureID);
+		if (*streamSlot >= 0) {
+			stbi_image_free(image.pixels);
+			image.pixels = NULL;
+			return textureID;
+		}
+
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_2D, textureID);
 		glTexImage2D(
 			GL_TEXTURE_2D,
 			0,
 			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
+			image.width,
+			image.height,
 			0,
 			GL_RGBA,
 			GL_UNSIGNED_BYTE,
-			image_data
+			image.pixels
 		);
 		glGenerateMipmap(GL_TEXTURE_2D);
+		// GL_SRGB is stored padded to four bytes per texel by every driver we target
+		gps::GpuMemory::Track(GL_TEXTURE, textureID, gps::GPU_MEMORY_TEXTURE,
+			gps::GpuMemory::TextureBytes(image.width, image.height, 4, true), name, image.path);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -213,21 +1056,55 @@ namespace gps {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glBindTexture(GL_TEXTURE_2D, 0);
 
+		stbi_image_free(image.pixels);
+		image.pixels = NULL;
+
 		return textureID;
 	}
 
-	Model3D::~Model3D() {
+	void Model3D::DeleteTextures() {
+        // the table names the handles made non-resident below
+        DeleteMaterials();
         for (size_t i = 0; i < loadedTextures.size(); i++) {
+            if (loadedTextures.at(i).streamSlot >= 0) {
+                gps::TextureStreaming::Destroy(loadedTextures.at(i).streamSlot);
+                continue;
+            }
+            // deleted with its array below
+            if (loadedTextures.at(i).layer >= 0)
+                continue;
+            if (loadedTextures.at(i).handle)
+                glMakeTextureHandleNonResidentARB(loadedTextures.at(i).handle);
+            gps::GpuMemory::Release(GL_TEXTURE, loadedTextures.at(i).id);
             glDeleteTextures(1, &loadedTextures.at(i).id);
         }
+        loadedTextures.clear();
 
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+        for (size_t i = 0; i < textureArrays.size(); i++) {
+            if (textureArrays.at(i).handle)
+                glMakeTextureHandleNonResidentARB(textureArrays.at(i).handle);
+            gps::GpuMemory::Release(GL_TEXTURE, textureArrays.at(i).id);
+            glDeleteTextures(1, &textureArrays.at(i).id);
         }
+        textureArrays.clear();
+        pendingArrays.clear();
+
+        for (size_t i = 0; i < pendingImages.size(); i++)
+            stbi_image_free(pendingImages[i].pixels);
+        pendingImages.clear();
+	}
+
+	void Model3D::Destroy() {
+        // the meshes delete their own buffers
+        meshes.clear();
+        DeleteTextures();
+        pendingMeshes.clear();
+        uvDensities.clear();
+        lodHistory.clear();
+        loadState = MODEL_UNLOADED;
+	}
+
+	Model3D::~Model3D() {
+        Destroy();
 	}
 }
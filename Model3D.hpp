@@ -2,42 +2,205 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "JobSystem.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <vector>
 
 namespace gps {
 
+    // Geometry of one shape as parsed from the .obj file, before it is uploaded
+    struct MeshData
+    {
+        std::vector<gps::Vertex> vertices;
+        // every level of detail back to back, see lods
+        std::vector<GLuint> indices;
+        std::vector<gps::MeshLod> lods;
+        std::vector<gps::Meshlet> meshlets;
+        // parallel arrays: texture file and its sampler name
+        std::vector<std::string> texturePaths;
+        std::vector<std::string> textureTypes;
+        // texture coordinate units per object space unit, averaged over the surface
+        float uvDensity;
+    };
+
+    // Decoded RGBA8 pixels waiting to be uploaded
+    struct ImageData
+    {
+        std::string path;
+        int width;
+        int height;
+        unsigned char* pixels;
+        // every mip level, finest first, when gps::TextureStreaming is on
+        std::vector<unsigned char> mipChain;
+    };
+
+    // Small textures of one type and size class packed as the layers of a GL_TEXTURE_2D_ARRAY, RGBA8 like ImageData
+    struct TextureArrayData
+    {
+        std::string type;
+        int width;
+        int height;
+        // one layer per file, in this order
+        std::vector<std::string> paths;
+        std::vector<unsigned char> pixels;
+    };
+
+    // Screen-size level of detail selection
+    struct LodSettings
+    {
+        // projected bounding-sphere diameter in pixels below which a mesh leaves full detail; each further level halves it
+        float fullDetailSize;
+        // fraction of a level the projected size has to move past a threshold before the choice changes
+        float hysteresis;
+        // levels added in the shadow pass
+        int shadowBias;
+
+        LodSettings() : fullDetailSize(400.0f), hysteresis(0.2f), shadowBias(1) {}
+    };
+
+    // Index ranges left after cluster culling, ready for glMultiDrawElements
+    struct ClusterDrawList
+    {
+        std::vector<GLsizei> counts;
+        // byte offsets into each mesh's index buffer
+        std::vector<const GLvoid*> offsets;
+        // the ranges of mesh i are [meshRanges[i], meshRanges[i + 1]); empty when nothing was culled
+        std::vector<GLuint> meshRanges;
+    };
+
+    // How far a model has got through ParseModel and UploadModel; each state is published after the data it covers
+    enum MODEL_LOAD_STATE { MODEL_UNLOADED, MODEL_GEOMETRY_READ, MODEL_PARSED, MODEL_READY };
+
+    // Owns its meshes and textures; move-only like gps::Mesh
     class Model3D
     {
 
     public:
+        Model3D();
         ~Model3D();
 
+        Model3D(Model3D&& other) noexcept;
+        Model3D& operator=(Model3D&& other) noexcept;
+        Model3D(const Model3D&) = delete;
+        Model3D& operator=(const Model3D&) = delete;
+
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// CPU half of LoadModel - parses the .obj and decodes its textures, no GL calls
+		// Safe to run on a worker thread; textures are decoded in parallel when a job system is given
+		// options decide how much geometry the meshes keep in system memory after UploadModel
+		void ParseModel(std::string fileName, std::string basePath, gps::JobSystem* jobSystem = NULL,
+			const gps::MeshLoadOptions& options = gps::MeshLoadOptions());
+
+		// GL half of LoadModel - creates textures and buffers from the parsed data, main thread only
+		void UploadModel();
+
+		// Deletes the meshes, textures and any parsed data while the context is still current, GL thread only
+		// The destructor does the same for a model not destroyed yet
+		void Destroy();
+
+		// lods holds one level per mesh, as filled by SelectLods; NULL draws full detail
+		// clusters, when filled by CullClusters, replaces lods and draws only the surviving meshlets
+		// depthOnly uses the position-only depth stream of the meshes that have one
+		void Draw(gps::Shader shaderProgram, const std::vector<unsigned char>* lods = NULL, const ClusterDrawList* clusters = NULL,
+			bool depthOnly = false);
+
+		// Union of the mesh bounds, object space
+		void GetBounds(glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+		// Safe to poll from any thread while another one loads the model
+		MODEL_LOAD_STATE GetLoadState();
+		bool IsReady();
+
+		// Same bounds as GetBounds, but known as soon as the .obj is read, long before the meshes exist
+		void GetLoadBounds(glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+		// Picks a level per mesh from its projected bounding sphere; pixelScale is viewportHeight / (2 tan(fovy / 2))
+		// Keeps the previous choices for hysteresis, so only one thread may select for a model at a time
+		// Instances drawn from one model pass their own history instead, resized here as needed
+		void SelectLods(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelScale, const LodSettings& settings,
+			std::vector<unsigned char>& lods, std::vector<unsigned char>& shadowLods, std::vector<unsigned char>* history = NULL);
+
+		// Tells gps::TextureStreaming which level of each streamed texture the meshes need at this distance
+		void RequestTextureLevels(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelScale);
+
+		// Drops the meshlets of the chosen levels that are outside the frustum or face away from the camera
+		// Adjacent survivors are merged into one range; meshes without meshlets get their whole level
+		void CullClusters(const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition,
+			const std::vector<unsigned char>& lods, ClusterDrawList& clusters);
 
     private:
+		// File the model was parsed from; owner of its GPU allocations
+        std::string name;
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// One GL_TEXTURE_2D_ARRAY per packed texture type and size class, the textures of its layers are in loadedTextures
+        std::vector<gps::Texture> textureArrays;
+		// With bindless textures: a uniform buffer of one MaterialData per mesh, and the index of each mesh's
+		// entry that its VAO reads as attribute 3; 0 when the textures are bound to units
+        GLuint materialBuffer;
+        GLuint materialIndexBuffer;
+		// Options given to ParseModel, applied when the meshes are built
+        gps::MeshLoadOptions loadOptions;
+		// Level chosen for each mesh by the last SelectLods
+        std::vector<unsigned char> lodHistory;
+		// MeshData::uvDensity of each mesh
+        std::vector<float> uvDensities;
+		// a MODEL_LOAD_STATE
+        std::atomic<int> loadState;
+        glm::vec3 loadBoundsMin;
+        glm::vec3 loadBoundsMax;
+
+		// Parsed data waiting for UploadModel
+        std::vector<gps::MeshData> pendingMeshes;
+        std::vector<gps::ImageData> pendingImages;
+        std::vector<gps::TextureArrayData> pendingArrays;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Welds the mesh and appends up to lodCount - 1 simplified index lists, halving the triangles each time
+		void GenerateLods(gps::MeshData& meshData, int lodCount);
+
+		// Splits each level of the mesh into meshlets
+		void BuildMeshlets(gps::MeshData& meshData);
+
+		// Packs the decoded images no larger than maxSize into one TextureArrayData per type and power-of-two
+		// size class holding two or more of them
+		void BuildTextureArrays(int maxSize);
+
+		// Creates the GL_TEXTURE_2D_ARRAY of each pending array
+		void UploadTextureArrays();
+
+		// Fills the material table from the mesh textures' handles and points each mesh's VAO at its entry
+		void UploadMaterials();
+		void DeleteMaterials();
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
 		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		GLuint ReadTextureFromFile(const char* file_name, int* streamSlot);
+
+		// Decodes an image file into flipped RGBA8 pixels
+		bool DecodeTexture(gps::ImageData& image);
+
+		// Creates the GL texture and its mipmaps; frees the pixels
+		// streamSlot is set to the gps::TextureStreaming slot, -1 when the texture is resident whole
+		GLuint UploadTexture(gps::ImageData& image, int* streamSlot);
+
+		// Deletes the textures and any decoded pixels not uploaded yet
+		void DeleteTextures();
     };
 }
 
@@ -0,0 +1,82 @@
+#include "OverdrawMeter.hpp"
+
+namespace gps {
+
+	OverdrawMeter::OverdrawMeter()
+	{
+		this->current = 0;
+		this->measuring = false;
+		this->overdraw = 0.0f;
+	}
+
+	void OverdrawMeter::Create(int latency)
+	{
+		measurements.resize(latency < 2 ? 2 : latency);
+		for (size_t i = 0; i < measurements.size(); i++) {
+			glGenQueries(1, &measurements[i].query);
+			measurements[i].targetSamples = 0;
+			measurements[i].pending = false;
+		}
+		current = 0;
+		overdraw = 0.0f;
+	}
+
+	void OverdrawMeter::Destroy()
+	{
+		for (size_t i = 0; i < measurements.size(); i++)
+			glDeleteQueries(1, &measurements[i].query);
+		measurements.clear();
+	}
+
+	void OverdrawMeter::Collect()
+	{
+		// oldest first, stopping at the first query the GPU hasn't finished
+		for (size_t i = 1; i <= measurements.size(); i++) {
+			Measurement& measurement = measurements[(current + i) % measurements.size()];
+			if (!measurement.pending)
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(measurement.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+
+			GLuint64 samples = 0;
+			glGetQueryObjectui64v(measurement.query, GL_QUERY_RESULT, &samples);
+			measurement.pending = false;
+			if (measurement.targetSamples == 0)
+				continue;
+			float frameOverdraw = (float)((double)samples / measurement.targetSamples);
+			overdraw = overdraw == 0.0f ? frameOverdraw : overdraw + (frameOverdraw - overdraw) * 0.1f;
+		}
+	}
+
+	void OverdrawMeter::Begin(uint64_t targetSamples)
+	{
+		if (measurements.empty())
+			return;
+		Collect();
+
+		int next = (current + 1) % (int)measurements.size();
+		// the GPU is more than `latency` frames behind - skip this frame rather than stall
+		if (measurements[next].pending)
+			return;
+		current = next;
+		measurements[current].targetSamples = targetSamples;
+		glBeginQuery(GL_SAMPLES_PASSED, measurements[current].query);
+		measuring = true;
+	}
+
+	void OverdrawMeter::End()
+	{
+		if (!measuring)
+			return;
+		glEndQuery(GL_SAMPLES_PASSED);
+		measurements[current].pending = true;
+		measuring = false;
+	}
+
+	float OverdrawMeter::GetOverdraw()
+	{
+		return overdraw;
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef OverdrawMeter_hpp
+#define OverdrawMeter_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // GL_SAMPLES_PASSED around the pass that resolves visibility, read back `latency` frames later so the
+    // CPU never waits. Overdraw is the number of samples that passed the depth test per framebuffer sample
+    class OverdrawMeter
+    {
+    public:
+        OverdrawMeter();
+
+        void Create(int latency = 4);
+        void Destroy();
+
+        // Collects finished measurements, then counts the samples drawn until End
+        // targetSamples is width * height * samples per pixel of the framebuffer drawn to
+        void Begin(uint64_t targetSamples);
+        void End();
+
+        // Moving average of the resolved frames; 0 until the first result arrives
+        float GetOverdraw();
+
+    private:
+        struct Measurement
+        {
+            GLuint query;
+            uint64_t targetSamples;
+            bool pending;
+        };
+
+        std::vector<Measurement> measurements;
+        int current;
+        bool measuring;
+        float overdraw;
+
+        void Collect();
+    };
+}
+
+#endif /* OverdrawMeter_hpp */
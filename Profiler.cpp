@@ -0,0 +1,185 @@
+#include "Profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+namespace gps {
+
+	static std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+	// registration is the only locked path; recording touches only the thread's own buffer
+	static std::mutex registryMutex;
+	static std::vector<ProfileThreadBuffer*> threadBuffers;
+	static uint32_t nextThreadId = 1;
+	static thread_local ProfileThreadBuffer* threadBuffer = NULL;
+
+	static std::mutex gpuMutex;
+	static std::vector<GpuTimerSample> gpuSamples;
+	static int64_t gpuClockOffsetNs = 0;
+
+	static ProfileThreadBuffer::Chunk* NewChunk()
+	{
+		ProfileThreadBuffer::Chunk* chunk = new ProfileThreadBuffer::Chunk();
+		chunk->count.store(0, std::memory_order_relaxed);
+		chunk->next.store(NULL, std::memory_order_relaxed);
+		return chunk;
+	}
+
+	static ProfileThreadBuffer* GetThreadBuffer()
+	{
+		if (!threadBuffer) {
+			ProfileThreadBuffer* buffer = new ProfileThreadBuffer();
+			buffer->first = NewChunk();
+			buffer->last = buffer->first;
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffer->threadId = nextThreadId++;
+			buffer->threadName = "thread " + std::to_string(buffer->threadId);
+			threadBuffers.push_back(buffer);
+			threadBuffer = buffer;
+		}
+		return threadBuffer;
+	}
+
+	bool Profiler::IsEnabled()
+	{
+#if defined(GPS_PROFILER)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	uint64_t Profiler::Now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch).count();
+	}
+
+	void Profiler::SetThreadName(const char* name)
+	{
+		ProfileThreadBuffer* buffer = GetThreadBuffer();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->threadName = name;
+	}
+
+	void Profiler::Record(const char* name, uint64_t beginNs, uint64_t endNs)
+	{
+		ProfileThreadBuffer* buffer = GetThreadBuffer();
+		ProfileThreadBuffer::Chunk* chunk = buffer->last;
+
+		uint32_t count = chunk->count.load(std::memory_order_relaxed);
+		if (count == ProfileThreadBuffer::CHUNK_SIZE) {
+			ProfileThreadBuffer::Chunk* next = NewChunk();
+			chunk->next.store(next, std::memory_order_release);
+			buffer->last = next;
+			chunk = next;
+			count = 0;
+		}
+
+		ProfileEvent& event = chunk->events[count];
+		event.name = name;
+		event.beginNs = beginNs;
+		event.endNs = endNs;
+		// publish after the event is complete
+		chunk->count.store(count + 1, std::memory_order_release);
+	}
+
+	void Profiler::CalibrateGpuClock()
+	{
+		if (!IsEnabled())
+			return;
+
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		uint64_t cpuNow = Now();
+
+		std::lock_guard<std::mutex> lock(gpuMutex);
+		gpuClockOffsetNs = (int64_t)cpuNow - (int64_t)gpuNow;
+	}
+
+	void Profiler::AddGpuSamples(const std::vector<GpuTimerSample>& samples)
+	{
+		if (!IsEnabled() || samples.empty())
+			return;
+
+		std::lock_guard<std::mutex> lock(gpuMutex);
+		for (size_t i = 0; i < samples.size(); i++) {
+			GpuTimerSample sample = samples[i];
+			sample.beginNs = (uint64_t)((int64_t)sample.beginNs + gpuClockOffsetNs);
+			sample.endNs = (uint64_t)((int64_t)sample.endNs + gpuClockOffsetNs);
+			gpuSamples.push_back(sample);
+		}
+	}
+
+	static void WriteEvent(std::ofstream& file, bool& first, const char* name, uint32_t threadId, uint64_t beginNs, uint64_t endNs)
+	{
+		file << (first ? "\n" : ",\n");
+		first = false;
+		file << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadId
+			<< ",\"ts\":" << beginNs / 1000.0 << ",\"dur\":" << (endNs - beginNs) / 1000.0 << "}";
+	}
+
+	static void WriteThreadName(std::ofstream& file, bool& first, const std::string& name, uint32_t threadId)
+	{
+		file << (first ? "\n" : ",\n");
+		first = false;
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadId
+			<< ",\"args\":{\"name\":\"" << name << "\"}}";
+	}
+
+	bool Profiler::ExportChromeTrace(const std::string& fileName)
+	{
+		std::ofstream file(fileName.c_str());
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		std::vector<ProfileThreadBuffer*> buffers;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffers = threadBuffers;
+		}
+
+		file.precision(3);
+		file << std::fixed;
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		size_t eventCount = 0;
+
+		for (size_t i = 0; i < buffers.size(); i++) {
+			{
+				std::lock_guard<std::mutex> lock(registryMutex);
+				WriteThreadName(file, first, buffers[i]->threadName, buffers[i]->threadId);
+			}
+
+			ProfileThreadBuffer::Chunk* chunk = buffers[i]->first;
+			while (chunk) {
+				uint32_t count = chunk->count.load(std::memory_order_acquire);
+				for (uint32_t e = 0; e < count; e++) {
+					const ProfileEvent& event = chunk->events[e];
+					WriteEvent(file, first, event.name, buffers[i]->threadId, event.beginNs, event.endNs);
+					eventCount++;
+				}
+				chunk = chunk->next.load(std::memory_order_acquire);
+			}
+		}
+
+		// GPU passes get a track of their own after the CPU threads
+		const uint32_t gpuTrackId = 1000;
+		WriteThreadName(file, first, "GPU", gpuTrackId);
+		{
+			std::lock_guard<std::mutex> lock(gpuMutex);
+			for (size_t i = 0; i < gpuSamples.size(); i++) {
+				WriteEvent(file, first, gpuSamples[i].pass.c_str(), gpuTrackId, gpuSamples[i].beginNs, gpuSamples[i].endNs);
+				eventCount++;
+			}
+		}
+
+		file << "\n]}\n";
+		printf("Profiler: wrote %zu events to %s\n", eventCount, fileName.c_str());
+		return true;
+	}
+}
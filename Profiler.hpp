@@ -0,0 +1,83 @@
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#include "GpuTimer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Zones compile to nothing unless GPS_PROFILER is defined (Debug configurations define it)
+#if defined(GPS_PROFILER)
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) gps::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) gps::Profiler::SetThreadName(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#endif
+
+namespace gps {
+
+    // name must be a string literal or otherwise outlive the profiler
+    struct ProfileEvent
+    {
+        const char* name;
+        uint64_t beginNs;
+        uint64_t endNs;
+    };
+
+    // Append-only event storage written by exactly one thread and read by the exporter without locks
+    struct ProfileThreadBuffer
+    {
+        static const uint32_t CHUNK_SIZE = 4096;
+
+        struct Chunk
+        {
+            ProfileEvent events[CHUNK_SIZE];
+            std::atomic<uint32_t> count;
+            std::atomic<Chunk*> next;
+        };
+
+        std::string threadName;
+        uint32_t threadId;
+        Chunk* first;
+        // writer side only
+        Chunk* last;
+    };
+
+    class Profiler
+    {
+    public:
+        static bool IsEnabled();
+
+        // nanoseconds since the profiler's epoch
+        static uint64_t Now();
+
+        static void SetThreadName(const char* name);
+        static void Record(const char* name, uint64_t beginNs, uint64_t endNs);
+
+        // Maps the GL_TIMESTAMP clock onto Now(); call on the thread owning the GL context
+        static void CalibrateGpuClock();
+        // Places resolved GPU pass timings on their own track of the trace
+        static void AddGpuSamples(const std::vector<GpuTimerSample>& samples);
+
+        // Chrome trace event format, viewable in chrome://tracing or Perfetto
+        static bool ExportChromeTrace(const std::string& fileName);
+    };
+
+    class ProfileZone
+    {
+    public:
+        ProfileZone(const char* name) : name(name), beginNs(Profiler::Now()) {}
+        ~ProfileZone() { Profiler::Record(name, beginNs, Profiler::Now()); }
+
+    private:
+        const char* name;
+        uint64_t beginNs;
+    };
+}
+
+#endif /* Profiler_hpp */
@@ -0,0 +1,247 @@
+#include "RenderStats.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	// field table shared by the exporters
+	struct CounterField
+	{
+		const char* name;
+		uint64_t RenderCounters::*field;
+	};
+
+	static const CounterField COUNTER_FIELDS[] = {
+		{ "draw_calls", &RenderCounters::drawCalls },
+		{ "triangles", &RenderCounters::triangles },
+		{ "vertices", &RenderCounters::vertices },
+		{ "program_binds", &RenderCounters::programBinds },
+		{ "texture_binds", &RenderCounters::textureBinds },
+		{ "vao_binds", &RenderCounters::vertexArrayBinds },
+		{ "uniform_uploads", &RenderCounters::uniformUploads },
+		{ "buffer_bytes_uploaded", &RenderCounters::bufferBytesUploaded },
+		{ "fbo_binds", &RenderCounters::framebufferBinds },
+	};
+	static const size_t COUNTER_FIELD_COUNT = sizeof(COUNTER_FIELDS) / sizeof(COUNTER_FIELDS[0]);
+
+	RenderCounters::RenderCounters()
+	{
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++)
+			this->*COUNTER_FIELDS[i].field = 0;
+	}
+
+	void RenderCounters::Add(const RenderCounters& other)
+	{
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++)
+			this->*COUNTER_FIELDS[i].field += other.*COUNTER_FIELDS[i].field;
+	}
+
+	void RenderCounters::Max(const RenderCounters& other)
+	{
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++) {
+			if (other.*COUNTER_FIELDS[i].field > this->*COUNTER_FIELDS[i].field)
+				this->*COUNTER_FIELDS[i].field = other.*COUNTER_FIELDS[i].field;
+		}
+	}
+
+	bool RenderCounters::IsEmpty() const
+	{
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++) {
+			if (this->*COUNTER_FIELDS[i].field != 0)
+				return false;
+		}
+		return true;
+	}
+
+	RenderCounters RenderStats::outsideFrame;
+	RenderCounters* RenderStats::current = &RenderStats::outsideFrame;
+	bool RenderStats::inFrame = false;
+	uint64_t RenderStats::frameIndex = 0;
+	std::vector<PassRenderStats> RenderStats::frame;
+	std::vector<size_t> RenderStats::openPasses;
+	std::vector<PassRenderStats> RenderStats::lastFrame;
+	std::vector<RenderStats::PassTotals> RenderStats::totals;
+	RenderCounters RenderStats::frameSum;
+	uint64_t RenderStats::frameCount = 0;
+	std::ofstream RenderStats::frameLog;
+
+	void RenderStats::BeginFrame(uint64_t frameIndex)
+	{
+		RenderStats::frameIndex = frameIndex;
+		frame.clear();
+		openPasses.clear();
+		inFrame = true;
+		// anything issued before the first pass still belongs to the frame
+		BeginPass("unattributed");
+	}
+
+	void RenderStats::BeginPass(const std::string& name)
+	{
+		if (!inFrame)
+			return;
+
+		size_t index = frame.size();
+		for (size_t i = 0; i < frame.size(); i++) {
+			if (frame[i].name == name) {
+				index = i;
+				break;
+			}
+		}
+		if (index == frame.size()) {
+			PassRenderStats pass;
+			pass.name = name;
+			frame.push_back(pass);
+		}
+
+		openPasses.push_back(index);
+		current = &frame[index].counters;
+	}
+
+	void RenderStats::EndPass()
+	{
+		// the frame's own "unattributed" pass stays open until EndFrame
+		if (!inFrame || openPasses.size() <= 1)
+			return;
+		openPasses.pop_back();
+		current = &frame[openPasses.back()].counters;
+	}
+
+	static void WriteCounters(std::ofstream& file, const RenderCounters& counters)
+	{
+		file << "{";
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++)
+			file << (i == 0 ? "\"" : ",\"") << COUNTER_FIELDS[i].name << "\":" << counters.*COUNTER_FIELDS[i].field;
+		file << "}";
+	}
+
+	void RenderStats::EndFrame()
+	{
+		if (!inFrame)
+			return;
+		inFrame = false;
+		openPasses.clear();
+		current = &outsideFrame;
+		// only report the catch-all pass when something actually landed in it
+		if (!frame.empty() && frame[0].counters.IsEmpty())
+			frame.erase(frame.begin());
+
+		RenderCounters frameTotals;
+		for (size_t i = 0; i < frame.size(); i++) {
+			frameTotals.Add(frame[i].counters);
+
+			PassTotals* passTotals = NULL;
+			for (size_t j = 0; j < totals.size(); j++) {
+				if (totals[j].name == frame[i].name)
+					passTotals = &totals[j];
+			}
+			if (!passTotals) {
+				PassTotals newTotals;
+				newTotals.name = frame[i].name;
+				newTotals.frames = 0;
+				totals.push_back(newTotals);
+				passTotals = &totals.back();
+			}
+			passTotals->sum.Add(frame[i].counters);
+			passTotals->max.Max(frame[i].counters);
+			passTotals->frames++;
+		}
+		frameSum.Add(frameTotals);
+		frameCount++;
+
+		if (frameLog.is_open()) {
+			frameLog << "{\"frame\":" << frameIndex << ",\"total\":";
+			WriteCounters(frameLog, frameTotals);
+			frameLog << ",\"passes\":{";
+			for (size_t i = 0; i < frame.size(); i++) {
+				frameLog << (i == 0 ? "\"" : ",\"") << frame[i].name << "\":";
+				WriteCounters(frameLog, frame[i].counters);
+			}
+			frameLog << "}}\n";
+		}
+
+		lastFrame.swap(frame);
+	}
+
+	const std::vector<PassRenderStats>& RenderStats::GetLastFrame()
+	{
+		return lastFrame;
+	}
+
+	RenderCounters RenderStats::GetLastFrameTotals()
+	{
+		RenderCounters frameTotals;
+		for (size_t i = 0; i < lastFrame.size(); i++)
+			frameTotals.Add(lastFrame[i].counters);
+		return frameTotals;
+	}
+
+	RenderCounters RenderStats::GetAverageFrameTotals()
+	{
+		RenderCounters average;
+		if (frameCount == 0)
+			return average;
+		for (size_t i = 0; i < COUNTER_FIELD_COUNT; i++)
+			average.*COUNTER_FIELDS[i].field = frameSum.*COUNTER_FIELDS[i].field / frameCount;
+		return average;
+	}
+
+	bool RenderStats::OpenFrameLog(const std::string& fileName)
+	{
+		frameLog.open(fileName.c_str());
+		if (!frameLog.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void RenderStats::CloseFrameLog()
+	{
+		if (frameLog.is_open())
+			frameLog.close();
+	}
+
+	bool RenderStats::WriteSummary(const std::string& fileName)
+	{
+		std::ofstream file(fileName.c_str());
+		if (!file.is_open()) {
+			fprintf(stderr, "ERROR: could not open %s\n", fileName.c_str());
+			return false;
+		}
+
+		file.precision(2);
+		file << std::fixed;
+		file << "{\n  \"frames\": " << frameCount << ",\n";
+		file << "  \"average_per_frame\": ";
+		WriteCounters(file, GetAverageFrameTotals());
+		file << ",\n  \"passes\": {";
+		for (size_t i = 0; i < totals.size(); i++) {
+			const PassTotals& pass = totals[i];
+			file << (i == 0 ? "\n" : ",\n") << "    \"" << pass.name << "\": { \"frames\": " << pass.frames << ", \"average\": {";
+			for (size_t f = 0; f < COUNTER_FIELD_COUNT; f++)
+				file << (f == 0 ? "\"" : ",\"") << COUNTER_FIELDS[f].name << "\":" << (double)(pass.sum.*COUNTER_FIELDS[f].field) / pass.frames;
+			file << "}, \"max\": ";
+			WriteCounters(file, pass.max);
+			file << " }";
+		}
+		file << "\n  }\n}\n";
+		printf("Render stats: summary written to %s\n", fileName.c_str());
+		return true;
+	}
+
+	void RenderStats::PrintSummary()
+	{
+		if (frameCount == 0)
+			return;
+		printf("Render stats per frame (average over %llu frames)\n", (unsigned long long)frameCount);
+		printf("  %-16s %7s %9s %9s %7s %7s %7s %8s %10s %5s\n", "pass", "draws", "tris", "verts", "progs", "texs", "vaos", "uniforms", "bytes", "fbos");
+		for (size_t i = 0; i < totals.size(); i++) {
+			const PassTotals& pass = totals[i];
+			double n = (double)pass.frames;
+			printf("  %-16s %7.1f %9.0f %9.0f %7.1f %7.1f %7.1f %8.1f %10.0f %5.1f\n", pass.name.c_str(),
+				pass.sum.drawCalls / n, pass.sum.triangles / n, pass.sum.vertices / n, pass.sum.programBinds / n,
+				pass.sum.textureBinds / n, pass.sum.vertexArrayBinds / n, pass.sum.uniformUploads / n,
+				pass.sum.bufferBytesUploaded / n, pass.sum.framebufferBinds / n);
+		}
+	}
+}
@@ -0,0 +1,183 @@
+#ifndef RenderStats_hpp
+#define RenderStats_hpp
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct RenderCounters
+    {
+        uint64_t drawCalls;
+        uint64_t triangles;
+        uint64_t vertices;
+        uint64_t programBinds;
+        uint64_t textureBinds;
+        uint64_t vertexArrayBinds;
+        uint64_t uniformUploads;
+        uint64_t bufferBytesUploaded;
+        uint64_t framebufferBinds;
+
+        RenderCounters();
+        void Add(const RenderCounters& other);
+        void Max(const RenderCounters& other);
+        bool IsEmpty() const;
+    };
+
+    // Counters for one pass of one frame
+    struct PassRenderStats
+    {
+        std::string name;
+        RenderCounters counters;
+    };
+
+    // Per-pass counts of the GL work issued on the render thread, fed by the gps::gl wrappers below
+    // Work outside BeginFrame/EndFrame (loading, init) is not counted
+    class RenderStats
+    {
+    public:
+        static RenderCounters& Current() { return *current; }
+
+        static void BeginFrame(uint64_t frameIndex);
+        static void EndFrame();
+        // Passes nest; counts go to the innermost open pass
+        static void BeginPass(const std::string& name);
+        static void EndPass();
+
+        static const std::vector<PassRenderStats>& GetLastFrame();
+        static RenderCounters GetLastFrameTotals();
+        // Per-frame average of every frame so far, all passes summed
+        static RenderCounters GetAverageFrameTotals();
+
+        // One JSON object per frame, one frame per line
+        static bool OpenFrameLog(const std::string& fileName);
+        static void CloseFrameLog();
+        // Per-pass averages and maxima per frame over the whole run
+        static bool WriteSummary(const std::string& fileName);
+        static void PrintSummary();
+
+    private:
+        struct PassTotals
+        {
+            std::string name;
+            RenderCounters sum;
+            RenderCounters max;
+            uint64_t frames;
+        };
+
+        static RenderCounters* current;
+        static RenderCounters outsideFrame;
+        static bool inFrame;
+        static uint64_t frameIndex;
+        static std::vector<PassRenderStats> frame;
+        static std::vector<size_t> openPasses;
+        static std::vector<PassRenderStats> lastFrame;
+        static std::vector<PassTotals> totals;
+        static RenderCounters frameSum;
+        static uint64_t frameCount;
+        static std::ofstream frameLog;
+    };
+
+    // Counting stand-ins for the GL calls made while drawing; same arguments as the functions they wrap
+    namespace gl {
+
+        inline void UseProgram(GLuint program)
+        {
+            RenderStats::Current().programBinds++;
+            glUseProgram(program);
+        }
+
+        inline void BindTexture(GLenum target, GLuint texture)
+        {
+            RenderStats::Current().textureBinds++;
+            glBindTexture(target, texture);
+        }
+
+        inline void BindVertexArray(GLuint vertexArray)
+        {
+            RenderStats::Current().vertexArrayBinds++;
+            glBindVertexArray(vertexArray);
+        }
+
+        inline void BindFramebuffer(GLenum target, GLuint framebuffer)
+        {
+            RenderStats::Current().framebufferBinds++;
+            glBindFramebuffer(target, framebuffer);
+        }
+
+        inline void Uniform1i(GLint location, GLint value)
+        {
+            RenderStats::Current().uniformUploads++;
+            glUniform1i(location, value);
+        }
+
+        inline void Uniform1f(GLint location, GLfloat value)
+        {
+            RenderStats::Current().uniformUploads++;
+            glUniform1f(location, value);
+        }
+
+        inline void Uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+        {
+            RenderStats::Current().uniformUploads++;
+            glUniform3fv(location, count, value);
+        }
+
+        inline void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+        {
+            RenderStats::Current().uniformUploads++;
+            glUniformMatrix4fv(location, count, transpose, value);
+        }
+
+        // vertices are the ones submitted - the index count for indexed draws
+        inline void CountPrimitives(RenderCounters& counters, GLenum mode, GLsizei count)
+        {
+            counters.drawCalls++;
+            counters.vertices += count;
+            if (mode == GL_TRIANGLES)
+                counters.triangles += count / 3;
+            else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+                counters.triangles += count > 2 ? count - 2 : 0;
+        }
+
+        inline void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+        {
+            CountPrimitives(RenderStats::Current(), mode, count);
+            glDrawElements(mode, count, type, indices);
+        }
+
+        // one draw call for the whole batch
+        inline void MultiDrawElements(GLenum mode, const GLsizei* count, GLenum type, const void* const* indices, GLsizei drawCount)
+        {
+            RenderCounters batch;
+            for (GLsizei i = 0; i < drawCount; i++)
+                CountPrimitives(batch, mode, count[i]);
+            batch.drawCalls = drawCount > 0 ? 1 : 0;
+            RenderStats::Current().Add(batch);
+            glMultiDrawElements(mode, count, type, indices, drawCount);
+        }
+
+        inline void DrawArrays(GLenum mode, GLint first, GLsizei count)
+        {
+            CountPrimitives(RenderStats::Current(), mode, count);
+            glDrawArrays(mode, first, count);
+        }
+
+        // one draw call, primitives of every instance
+        inline void DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
+        {
+            RenderCounters batch;
+            CountPrimitives(batch, mode, count);
+            batch.vertices *= instanceCount;
+            batch.triangles *= instanceCount;
+            RenderStats::Current().Add(batch);
+            glDrawArraysInstanced(mode, first, count, instanceCount);
+        }
+    }
+}
+
+#endif /* RenderStats_hpp */
@@ -0,0 +1,113 @@
+#include "RenderTarget.hpp"
+#include "GpuMemory.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	RenderTarget::RenderTarget()
+	{
+		this->framebuffer = 0;
+		this->colorRenderbuffer = 0;
+		this->colorTexture = 0;
+		this->depthRenderbuffer = 0;
+		this->width = 0;
+		this->height = 0;
+	}
+
+	bool RenderTarget::Create(int width, int height, bool sampledColor)
+	{
+		this->width = width;
+		this->height = height;
+
+		// a sampled target is an intermediate that gets upscaled into the final one, so it holds
+		// linear colour; only the final target is sRGB, which the GL_FRAMEBUFFER_SRGB state the
+		// application enables at startup encodes on write just as it does for the window
+		if (sampledColor) {
+			glGenTextures(1, &colorTexture);
+			glBindTexture(GL_TEXTURE_2D, colorTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+		else {
+			glGenRenderbuffers(1, &colorRenderbuffer);
+			glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+		}
+
+		glGenRenderbuffers(1, &depthRenderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		if (sampledColor)
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		else
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		if (sampledColor)
+			GpuMemory::Track(GL_TEXTURE, colorTexture, GPU_MEMORY_RENDER_TARGET,
+				GpuMemory::TextureBytes(width, height, 4, false), "render target", "color");
+		else
+			GpuMemory::Track(GL_RENDERBUFFER, colorRenderbuffer, GPU_MEMORY_RENDER_TARGET,
+				GpuMemory::TextureBytes(width, height, 4, false), "render target", "color");
+		GpuMemory::Track(GL_RENDERBUFFER, depthRenderbuffer, GPU_MEMORY_RENDER_TARGET,
+			GpuMemory::TextureBytes(width, height, 4, false), "render target", "depth");
+
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "ERROR: render target %dx%d is incomplete (0x%x)\n", width, height, status);
+			Destroy();
+			return false;
+		}
+		return true;
+	}
+
+	void RenderTarget::Destroy()
+	{
+		if (framebuffer)
+			glDeleteFramebuffers(1, &framebuffer);
+		GpuMemory::Release(GL_RENDERBUFFER, colorRenderbuffer);
+		GpuMemory::Release(GL_RENDERBUFFER, depthRenderbuffer);
+		if (colorTexture) {
+			GpuMemory::Release(GL_TEXTURE, colorTexture);
+			glDeleteTextures(1, &colorTexture);
+		}
+		if (colorRenderbuffer)
+			glDeleteRenderbuffers(1, &colorRenderbuffer);
+		if (depthRenderbuffer)
+			glDeleteRenderbuffers(1, &depthRenderbuffer);
+		framebuffer = 0;
+		colorRenderbuffer = 0;
+		colorTexture = 0;
+		depthRenderbuffer = 0;
+	}
+
+	GLuint RenderTarget::GetFramebuffer()
+	{
+		return framebuffer;
+	}
+
+	GLuint RenderTarget::GetColorTexture()
+	{
+		return colorTexture;
+	}
+
+	int RenderTarget::GetWidth()
+	{
+		return width;
+	}
+
+	int RenderTarget::GetHeight()
+	{
+		return height;
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef RenderTarget_hpp
+#define RenderTarget_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    // Offscreen colour + depth framebuffer standing in for the window's default framebuffer
+    // With sampledColor the colour is a linearly filtered texture that later passes can read
+    class RenderTarget
+    {
+    public:
+        RenderTarget();
+
+        bool Create(int width, int height, bool sampledColor = false);
+        void Destroy();
+
+        GLuint GetFramebuffer();
+        // 0 unless created with sampledColor
+        GLuint GetColorTexture();
+        int GetWidth();
+        int GetHeight();
+
+    private:
+        GLuint framebuffer;
+        GLuint colorRenderbuffer;
+        GLuint colorTexture;
+        GLuint depthRenderbuffer;
+        int width;
+        int height;
+    };
+}
+
+#endif /* RenderTarget_hpp */
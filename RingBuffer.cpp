@@ -0,0 +1,187 @@
+#include "RingBuffer.hpp"
+#include "GpuMemory.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	RingBuffer::RingBuffer()
+	{
+		this->target = GL_ARRAY_BUFFER;
+		this->buffer = 0;
+		this->partitionSize = 0;
+		this->partitionCount = 0;
+		this->currentPartition = 0;
+		this->partitionUsed = 0;
+		this->persistent = false;
+		this->mappedPointer = NULL;
+	}
+
+	void RingBuffer::Create(GLenum target, GLsizeiptr partitionSize, int partitionCount, const std::string& label)
+	{
+		this->target = target;
+		this->label = label;
+		// keep every partition start aligned for texel and uniform block offsets
+		this->partitionSize = (partitionSize + 255) & ~(GLsizeiptr)255;
+		this->partitionCount = partitionCount;
+		this->currentPartition = partitionCount - 1;
+		this->persistent = GLEW_ARB_buffer_storage ? true : false;
+		this->fences.assign(partitionCount, (GLsync)0);
+
+		CreateStorage();
+		printf("Ring buffer: %d x %ld bytes, %s\n", partitionCount, (long)this->partitionSize,
+			persistent ? "persistently mapped" : "mapped per frame");
+	}
+
+	void RingBuffer::CreateStorage()
+	{
+		GLsizeiptr totalSize = partitionSize * partitionCount;
+
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		if (persistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, totalSize, NULL, flags);
+			mappedPointer = (unsigned char*)glMapBufferRange(target, 0, totalSize, flags);
+		}
+		else {
+			glBufferData(target, totalSize, NULL, GL_STREAM_DRAW);
+			mappedPointer = NULL;
+		}
+		glBindBuffer(target, 0);
+		GpuMemory::Track(GL_BUFFER, buffer, GPU_MEMORY_STREAMING_BUFFER, totalSize, "ring buffers", label);
+	}
+
+	void RingBuffer::Destroy()
+	{
+		DeleteFences();
+		if (buffer) {
+			GpuMemory::Release(GL_BUFFER, buffer);
+			if (persistent) {
+				glBindBuffer(target, buffer);
+				glUnmapBuffer(target);
+				glBindBuffer(target, 0);
+			}
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = 0;
+		mappedPointer = NULL;
+	}
+
+	bool RingBuffer::BeginFrame(GLsizeiptr requiredSize)
+	{
+		bool grew = false;
+		if (requiredSize > partitionSize) {
+			// grow - every partition has to be idle before the storage is replaced
+			for (int i = 0; i < partitionCount; i++)
+				WaitForFence(i);
+			// the storage is replaced (GL may hand the same name back); the caller re-attaches on the return value
+			Destroy();
+			partitionSize = (requiredSize * 2 + 255) & ~(GLsizeiptr)255;
+			CreateStorage();
+			fences.assign(partitionCount, (GLsync)0);
+			printf("Ring buffer: grew to %d x %ld bytes\n", partitionCount, (long)partitionSize);
+			grew = true;
+		}
+
+		currentPartition = (currentPartition + 1) % partitionCount;
+		partitionUsed = 0;
+
+		if (persistent) {
+			WaitForFence(currentPartition);
+			return grew;
+		}
+
+		glBindBuffer(target, buffer);
+		GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+		GLsync fence = fences[currentPartition];
+		if (fence && glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			// still in use - orphan the storage rather than wait; commands in flight keep the old one
+			glBufferData(target, partitionSize * partitionCount, NULL, GL_STREAM_DRAW);
+			DeleteFences();
+			fences.assign(partitionCount, (GLsync)0);
+		}
+		else if (fence) {
+			glDeleteSync(fence);
+			fences[currentPartition] = 0;
+		}
+		mappedPointer = (unsigned char*)glMapBufferRange(target, currentPartition * partitionSize, partitionSize, mapFlags);
+		glBindBuffer(target, 0);
+		return grew;
+	}
+
+	GLintptr RingBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment, void** pointer)
+	{
+		if (alignment > 1)
+			partitionUsed = (partitionUsed + alignment - 1) / alignment * alignment;
+		if (partitionUsed + size > partitionSize) {
+			fprintf(stderr, "ERROR: ring buffer partition overflow (%ld of %ld bytes)\n", (long)(partitionUsed + size), (long)partitionSize);
+			*pointer = NULL;
+			return -1;
+		}
+
+		GLintptr offset = currentPartition * partitionSize + partitionUsed;
+		if (persistent)
+			*pointer = mappedPointer + offset;
+		else
+			*pointer = mappedPointer + partitionUsed;
+		partitionUsed += size;
+		return offset;
+	}
+
+	void RingBuffer::FinishWrites()
+	{
+		// coherent persistent mappings need nothing; the per-frame mapping must be released before drawing
+		if (!persistent && mappedPointer) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			glBindBuffer(target, 0);
+			mappedPointer = NULL;
+		}
+	}
+
+	void RingBuffer::EndFrame()
+	{
+		FinishWrites();
+		if (fences[currentPartition])
+			glDeleteSync(fences[currentPartition]);
+		fences[currentPartition] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	GLuint RingBuffer::GetBuffer()
+	{
+		return buffer;
+	}
+
+	bool RingBuffer::IsPersistent()
+	{
+		return persistent;
+	}
+
+	void RingBuffer::WaitForFence(int partition)
+	{
+		GLsync fence = fences[partition];
+		if (!fence)
+			return;
+
+		// flush once, then keep waiting in short slices
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (true) {
+			GLenum result = glClientWaitSync(fence, flags, 1000000);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+				break;
+			flags = 0;
+		}
+		glDeleteSync(fence);
+		fences[partition] = 0;
+	}
+
+	void RingBuffer::DeleteFences()
+	{
+		for (size_t i = 0; i < fences.size(); i++) {
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+}
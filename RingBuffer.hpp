@@ -0,0 +1,59 @@
+#ifndef RingBuffer_hpp
+#define RingBuffer_hpp
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Streaming buffer split into one partition per frame in flight
+    // Uses a persistently mapped ARB_buffer_storage allocation when available, otherwise maps each
+    // partition with glMapBufferRange and orphans the storage instead of stalling on the GPU
+    class RingBuffer
+    {
+    public:
+        RingBuffer();
+
+        // label names the buffer in GPU memory reports and debuggers
+        void Create(GLenum target, GLsizeiptr partitionSize, int partitionCount = 3, const std::string& label = "ring buffer");
+        void Destroy();
+
+        // Waits until the GPU is done with the next partition, growing it if `requiredSize` doesn't fit
+        // Returns true when it grew: the storage was replaced and anything attached to it must be
+        // re-attached, even if GetBuffer() hands back the same (recycled) name
+        bool BeginFrame(GLsizeiptr requiredSize);
+
+        // Bump-allocates from the current partition; returns the offset from the start of the buffer
+        GLintptr Allocate(GLsizeiptr size, GLsizeiptr alignment, void** pointer);
+
+        // Makes the CPU writes visible to the GPU; call before issuing draws that read them
+        void FinishWrites();
+
+        // Fences the partition so it's not overwritten while this frame is in flight
+        void EndFrame();
+
+        GLuint GetBuffer();
+        bool IsPersistent();
+
+    private:
+        GLenum target;
+        GLuint buffer;
+        GLsizeiptr partitionSize;
+        int partitionCount;
+        int currentPartition;
+        GLsizeiptr partitionUsed;
+        bool persistent;
+        // whole-buffer mapping when persistent, the current partition's mapping otherwise
+        unsigned char* mappedPointer;
+        std::string label;
+        std::vector<GLsync> fences;
+
+        void CreateStorage();
+        void WaitForFence(int partition);
+        void DeleteFences();
+    };
+}
+
+#endif /* RingBuffer_hpp */
@@ -1,4 +1,10 @@
 #include "Shader.hpp"
+#include "AssetArchive.hpp"
+#include "RenderStats.hpp"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 namespace gps {
     std::string Shader::readShaderFile(std::string fileName)
@@ -6,6 +12,11 @@ namespace gps {
         std::ifstream shaderFile;
         std::string shaderString;
 
+        const unsigned char* data;
+        size_t size;
+        if (AssetArchive::Find(fileName, &data, &size))
+            return std::string((const char*)data, size);
+
         //open shader file
         shaderFile.open(fileName.c_str());
 
@@ -49,42 +60,88 @@ namespace gps {
         }
     }
 
+    GLuint Shader::compileStage(GLenum type, const std::string& source, const std::string& defines)
+    {
+        //the defines have to follow the #version line; #line keeps the error messages on the file's numbering
+        std::string header;
+        std::string body = source;
+        if (source.compare(0, 8, "#version") == 0) {
+            size_t lineEnd = source.find('\n');
+            header = source.substr(0, lineEnd == std::string::npos ? source.size() : lineEnd + 1);
+            body = lineEnd == std::string::npos ? std::string() : source.substr(lineEnd + 1);
+            if (lineEnd == std::string::npos)
+                header += "\n";
+        }
+        if (!defines.empty())
+            header += defines + (header.empty() ? "#line 1\n" : "#line 2\n");
+
+        const GLchar* strings[] = { header.c_str(), body.c_str() };
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 2, strings, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-
-        //attach and link the shader programs
+        loadShader(vertexShaderFileName, fragmentShaderFileName, std::string());
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines)
+    {
+        beginLoadShader(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
+    }
+
+    void Shader::beginLoadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines)
+    {
+        //read and compile both stages; nothing here waits for the compiler
+        GLuint vertexShader = compileStage(GL_VERTEX_SHADER, readShaderFile(vertexShaderFileName), defines);
+        GLuint fragmentShader = compileStage(GL_FRAGMENT_SHADER, readShaderFile(fragmentShaderFileName), defines);
+
+        //attach and link the shader programs; the stages stay attached until finishLoad has read their logs
         this->shaderProgram = glCreateProgram();
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
         glLinkProgram(this->shaderProgram);
         glDeleteShader(vertexShader);
         glDeleteShader(fragmentShader);
-        //check linking info
+    }
+
+    bool Shader::isReady()
+    {
+        if (!parallelCompileSupported())
+            return true;
+        GLint complete = GL_TRUE;
+        glGetProgramiv(this->shaderProgram, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    void Shader::finishLoad()
+    {
+        //check compilation status, then linking info - the first query waits for the compiler if it is still busy
+        GLuint stages[2];
+        GLsizei stageCount = 0;
+        glGetAttachedShaders(this->shaderProgram, 2, &stageCount, stages);
+        for (GLsizei i = 0; i < stageCount; i++) {
+            shaderCompileLog(stages[i]);
+            //detaching frees the stages, they were flagged for deletion after the link
+            glDetachShader(this->shaderProgram, stages[i]);
+        }
         shaderLinkLog(this->shaderProgram);
     }
 
+    bool Shader::parallelCompileSupported()
+    {
+        static int supported = -1;
+        if (supported < 0)
+            supported = glewIsSupported("GL_KHR_parallel_shader_compile") || glewIsSupported("GL_ARB_parallel_shader_compile");
+        return supported != 0;
+    }
+
     void Shader::useShaderProgram()
     {
-        glUseProgram(this->shaderProgram);
+        gl::UseProgram(this->shaderProgram);
     }
 
 }
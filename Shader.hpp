@@ -16,10 +16,22 @@ class Shader
 public:
     GLuint shaderProgram;
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+    // defines are inserted after the #version line of both stages, e.g. "#define FOG\n"
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines);
     void useShaderProgram();
 
+    // Starts compiling and linking without waiting for the result; with KHR_parallel_shader_compile the
+    // driver does the work on its own threads until isReady. finishLoad reports any errors
+    void beginLoadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string defines);
+    bool isReady();
+    void finishLoad();
+
+    // Whether the driver compiles in the background; needs a current context
+    static bool parallelCompileSupported();
+
 private:
     std::string readShaderFile(std::string fileName);
+    GLuint compileStage(GLenum type, const std::string& source, const std::string& defines);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
 };
@@ -0,0 +1,70 @@
+#include "ShaderVariants.hpp"
+#include "Profiler.hpp"
+
+#include <cstdio>
+
+namespace gps {
+
+	static const char* FEATURE_NAMES[SHADER_FEATURE_COUNT] = { "SHADOWS", "FOG", "SPOT_LIGHT", "CLUSTERED_LIGHTS" };
+
+	ShaderVariants::ShaderVariants()
+	{
+	}
+
+	void ShaderVariants::Create(const std::string& vertexFileName, const std::string& fragmentFileName,
+		const std::string& defines)
+	{
+		Destroy();
+		this->vertexFileName = vertexFileName;
+		this->fragmentFileName = fragmentFileName;
+		this->defines = defines;
+	}
+
+	void ShaderVariants::Destroy()
+	{
+		for (std::unordered_map<unsigned int, Variant>::iterator it = variants.begin(); it != variants.end(); ++it)
+			glDeleteProgram(it->second.shader.shaderProgram);
+		variants.clear();
+	}
+
+	ShaderVariants::Variant& ShaderVariants::Begin(unsigned int features)
+	{
+		std::string defines = this->defines;
+		std::string names;
+		for (int bit = 0; bit < SHADER_FEATURE_COUNT; bit++) {
+			if (features & (1u << bit)) {
+				defines += std::string("#define ") + FEATURE_NAMES[bit] + "\n";
+				names += std::string(names.empty() ? "" : " ") + FEATURE_NAMES[bit];
+			}
+		}
+		printf("Compiling %s variant: %s\n", fragmentFileName.c_str(), names.empty() ? "no features" : names.c_str());
+
+		Variant& variant = variants[features];
+		variant.shader.beginLoadShader(vertexFileName, fragmentFileName, defines);
+		variant.linked = false;
+		return variant;
+	}
+
+	gps::Shader& ShaderVariants::Get(unsigned int features)
+	{
+		std::unordered_map<unsigned int, Variant>::iterator it = variants.find(features);
+		Variant& variant = it != variants.end() ? it->second : Begin(features);
+		if (!variant.linked) {
+			PROFILE_ZONE("LinkShaderVariant");
+			variant.shader.finishLoad();
+			variant.linked = true;
+		}
+		return variant.shader;
+	}
+
+	void ShaderVariants::Prefetch(unsigned int features)
+	{
+		if (Shader::parallelCompileSupported() && variants.find(features) == variants.end())
+			Begin(features);
+	}
+
+	int ShaderVariants::GetVariantCount()
+	{
+		return (int)variants.size();
+	}
+}
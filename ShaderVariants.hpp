@@ -0,0 +1,65 @@
+#ifndef ShaderVariants_hpp
+#define ShaderVariants_hpp
+
+#include <GL/glew.h>
+
+#include "Shader.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace gps {
+
+    // Optional parts of the lighting shaders; a variant is the bitwise or of the features it keeps
+    // Each kept feature is #defined under its name without the prefix, e.g. FOG
+    enum SHADER_FEATURE {
+        SHADER_FEATURE_SHADOWS = 1 << 0,
+        SHADER_FEATURE_FOG = 1 << 1,
+        SHADER_FEATURE_SPOT_LIGHT = 1 << 2,
+        SHADER_FEATURE_CLUSTERED_LIGHTS = 1 << 3
+    };
+
+    const int SHADER_FEATURE_COUNT = 4;
+
+    // Permutations of one vertex/fragment pair specialized through #defines, so a disabled feature is not
+    // in the program at all; each is compiled the first time it is asked for and then kept
+    // GL thread only
+    class ShaderVariants
+    {
+    public:
+        ShaderVariants();
+
+        // Remembers the files; nothing is compiled yet
+        // defines are given to every variant ahead of its features
+        void Create(const std::string& vertexFileName, const std::string& fragmentFileName,
+            const std::string& defines = std::string());
+        void Destroy();
+
+        // The variant with exactly these features, compiled now if it was never requested; waits for a
+        // variant Prefetch started
+        gps::Shader& Get(unsigned int features);
+
+        // Starts compiling a variant that is likely to be asked for soon, so switching to it does not stall
+        // Does nothing without KHR_parallel_shader_compile, where compiling early would stall just the same
+        void Prefetch(unsigned int features);
+
+        int GetVariantCount();
+
+    private:
+        struct Variant
+        {
+            gps::Shader shader;
+            // false until finishLoad has run
+            bool linked;
+        };
+
+        std::string vertexFileName;
+        std::string fragmentFileName;
+        std::string defines;
+        std::unordered_map<unsigned int, Variant> variants;
+
+        Variant& Begin(unsigned int features);
+    };
+}
+
+#endif /* ShaderVariants_hpp */
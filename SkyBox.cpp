@@ -7,6 +7,9 @@
 //
 
 #include "SkyBox.hpp"
+#include "AssetArchive.hpp"
+#include "RenderStats.hpp"
+#include "GpuMemory.hpp"
 
 namespace gps {
     
@@ -27,17 +30,17 @@ namespace gps {
         
         //set the view and projection matrices
         glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        gl::UniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
+        gl::UniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
         
         glDepthFunc(GL_LEQUAL);
         
-        glBindVertexArray(skyboxVAO);
+        gl::BindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
+        gl::BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        gl::DrawArrays(GL_TRIANGLES, 0, 36);
+        gl::BindVertexArray(0);
         
         glDepthFunc(GL_LESS);
     }
@@ -50,12 +53,17 @@ namespace gps {
         
         int width,height, n;
         unsigned char* image;
+        const unsigned char* data;
+        size_t size;
         int force_channels = 3;
         
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
+            if (AssetArchive::Find(skyBoxFaces[i], &data, &size))
+                image = stbi_load_from_memory(data, (int)size, &width, &height, &n, force_channels);
+            else
+                image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
             if (!image) {
                 fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
                 return false;
@@ -64,6 +72,7 @@ namespace gps {
                          GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
                          GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
                          );
+            stbi_image_free(image);
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -72,6 +81,10 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         
+        // six faces, RGB8 padded to four bytes per texel
+        GpuMemory::Track(GL_TEXTURE, textureID, GPU_MEMORY_TEXTURE,
+            GpuMemory::TextureBytes(width, height, 4, false, 6), "skybox", "cubemap");
+        
         return textureID;
     }
     
@@ -127,6 +140,7 @@ namespace gps {
         glBindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+        GpuMemory::Track(GL_BUFFER, skyboxVBO, GPU_MEMORY_VERTEX_BUFFER, sizeof(skyboxVertices), "skybox", "cube vertices");
         
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
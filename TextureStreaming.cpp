@@ -0,0 +1,314 @@
+#include "TextureStreaming.hpp"
+#include "Model3D.hpp"
+#include "GpuMemory.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+
+namespace gps {
+
+	static const int NO_REQUEST = INT_MAX;
+
+	TextureStreaming::StreamedTexture TextureStreaming::slots[TextureStreaming::MAX_TEXTURES];
+	std::atomic<int> TextureStreaming::requests[TextureStreaming::MAX_TEXTURES];
+	size_t TextureStreaming::budget = 0;
+	size_t TextureStreaming::residentBytes = 0;
+	uint64_t TextureStreaming::frame = 0;
+	uint64_t TextureStreaming::levelsUploaded = 0;
+	uint64_t TextureStreaming::levelsEvicted = 0;
+
+	// sRGB <-> linear, the same curve GL_SRGB decodes with
+	struct SrgbTables
+	{
+		float toLinear[256];
+		unsigned char fromLinear[4096];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++) {
+				float l = i / 4095.0f;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	static const SrgbTables& GetSrgbTables()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	void TextureStreaming::SetBudget(size_t bytes)
+	{
+		budget = bytes;
+	}
+
+	size_t TextureStreaming::GetBudget()
+	{
+		return budget;
+	}
+
+	bool TextureStreaming::IsEnabled()
+	{
+		return budget > 0;
+	}
+
+	void TextureStreaming::BuildMipChain(ImageData& image)
+	{
+		PROFILE_ZONE("BuildMipChain");
+		if (!image.pixels)
+			return;
+
+		const SrgbTables& srgb = GetSrgbTables();
+		size_t chainBytes = GpuMemory::TextureBytes(image.width, image.height, 4, true);
+		image.mipChain.resize(chainBytes);
+		std::copy(image.pixels, image.pixels + (size_t)image.width * image.height * 4, image.mipChain.begin());
+
+		int width = image.width;
+		int height = image.height;
+		size_t offset = 0;
+		while (width > 1 || height > 1) {
+			const unsigned char* source = &image.mipChain[offset];
+			offset += (size_t)width * height * 4;
+			unsigned char* target = &image.mipChain[offset];
+			int targetWidth = std::max(width / 2, 1);
+			int targetHeight = std::max(height / 2, 1);
+			for (int y = 0; y < targetHeight; y++) {
+				int y0 = std::min(y * 2, height - 1);
+				int y1 = std::min(y * 2 + 1, height - 1);
+				for (int x = 0; x < targetWidth; x++) {
+					int x0 = std::min(x * 2, width - 1);
+					int x1 = std::min(x * 2 + 1, width - 1);
+					const unsigned char* texels[4] = {
+						source + ((size_t)y0 * width + x0) * 4, source + ((size_t)y0 * width + x1) * 4,
+						source + ((size_t)y1 * width + x0) * 4, source + ((size_t)y1 * width + x1) * 4
+					};
+					unsigned char* out = target + ((size_t)y * targetWidth + x) * 4;
+					for (int c = 0; c < 3; c++) {
+						float sum = srgb.toLinear[texels[0][c]] + srgb.toLinear[texels[1][c]] + srgb.toLinear[texels[2][c]] + srgb.toLinear[texels[3][c]];
+						out[c] = srgb.fromLinear[(int)(sum * 0.25f * 4095.0f + 0.5f)];
+					}
+					out[3] = (unsigned char)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+				}
+			}
+			width = targetWidth;
+			height = targetHeight;
+		}
+	}
+
+	int TextureStreaming::Create(ImageData& image, const std::string& owner, GLuint* texture)
+	{
+		*texture = 0;
+		if (image.mipChain.empty())
+			return -1;
+		int slot = 0;
+		while (slot < MAX_TEXTURES && slots[slot].used)
+			slot++;
+		if (slot == MAX_TEXTURES) {
+			fprintf(stderr, "WARNING: no texture streaming slot left for %s\n", image.path.c_str());
+			return -1;
+		}
+
+		StreamedTexture& streamed = slots[slot];
+		streamed.used = true;
+		streamed.owner = owner;
+		streamed.label = image.path;
+		streamed.width = image.width;
+		streamed.height = image.height;
+		streamed.pixels = std::move(image.mipChain);
+		streamed.levelOffsets.clear();
+		size_t offset = 0;
+		int width = image.width;
+		int height = image.height;
+		streamed.tailLevel = -1;
+		for (int level = 0; ; level++) {
+			streamed.levelOffsets.push_back(offset);
+			offset += (size_t)width * height * 4;
+			if (streamed.tailLevel < 0 && std::max(width, height) <= TAIL_SIZE)
+				streamed.tailLevel = level;
+			if (width == 1 && height == 1)
+				break;
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		streamed.levelCount = (int)streamed.levelOffsets.size();
+
+		glGenTextures(1, &streamed.texture);
+		glBindTexture(GL_TEXTURE_2D, streamed.texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, streamed.levelCount - 1);
+		for (int level = streamed.levelCount - 1; level >= streamed.tailLevel; level--)
+			UploadLevel(streamed, level);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		streamed.wantedLevel = streamed.tailLevel;
+		streamed.lastRequested = frame;
+		requests[slot] = NO_REQUEST;
+		*texture = streamed.texture;
+		return slot;
+	}
+
+	void TextureStreaming::Destroy(int slot)
+	{
+		if (slot < 0 || slot >= MAX_TEXTURES || !slots[slot].used)
+			return;
+		StreamedTexture& streamed = slots[slot];
+		for (int level = streamed.residentLevel; level < streamed.levelCount; level++)
+			residentBytes -= LevelBytes(streamed, level);
+		GpuMemory::Release(GL_TEXTURE, streamed.texture);
+		glDeleteTextures(1, &streamed.texture);
+		streamed.used = false;
+		streamed.texture = 0;
+		streamed.pixels = std::vector<unsigned char>();
+		streamed.levelOffsets.clear();
+	}
+
+	void TextureStreaming::Request(int slot, float uvPerPixel)
+	{
+		const StreamedTexture& streamed = slots[slot];
+		float texelsPerPixel = uvPerPixel * std::max(streamed.width, streamed.height);
+		int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+		int current = requests[slot].load(std::memory_order_relaxed);
+		while (level < current && !requests[slot].compare_exchange_weak(current, level, std::memory_order_relaxed))
+			;
+	}
+
+	void TextureStreaming::Update()
+	{
+		if (!IsEnabled())
+			return;
+		PROFILE_ZONE("TextureStreaming");
+		frame++;
+
+		// textures nobody asked for only keep their finer levels while there is room for them
+		std::vector<int> candidates;
+		for (int slot = 0; slot < MAX_TEXTURES; slot++) {
+			StreamedTexture& streamed = slots[slot];
+			if (!streamed.used)
+				continue;
+			int requested = requests[slot].exchange(NO_REQUEST, std::memory_order_relaxed);
+			if (requested != NO_REQUEST) {
+				streamed.wantedLevel = std::min(requested, streamed.tailLevel);
+				streamed.lastRequested = frame;
+			}
+			else
+				streamed.wantedLevel = streamed.tailLevel;
+			if (streamed.residentLevel > streamed.wantedLevel)
+				candidates.push_back(slot);
+		}
+
+		// the blurriest first, then the most recently asked for
+		std::sort(candidates.begin(), candidates.end(), [](int a, int b) {
+			int missingA = slots[a].residentLevel - slots[a].wantedLevel;
+			int missingB = slots[b].residentLevel - slots[b].wantedLevel;
+			if (missingA != missingB)
+				return missingA > missingB;
+			return slots[a].lastRequested > slots[b].lastRequested;
+		});
+
+		size_t uploadedBytes = 0;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			StreamedTexture& streamed = slots[candidates[c]];
+			int level = streamed.residentLevel - 1;
+			size_t bytes = LevelBytes(streamed, level);
+			if (uploadedBytes > 0 && uploadedBytes + bytes > UPLOAD_BYTES_PER_FRAME)
+				break;
+
+			// make room from the levels their textures no longer need, least recently asked for first
+			while (residentBytes + bytes > budget) {
+				int victim = -1;
+				for (int slot = 0; slot < MAX_TEXTURES; slot++) {
+					const StreamedTexture& other = slots[slot];
+					if (other.used && other.residentLevel < other.wantedLevel &&
+						(victim < 0 || other.lastRequested < slots[victim].lastRequested))
+						victim = slot;
+				}
+				if (victim < 0)
+					break;
+				EvictLevel(slots[victim]);
+			}
+			if (residentBytes + bytes > budget)
+				continue;
+
+			glBindTexture(GL_TEXTURE_2D, streamed.texture);
+			UploadLevel(streamed, level);
+			uploadedBytes += bytes;
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	size_t TextureStreaming::GetResidentBytes()
+	{
+		return residentBytes;
+	}
+
+	void TextureStreaming::PrintSummary()
+	{
+		if (!IsEnabled())
+			return;
+		size_t textureCount = 0;
+		size_t chainBytes = 0;
+		for (int slot = 0; slot < MAX_TEXTURES; slot++) {
+			if (slots[slot].used) {
+				textureCount++;
+				chainBytes += slots[slot].pixels.size();
+			}
+		}
+		printf("Texture streaming: %zu textures, %.1f of %.1f MB resident (%.1f MB with every level), %llu levels uploaded, %llu evicted\n",
+			textureCount, residentBytes / (1024.0 * 1024.0), budget / (1024.0 * 1024.0), chainBytes / (1024.0 * 1024.0),
+			(unsigned long long)levelsUploaded, (unsigned long long)levelsEvicted);
+	}
+
+	size_t TextureStreaming::LevelBytes(const StreamedTexture& texture, int level)
+	{
+		size_t end = level + 1 < texture.levelCount ? texture.levelOffsets[level + 1] : texture.pixels.size();
+		return end - texture.levelOffsets[level];
+	}
+
+	// The texture must be bound; level is the one above the finest resident level
+	void TextureStreaming::UploadLevel(StreamedTexture& texture, int level)
+	{
+		int width = std::max(texture.width >> level, 1);
+		int height = std::max(texture.height >> level, 1);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texture.pixels[texture.levelOffsets[level]]);
+		residentBytes += LevelBytes(texture, level);
+		if (level < texture.tailLevel)
+			levelsUploaded++;
+		SetResidentLevel(texture, level);
+	}
+
+	// Drops the finest resident level; the clamp moves first so the texture never samples the freed level
+	void TextureStreaming::EvictLevel(StreamedTexture& texture)
+	{
+		int level = texture.residentLevel;
+		glBindTexture(GL_TEXTURE_2D, texture.texture);
+		SetResidentLevel(texture, level + 1);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		residentBytes -= LevelBytes(texture, level);
+		levelsEvicted++;
+	}
+
+	void TextureStreaming::SetResidentLevel(StreamedTexture& texture, int level)
+	{
+		texture.residentLevel = level;
+		// the level of detail is measured from the base level and lands on the same absolute level Request
+		// asked for; a MIN_LOD clamp on top would add to the base and skip that many levels more
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+		size_t bytes = 0;
+		for (int l = level; l < texture.levelCount; l++)
+			bytes += LevelBytes(texture, l);
+		GpuMemory::Track(GL_TEXTURE, texture.texture, GPU_MEMORY_TEXTURE, bytes, texture.owner, texture.label);
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef TextureStreaming_hpp
+#define TextureStreaming_hpp
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct ImageData;
+
+    // Mip-level residency of the model textures under a video memory budget
+    // Every mip chain stays in system memory. Only the coarse tail of each texture is always resident; the finer
+    // levels are uploaded when the draws ask for them, and the ones nobody asked for last are evicted first when
+    // the budget runs out. GL_TEXTURE_BASE_LEVEL follows the finest resident level, so a texture always samples
+    // complete, just blurrier while its levels arrive
+    class TextureStreaming
+    {
+    public:
+        static const int MAX_TEXTURES = 4096;
+        // levels this size or smaller are uploaded with the texture and never evicted
+        static const int TAIL_SIZE = 64;
+        // finer levels uploaded per frame, at least one
+        static const size_t UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+        // 0 turns streaming off and the textures are created with their whole chain; set before any model loads
+        static void SetBudget(size_t bytes);
+        static size_t GetBudget();
+        static bool IsEnabled();
+
+        // Any thread: fills image.mipChain with every level of image.pixels, box filtered in linear space
+        static void BuildMipChain(ImageData& image);
+
+        // GL thread: creates the texture with only its tail resident and takes over the chain
+        // Returns the slot, -1 when every slot is taken and the caller should upload the texture whole
+        static int Create(ImageData& image, const std::string& owner, GLuint* texture);
+        static void Destroy(int slot);
+
+        // Any thread: asks for the level where one texel covers one pixel; uvPerPixel is the texture coordinate
+        // distance one pixel spans on the nearest part of the surface
+        static void Request(int slot, float uvPerPixel);
+
+        // GL thread, once per frame: uploads and evicts levels for the requests made since the last call
+        static void Update();
+
+        static size_t GetResidentBytes();
+        static void PrintSummary();
+
+    private:
+        struct StreamedTexture
+        {
+            bool used;
+            GLuint texture;
+            std::string owner;
+            std::string label;
+            int width;
+            int height;
+            int levelCount;
+            // the whole chain, finest level first
+            std::vector<unsigned char> pixels;
+            std::vector<size_t> levelOffsets;
+            int tailLevel;
+            int residentLevel;
+            int wantedLevel;
+            uint64_t lastRequested;
+        };
+
+        static StreamedTexture slots[MAX_TEXTURES];
+        // finest level asked for since the last Update, NO_REQUEST when none
+        static std::atomic<int> requests[MAX_TEXTURES];
+        static size_t budget;
+        static size_t residentBytes;
+        static uint64_t frame;
+        static uint64_t levelsUploaded;
+        static uint64_t levelsEvicted;
+
+        static size_t LevelBytes(const StreamedTexture& texture, int level);
+        static void UploadLevel(StreamedTexture& texture, int level);
+        static void EvictLevel(StreamedTexture& texture);
+        static void SetResidentLevel(StreamedTexture& texture, int level);
+    };
+}
+
+#endif /* TextureStreaming_hpp */
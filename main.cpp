@@ -12,8 +12,36 @@
 #include "Camera.hpp"
 #include "Window.h"
 #include "SkyBox.hpp"
-
+#include "JobSystem.hpp"
+#include "FramePacket.hpp"
+#include "RingBuffer.hpp"
+#include "GpuTimer.hpp"
+#include "Profiler.hpp"
+#include "HeadlessContext.hpp"
+#include "RenderTarget.hpp"
+#include "Benchmark.hpp"
+#include "InputRecording.hpp"
+#include "CameraSpline.hpp"
+#include "RenderStats.hpp"
+#include "GpuMemory.hpp"
+#include "Impostor.hpp"
+#include "Meshlets.hpp"
+#include "ClusteredLights.hpp"
+#include "OverdrawMeter.hpp"
+#include "GBuffer.hpp"
+#include "FrameGovernor.hpp"
+#include "ShaderVariants.hpp"
+#include "AssetArchive.hpp"
+#include "TextureStreaming.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
 
 //window
 int glWindowWidth = 800;
@@ -22,28 +50,76 @@ int retina_width, retina_height;
 GLFWwindow* glWindow = NULL;
 
 //constants
-const unsigned int SHADOW_WIDTH = 2048;
-const unsigned int SHADOW_HEIGHT = 2048;
+// render thread: the shadow map is reallocated when the governor picks another size
+const int MAX_SHADOW_MAP_SIZE = 2048;
+int shadowMapSize = 0;
+// --no-shadows skips the shadow pass and compiles the lookup out of the lit shaders
+bool shadowsEnabled = true;
 
 //vectors
 std::vector<const GLchar*> faces;
 
+//jobs
+gps::JobSystem jobSystem;
+
+//render thread - owns the GL context and draws the packets built by the main thread
+gps::FramePacketQueue framePackets(2);
+std::thread renderThread;
+uint64_t frameIndex = 0;
+
 //matrices
-glm::mat4 model;
-GLuint modelLoc;
 glm::mat4 view;
-GLuint viewLoc;
 glm::mat4 projection;
-GLuint projectionLoc;
-glm::mat3 normalMatrix;
-GLuint normalMatrixLoc;
 glm::mat4 lightRotation;
 
+//per-draw data - model and normal matrices streamed through a ring buffer, read as a texture buffer
+gps::RingBuffer drawDataRing;
+GLuint drawDataTexture;
+const int DRAW_DATA_TEXTURE_UNIT = 4;
+
+//gpu pass timings, owned by the render thread
+gps::GpuTimer gpuTimer;
+std::atomic<bool> printGpuTimings(false);
+const char* gpuTimerLogFile = NULL;
+
+//profiler
+const char* profilerTraceFile = NULL;
+
+//render statistics
+const char* renderStatsFile = NULL;
+const char* renderStatsFrameLogFile = NULL;
+
+//headless benchmark
+bool benchMode = false;
+int benchFrames = 600;
+int benchWarmupFrames = 60;
+const char* benchReportFile = "bench.json";
+gps::HeadlessContext headlessContext;
+gps::RenderTarget benchTarget;
+gps::Benchmark benchmark;
+//the framebuffer the scene ends up in: the window's, or the offscreen bench target
+GLuint sceneFramebuffer = 0;
+
+//asset archive: mounted when present, the loose files are the fallback for anything it does not hold
+const char* archiveFile = "assets.pak";
+bool archiveRequired = false;
+const char* packArchiveFile = NULL;
+
+//input recording and replay, in fixed simulation ticks (one per frame packet)
+uint32_t simulationTick = 0;
+gps::InputRecording inputRecording;
+const char* recordFile = NULL;
+bool recordPoses = false;
+bool replaying = false;
+size_t replayEventIndex = 0;
+
+//authored camera path, advanced a fixed distance per tick
+gps::CameraSpline cameraSpline;
+float cameraSplineSpeed = 0.1f;
+
 //light parameters
 glm::vec3 lightDir;
 glm::vec3 lightColor;
-GLuint lightDirLoc;
-GLuint lightColorLoc;
 
 //camera
 gps::Camera myCamera(
@@ -63,13 +139,107 @@ gps::Model3D screenQuad;
 gps::Model3D racoon;
 gps::Model3D scarecrow;
 gps::Model3D tree;
+// the big models stream in after the first frame: the loader thread parses them nearest to the camera first,
+// the render thread uploads one per frame, and until then they are drawn as their bounding box
+struct StreamedModel {
+	gps::Model3D* model;
+	const char* fileName;
+	const char* basePath;
+	// where buildDrawList places the model, before the scene rotation
+	glm::vec3 position;
+};
+bool streamingLoads = true;
+std::vector<StreamedModel> streamedModels;
+std::thread loaderThread;
+std::atomic<bool> stopLoading(false);
+// camera of the latest tick in scene space, for the loader thread's priorities
+std::mutex streamingCameraMutex;
+glm::vec3 streamingCameraPosition;
+// render thread only
+bool allModelsReady = false;
+bool firstFramePresented = false;
+std::chrono::steady_clock::time_point startTime;
+// upload the models as gps::Vertex instead of the packed format, for comparisons
+bool floatVertices = false;
+// levels of detail generated per mesh at load, 1 turns simplification off
+int lodCount = 4;
+gps::LodSettings lodSettings;
+// meshlet frustum and backface culling for the main pass
+bool clusterCulling = true;
+// position-only vertex stream for the shadow pass and the depth pre-pass
+gps::DEPTH_STREAM depthStream = gps::DEPTH_STREAM_WELDED;
+// video memory the model textures may stream their finer mip levels into, 0 keeps them all resident
+double textureBudgetMegabytes = 256.0;
+// model textures up to this size share one texture array per type, 0 binds every texture on its own
+int textureArrayMaxSize = 512;
+// when ARB_bindless_texture is there, the lit shaders read resident texture handles from a material table per model
+// instead of the meshes binding units; --no-bindless turns it off. It covers the non-streamed textures and the
+// texture arrays only: a texture under the streaming budget keeps its unit, a handle would freeze its mip levels
+bool bindlessTextures = true;
+
+// trees covering fewer pixels than a baked impostor frame are drawn as one quad
+bool impostorsEnabled = true;
+float impostorSize = 96.0f;
+gps::Impostor treeImpostor;
+// baked once the tree is uploaded; until then far trees are drawn as meshes
+bool treeImpostorBaked = false;
+std::atomic<bool> treeImpostorReady(false);
+// bounding sphere of the tree, object space, known as soon as it is parsed
+glm::vec3 treeCenter;
+float treeRadius = 0.0f;
+gps::RingBuffer impostorInstanceRing;
+
+// copies of the tree scattered around the farm, model matrices before the scene rotation
+int forestCount = 0;
+std::vector<glm::mat4> forest;
+std::vector<std::vector<unsigned char> > forestLodHistory;
+// the forest and the lamps are scattered over the farm once its bounds are known
+bool scatterPlaced = false;
+
+// point and spot lamps scattered around the farm, world space before the scene rotation
+int lampCount = 0;
+std::vector<gps::Light> lamps;
+gps::ClusteredLights clusteredLights;
+const int LIGHT_DATA_TEXTURE_UNIT = 5;
+const int LIGHT_GRID_TEXTURE_UNIT = 6;
+
+// depth-only pass before the main pass, so the lighting shader runs about once per sample
+enum DEPTH_PREPASS_MODE { DEPTH_PREPASS_OFF, DEPTH_PREPASS_ON, DEPTH_PREPASS_AUTO };
+DEPTH_PREPASS_MODE depthPrepassMode = DEPTH_PREPASS_AUTO;
+// auto mode turns the pre-pass on above this overdraw and off again below 80% of it
+float overdrawThreshold = 2.0f;
+bool depthPrepassActive = false;
+GLint framebufferSamples = 1;
+gps::OverdrawMeter overdrawMeter;
+
+// deferred shading instead of the forward main pass; B switches at runtime
+bool deferredShading = false;
+gps::GBuffer gBuffer;
+const int GBUFFER_TEXTURE_UNIT = 7;
+
+// frame-time governor: render scale, shadow resolution and LOD bias follow the GPU frame time
+// a negative target means 60 FPS in a window and no governor when benchmarking
+double targetFps = -1.0;
+gps::FrameGovernor frameGovernor;
+std::atomic<float> governedRenderScale(1.0f);
+std::atomic<float> governedLodBias(1.0f);
+// below full scale the main passes draw into scaledTarget, which is then upscaled to sceneFramebuffer
+gps::RenderTarget scaledTarget;
+GLuint mainFramebuffer = 0;
 
 //shaders
-gps::Shader myCustomShader;
+// the lit shaders come in variants with fog, spotlight, shadows and lamps compiled in or out
+gps::ShaderVariants mainShaderVariants;
 gps::Shader lightShader;
 gps::Shader screenQuadShader;
 gps::Shader depthMapShader;
 gps::Shader skyboxShader;
+gps::Shader impostorBakeShader;
+gps::Shader impostorShader;
+gps::Shader depthPrepassShader;
+gps::Shader gBufferShader;
+gps::ShaderVariants deferredLightingVariants;
+gps::Shader upscaleShader;
 
 GLuint shadowMapFBO;
 GLuint depthMapTexture;
@@ -77,6 +247,10 @@ GLuint depthMapTexture;
 bool showDepthMap;
 bool fullScreen = false;
 
+//render modes, applied by the render thread
+GLenum polygonMode = GL_FILL;
+bool multisample = true;
+
 //skyBox
 gps::SkyBox mySkyBox;
 
@@ -87,7 +261,6 @@ float yaw = -90.0f, pitch;
 
 //fog
 int initFog = 0;
-GLint initFogLocation;
 GLfloat initFogDensity = 0.005f;
 
 //camera animation
@@ -105,8 +278,12 @@ GLfloat scarecrowRotation = 0.0f;
 float moveRacoonX;
 float move = 0.01f;
 
+//the shadow and main passes used to advance the animations once each per frame
+const int ANIMATION_STEPS_PER_FRAME = 2;
+
 //spotlight
 int initSpotLight;
+// set once by initUniforms, before the render thread starts
 float spotLight;
 float spotLight1;
 
@@ -143,25 +320,35 @@ GLenum glCheckError_(const char* file, int line) {
 
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "window resized to width: %d , and height: %d\n", width, height);
-	// get the size
-	glfwGetFramebufferSize(window, &width, &height);
+	// get the size - projection and viewport follow it through the next frame packet
 	glfwGetFramebufferSize(window, &retina_width, &retina_height);
-	// compute the matrix and send it to the shader
-	myCustomShader.useShaderProgram();
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 1000.0f);
-	GLint projLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-	// set Viewport transform
-	glViewport(0, 0, width, height);
 }
 
-void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, GL_TRUE);
+void applyKeyEvent(int key, int action) {
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS && glWindow)
+		glfwSetWindowShouldClose(glWindow, GL_TRUE);
 
 	if (key == GLFW_KEY_M && action == GLFW_PRESS)
 		showDepthMap = !showDepthMap;
 
+	//print job system utilization
+	if (key == GLFW_KEY_J && action == GLFW_PRESS)
+		jobSystem.PrintUtilization();
+
+	//print gpu pass timings
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		printGpuTimings = true;
+
+	//dump gpu memory allocations
+	if (key == GLFW_KEY_V && action == GLFW_PRESS)
+		gps::GpuMemory::Dump();
+
+	//switch between forward and deferred shading
+	if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+		deferredShading = !deferredShading;
+		printf("Shading: %s\n", deferredShading ? "deferred" : "forward");
+	}
+
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -171,7 +358,7 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 	}
 }
 
-void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+void applyCursorEvent(double xpos, double ypos) {
 	if (mouse) {
 		lastX = xpos;
 		lastY = ypos;
@@ -195,14 +382,41 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 		pitch = -89.0f;
 
 	myCamera.rotate(pitch, yaw);
-	view = myCamera.getViewMatrix();
-	myCustomShader.useShaderProgram();
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(glm::mat3(glm::inverseTranspose(view * model))));
+}
+
+void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
+	// a replay owns the input; escape still ends it early
+	if (replaying && key != GLFW_KEY_ESCAPE)
+		return;
+	if (recordFile && !recordPoses)
+		inputRecording.AddKey(simulationTick, key, action);
+	applyKeyEvent(key, action);
+}
+
+void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+	if (replaying)
+		return;
+	if (recordFile && !recordPoses)
+		inputRecording.AddCursor(simulationTick, xpos, ypos);
+	applyCursorEvent(xpos, ypos);
+}
+
+// Feeds the events recorded for this tick through the same handlers live input uses
+void replayInput() {
+	const std::vector<gps::InputEvent>& events = inputRecording.GetEvents();
+	while (replayEventIndex < events.size() && events[replayEventIndex].tick <= simulationTick) {
+		const gps::InputEvent& event = events[replayEventIndex++];
+		if (event.type == gps::INPUT_KEY)
+			applyKeyEvent(event.key, event.action);
+		else
+			applyCursorEvent(event.x, event.y);
+	}
 }
 
 void processMovement()
 {
+	PROFILE_ZONE("processMovement");
+
 	//start preview
 	if (pressedKeys[GLFW_KEY_Z]) {
 		startCameraPreview = true;
@@ -215,26 +429,26 @@ void processMovement()
 
 	//line view
 	if (pressedKeys[GLFW_KEY_1]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		polygonMode = GL_LINE;
 	}
 
 	//point view
 	if (pressedKeys[GLFW_KEY_2]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+		polygonMode = GL_POINT;
 	}
 
 	//normal view
 	if (pressedKeys[GLFW_KEY_3]) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		polygonMode = GL_FILL;
 	}
 
 	//smooth view
 	if (pressedKeys[GLFW_KEY_4]) {
-		glEnable(GL_MULTISAMPLE);
+		multisample = true;
 	}
 
 	if (pressedKeys[GLFW_KEY_5]) {
-		glDisable(GL_MULTISAMPLE);
+		multisample = false;
 	}
 
 	//rotate scene
@@ -257,16 +471,12 @@ void processMovement()
 
 	//start spotlight
 	if (pressedKeys[GLFW_KEY_O]) {
-		myCustomShader.useShaderProgram();
 		initSpotLight = 1;
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "initSpotLight"), initSpotLight);
 	}
 
 	//stop spotlight
 	if (pressedKeys[GLFW_KEY_P]) {
-		myCustomShader.useShaderProgram();
 		initSpotLight = 0;
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "initSpotLight"), initSpotLight);
 	}
 
 	//move camera
@@ -286,8 +496,8 @@ void processMovement()
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
 	}
 
-	//full screen
-	if (pressedKeys[GLFW_KEY_F]) {
+	//full screen - no window to resize when a replay drives --bench
+	if (pressedKeys[GLFW_KEY_F] && glWindow) {
 		if (fullScreen)
 		{
 			glfwSetWindowMonitor(glWindow, nullptr, 100, 100, glWindowWidth, glWindowHeight, GLFW_DONT_CARE);
@@ -309,18 +519,12 @@ void processMovement()
 
 	//start fog
 	if (pressedKeys[GLFW_KEY_R]) {
-		myCustomShader.useShaderProgram();
 		initFog = 1;
-		initFogLocation = glGetUniformLocation(myCustomShader.shaderProgram, "initFog");
-		glUniform1i(initFogLocation, initFog);
 	}
 
 	//stop fog
 	if (pressedKeys[GLFW_KEY_T]) {
-		myCustomShader.useShaderProgram();
 		initFog = 0;
-		initFogLocation = glGetUniformLocation(myCustomShader.shaderProgram, "initFog");
-		glUniform1i(initFogLocation, initFog);
 	}
 
 	// increase the intensity of fog
@@ -377,6 +581,41 @@ bool initOpenGLWindow()
 	return true;
 }
 
+// Offscreen replacement for initOpenGLWindow used by --bench
+bool initHeadlessContext()
+{
+	if (!headlessContext.Create())
+		return false;
+
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	const GLubyte* version = glGetString(GL_VERSION);
+	printf("Renderer: %s\n", renderer);
+	printf("OpenGL version supported %s\n", version);
+	benchmark.SetInfo("renderer", (const char*)renderer);
+	benchmark.SetInfo("gl_version", (const char*)version);
+
+	retina_width = glWindowWidth;
+	retina_height = glWindowHeight;
+	if (!benchTarget.Create(retina_width, retina_height))
+		return false;
+	sceneFramebuffer = benchTarget.GetFramebuffer();
+	return true;
+}
+
+void makeContextCurrent() {
+	if (benchMode)
+		headlessContext.MakeCurrent();
+	else
+		glfwMakeContextCurrent(glWindow);
+}
+
+void releaseContext() {
+	if (benchMode)
+		headlessContext.ReleaseCurrent();
+	else
+		glfwMakeContextCurrent(NULL);
+}
+
 void initOpenGLState()
 {
 	glClearColor(0.3, 0.3, 0.3, 1.0);
@@ -387,35 +626,110 @@ void initOpenGLState()
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
 	glEnable(GL_FRAMEBUFFER_SRGB);
-}
-
-void initObjects() {
-	farm.LoadModel(
-		"objects/Scene.obj");
 
-	lightCube.LoadModel(
-		"objects/cube/cube.obj");
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glGetIntegerv(GL_SAMPLES, &framebufferSamples);
+	framebufferSamples = glm::max(framebufferSamples, 1);
 
-	screenQuad.LoadModel(
-		"objects/quad/quad.obj");
+	// decided before any model or shader loads, both have to agree
+	bindlessTextures = bindlessTextures && GLEW_ARB_bindless_texture;
+	printf("Material textures: %s\n", bindlessTextures ? "bindless, streamed textures bound to units" : "bound to units");
+}
 
-	racoon.LoadModel(
-		"objects/racoon/racoon.obj", 
-		"objects/racoon/");
+// Parses the streamed models one at a time, always the one nearest to the camera next
+// Runs outside the job system, whose Wait could otherwise hand a whole model load to the simulation thread
+void loaderThreadFunction(gps::MeshLoadOptions loadOptions) {
+	PROFILE_THREAD("loader");
 
-	scarecrow.LoadModel(
-		"objects/scarecrow/scarecrow.obj", 
-		"objects/scarecrow/");
+	std::vector<bool> parsed(streamedModels.size(), false);
+	for (size_t count = 0; count < streamedModels.size() && !stopLoading.load(); count++) {
+		glm::vec3 cameraPosition;
+		{
+			std::lock_guard<std::mutex> lock(streamingCameraMutex);
+			cameraPosition = streamingCameraPosition;
+		}
+		size_t next = streamedModels.size();
+		for (size_t i = 0; i < streamedModels.size(); i++) {
+			if (!parsed[i] && (next == streamedModels.size() ||
+				glm::length(streamedModels[i].position - cameraPosition) < glm::length(streamedModels[next].position - cameraPosition)))
+				next = i;
+		}
+		parsed[next] = true;
+		const StreamedModel& streamed = streamedModels[next];
+		streamed.model->ParseModel(streamed.fileName, streamed.basePath, NULL, loadOptions);
+	}
+}
 
-	tree.LoadModel(
-		"objects/tree/tree.obj", 
-		"objects/tree/");
+void initObjects() {
+	PROFILE_ZONE("initObjects");
+
+	struct ModelFile {
+		gps::Model3D* model;
+		const char* fileName;
+		const char* basePath;
+		// the light cube and the screen quad are tiny and drawn from the first frame on
+		bool streamed;
+		glm::vec3 position;
+	};
+
+	const ModelFile modelFiles[] = {
+		{ &farm, "objects/Scene.obj", "objects/", true, glm::vec3(0.0f) },
+		{ &lightCube, "objects/cube/cube.obj", "objects/cube/", false, glm::vec3(0.0f) },
+		{ &screenQuad, "objects/quad/quad.obj", "objects/quad/", false, glm::vec3(0.0f) },
+		{ &racoon, "objects/racoon/racoon.obj", "objects/racoon/", true, glm::vec3(0.0f) },
+		{ &scarecrow, "objects/scarecrow/scarecrow.obj", "objects/scarecrow/", true, glm::vec3(10.29f, 0.0f, 13.808f) },
+		{ &tree, "objects/tree/tree.obj", "objects/tree/", true, glm::vec3(6.25f, 1.44f, -12.48f) },
+	};
+	const size_t modelCount = sizeof(modelFiles) / sizeof(modelFiles[0]);
+
+	// parse and decode on the workers, upload on the main thread as soon as each model is parsed
+	// nothing picks against the scene, so the meshes only keep their bounds once uploaded
+	gps::MeshLoadOptions loadOptions;
+	loadOptions.retention = gps::RETAIN_BOUNDS;
+	loadOptions.vertexFormat = floatVertices ? gps::VERTEX_FORMAT_FLOAT : gps::VERTEX_FORMAT_QUANTIZED;
+	loadOptions.lodCount = lodCount;
+	loadOptions.buildMeshlets = clusterCulling;
+	loadOptions.depthStream = depthStream;
+	loadOptions.textureArrayMaxSize = textureArrayMaxSize;
+	loadOptions.bindlessTextures = bindlessTextures;
+
+	gps::JobCounter parsed[modelCount];
+	gps::JobCounter uploaded;
+	for (size_t i = 0; i < modelCount; i++) {
+		ModelFile file = modelFiles[i];
+		if (streamingLoads && file.streamed) {
+			StreamedModel streamed = { file.model, file.fileName, file.basePath, file.position };
+			streamedModels.push_back(streamed);
+			continue;
+		}
+		jobSystem.Run([file, loadOptions]() {
+			file.model->ParseModel(file.fileName, file.basePath, &jobSystem, loadOptions);
+		}, &parsed[i]);
+		jobSystem.RunOnMainThread([file]() {
+			file.model->UploadModel();
+		}, &uploaded, &parsed[i]);
+	}
+	jobSystem.Wait(&uploaded);
+	for (size_t i = 0; i < modelCount; i++)
+		jobSystem.Wait(&parsed[i]);
+
+	allModelsReady = streamedModels.empty();
+	if (!streamedModels.empty()) {
+		streamingCameraPosition = myCamera.cameraPosition;
+		loaderThread = std::thread(loaderThreadFunction, loadOptions);
+	}
 }
 
 void initShaders() {
-	myCustomShader.loadShader(
-		"shaders/shaderStart.vert", 
-		"shaders/shaderStart.frag");
+	PROFILE_ZONE("initShaders");
+
+	// the shaders sampling the model textures read the material tables the models fill with their handles
+	std::string materialDefines = bindlessTextures ? "#define BINDLESS_TEXTURES\n" : "";
+
+	mainShaderVariants.Create(
+		"shaders/shaderStart.vert",
+		"shaders/shaderStart.frag",
+		materialDefines);
 
 	lightShader.loadShader(
 		"shaders/lightCube.vert",
@@ -432,6 +746,128 @@ void initShaders() {
 	skyboxShader.loadShader(
 		"shaders/skyboxShader.vert",
 		"shaders/skyboxShader.frag");
+
+	impostorBakeShader.loadShader(
+		"shaders/impostorBake.vert",
+		"shaders/impostorBake.frag",
+		materialDefines);
+
+	impostorShader.loadShader(
+		"shaders/impostor.vert",
+		"shaders/impostor.frag");
+
+	depthPrepassShader.loadShader(
+		"shaders/depthPrepass.vert",
+		"shaders/depthMapShader.frag");
+
+	gBufferShader.loadShader(
+		"shaders/shaderStart.vert",
+		"shaders/gbuffer.frag",
+		materialDefines);
+
+	deferredLightingVariants.Create(
+		"shaders/screenQuad.vert",
+		"shaders/deferredLighting.frag");
+
+	upscaleShader.loadShader(
+		"shaders/screenQuad.vert",
+		"shaders/upscale.frag");
+}
+
+float randomUniform(std::minstd_rand& random, float low, float high) {
+	return low + (high - low) * (float)(random() - random.min()) / (float)(random.max() - random.min());
+}
+
+// Random points over the farm outside its middle, at the height the tree stands on
+// Fixed seeds, so recordings and benchmarks always see the same scene
+std::vector<glm::vec3> scatterOverFarm(int count, unsigned int seed) {
+	glm::vec3 farmMin, farmMax, treeMin, treeMax;
+	farm.GetLoadBounds(farmMin, farmMax);
+	tree.GetLoadBounds(treeMin, treeMax);
+	glm::vec3 farmCenter = (farmMin + farmMax) * 0.5f;
+	glm::vec2 farmExtent = glm::vec2(farmMax.x - farmMin.x, farmMax.z - farmMin.z) * 0.5f;
+	float clearing = 0.5f * glm::min(farmExtent.x, farmExtent.y);
+
+	std::minstd_rand random(seed);
+	std::vector<glm::vec3> positions;
+	while ((int)positions.size() < count) {
+		glm::vec3 position(randomUniform(random, -farmExtent.x, farmExtent.x), 0.0f, randomUniform(random, -farmExtent.y, farmExtent.y));
+		if (glm::length(position) >= clearing)
+			positions.push_back(position + glm::vec3(farmCenter.x, treeMin.y, farmCenter.z));
+	}
+	return positions;
+}
+
+// On the thread that owns the context, once the tree is uploaded
+void bakeTreeImpostor() {
+	if (!impostorsEnabled || treeImpostorBaked || !tree.IsReady())
+		return;
+	treeImpostorBaked = true;
+	if (treeImpostor.Bake(tree, impostorBakeShader, 8, 128, "tree impostor"))
+		treeImpostorReady.store(true, std::memory_order_release);
+}
+
+void initImpostors() {
+	PROFILE_ZONE("initImpostors");
+
+	bakeTreeImpostor();
+	impostorInstanceRing.Create(GL_ARRAY_BUFFER, (forestCount + 1) * sizeof(glm::vec4), 3, "impostor instances");
+}
+
+void initForest() {
+	glm::vec3 treeMin, treeMax;
+	tree.GetLoadBounds(treeMin, treeMax);
+	// the same sphere the impostor is baked around
+	treeCenter = (treeMin + treeMax) * 0.5f;
+	treeRadius = glm::length(treeMax - treeMin) * 0.5f;
+	glm::vec3 treeBase((treeMin.x + treeMax.x) * 0.5f, treeMin.y, (treeMin.z + treeMax.z) * 0.5f);
+
+	std::vector<glm::vec3> positions = scatterOverFarm(forestCount, 39);
+	std::minstd_rand random(39);
+	forest.clear();
+	for (size_t i = 0; i < positions.size(); i++) {
+		float scale = randomUniform(random, 0.7f, 1.3f);
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+		model = glm::scale(model, glm::vec3(scale, scale, scale));
+		forest.push_back(glm::translate(model, -treeBase));
+	}
+	forestLodHistory.assign(forest.size(), std::vector<unsigned char>());
+}
+
+// Warm street lamps on posts; every fourth one is a spot light shining down
+void initLamps() {
+	std::vector<glm::vec3> positions = scatterOverFarm(lampCount, 40);
+	std::minstd_rand random(40);
+	lamps.clear();
+	for (size_t i = 0; i < positions.size(); i++) {
+		gps::Light lamp;
+		lamp.position = positions[i] + glm::vec3(0.0f, 3.0f, 0.0f);
+		lamp.color = glm::vec3(1.0f, randomUniform(random, 0.55f, 0.8f), randomUniform(random, 0.3f, 0.5f)) * 8.0f;
+		lamp.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		if (i % 4 == 3) {
+			lamp.type = gps::LIGHT_SPOT;
+			lamp.range = 12.0f;
+			lamp.color *= 2.0f;
+			lamp.cosInnerCone = cosf(glm::radians(25.0f));
+			lamp.cosOuterCone = cosf(glm::radians(40.0f));
+		}
+		else {
+			lamp.type = gps::LIGHT_POINT;
+			lamp.range = randomUniform(random, 6.0f, 10.0f);
+			lamp.cosInnerCone = -1.0f;
+			lamp.cosOuterCone = -1.0f;
+		}
+		lamps.push_back(lamp);
+	}
+}
+
+// Simulation side, as soon as the farm and the tree are parsed
+void placeScatteredObjects() {
+	if (scatterPlaced || farm.GetLoadState() == gps::MODEL_UNLOADED || tree.GetLoadState() == gps::MODEL_UNLOADED)
+		return;
+	scatterPlaced = true;
+	initForest();
+	initLamps();
 }
 
 void initSkyBox() {
@@ -444,6 +880,8 @@ void initSkyBox() {
 }
 
 void loadSkyBox() {
+	PROFILE_ZONE("loadSkyBox");
+
 	mySkyBox.Load(faces);
 	skyboxShader.useShaderProgram();
 	view = myCamera.getViewMatrix();
@@ -452,35 +890,17 @@ void loadSkyBox() {
 	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 }
 
+// The lit shaders are compiled per variant on first use, so their uniforms are set every frame instead
 void initUniforms() {
-	myCustomShader.useShaderProgram();
-
-	model = glm::mat4(1.0f);
-	modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
 	projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-	projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(1.0f, 1.0f, 0.0f);
 	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-	lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightDir");
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "lightColor");
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
 	// spotlight
 	spotLight = glm::cos(glm::radians(10.0f));
@@ -488,21 +908,68 @@ void initUniforms() {
 	spotLightDirection = glm::vec3(0, 0, -1);
 	spotLightPosition = glm::vec3(0.0f, 1.0f, 0.0f);
 
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "spotLight"), spotLight);
-	glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "spotLight1"), spotLight1);
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, "spotLightDirection"), 1, glm::value_ptr(spotLightDirection));
-	glUniform3fv(glGetUniformLocation(myCustomShader.shaderProgram, "spotLightPosition"), 1, glm::value_ptr(spotLightPosition));
-
 	lightShader.useShaderProgram();
 	glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 }
 
+void initDrawData() {
+	// one partition per frame in flight: two queued packets plus the one the GPU is still drawing
+	drawDataRing.Create(GL_TEXTURE_BUFFER, 256 * sizeof(gps::DrawData), 3, "per-draw data");
+
+	glGenTextures(1, &drawDataTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataRing.GetBuffer());
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	clusteredLights.Create();
+	overdrawMeter.Create();
+}
+
+// Writes the draw list into this frame's partition; returns its offset in texels
+GLint uploadDrawData(const gps::FramePacket& frame) {
+	GLsizeiptr size = frame.drawList.size() * sizeof(gps::DrawData);
+	if (drawDataRing.BeginFrame(size)) {
+		//the ring grew - the texture still references the old storage, even if the new one reused its name
+		glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataRing.GetBuffer());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void* pointer;
+	GLintptr offset = drawDataRing.Allocate(size, sizeof(glm::vec4), &pointer);
+	if (pointer) {
+		gps::DrawData* drawData = (gps::DrawData*)pointer;
+		for (size_t i = 0; i < frame.drawList.size(); i++) {
+			drawData[i].model = frame.drawList[i].model;
+			drawData[i].normalMatrix = glm::mat4(frame.drawList[i].normalMatrix);
+		}
+	}
+	drawDataRing.FinishWrites();
+	gps::RenderStats::Current().bufferBytesUploaded += size;
+
+	return offset < 0 ? 0 : (GLint)(offset / sizeof(glm::vec4));
+}
+
+// Reallocates the depth map storage; the framebuffer keeps the same texture attached
+void resizeShadowMap(int size) {
+	if (size == shadowMapSize)
+		return;
+	if (shadowMapSize)
+		gps::GpuMemory::Release(GL_TEXTURE, depthMapTexture);
+	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	gps::GpuMemory::Track(GL_TEXTURE, depthMapTexture, gps::GPU_MEMORY_RENDER_TARGET,
+		gps::GpuMemory::TextureBytes(size, size, 4, false), "shadow pass", "depth map");
+	shadowMapSize = size;
+}
+
 void initFBO() {
 	glGenFramebuffers(1, &shadowMapFBO);
 	glGenTextures(1, &depthMapTexture);
+	resizeShadowMap(MAX_SHADOW_MAP_SIZE);
 	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
@@ -526,148 +993,942 @@ glm::mat4 computeLightSpaceTrMatrix() {
 	return lightProjection * lightView;
 }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
-	shader.useShaderProgram();
+void updateAnimation() {
+	for (int step = 0; step < ANIMATION_STEPS_PER_FRAME; step++) {
+		//scale tree
+		if (treeScale >= 2.0f) {
+			scale = -0.01f;
+		}
+		if (treeScale <= 0.5f) {
+			scale = 0.01f;
+		}
+		treeScale += scale;
+
+		//rotate scarecrow
+		scarecrowRotation += 0.01f;
+
+		//moveRacoon
+		if (moveRacoonX >= 10.0f)
+			move = -0.01f;
+		if (moveRacoonX <= 0.0f)
+			move = 0.01f;
+		moveRacoonX += move;
+	}
+}
+
+// True when the tree drawn with model covers fewer pixels than impostorSize; instance is its impostor data
+bool isFarTree(const glm::mat4& model, const glm::vec3& cameraPosition, float pixelScale, glm::vec4& instance) {
+	float scale = glm::length(glm::vec3(model[1]));
+	glm::vec3 center = glm::vec3(model * glm::vec4(treeCenter, 1.0f));
+	float radius = treeRadius * scale;
+	float distance = glm::length(center - cameraPosition);
+	instance = glm::vec4(center, scale);
+	return treeImpostorReady.load(std::memory_order_acquire) && distance > radius && 2.0f * radius / distance * pixelScale < impostorSize;
+}
+
+// Model matrix that stretches the light cube over the bounds of object
+glm::mat4 placeholderMatrix(gps::Model3D* object) {
+	glm::vec3 boundsMin, boundsMax, cubeMin, cubeMax;
+	object->GetLoadBounds(boundsMin, boundsMax);
+	lightCube.GetBounds(cubeMin, cubeMax);
+	glm::mat4 matrix = glm::translate(glm::mat4(1.0f), boundsMin);
+	matrix = glm::scale(matrix, (boundsMax - boundsMin) / glm::max(cubeMax - cubeMin, glm::vec3(1e-6f)));
+	return glm::translate(matrix, -cubeMin);
+}
+
+// pixelScale converts a projected size in view space units at distance 1 to pixels
+void buildDrawList(gps::FramePacket& frame, float pixelScale) {
+	PROFILE_ZONE("buildDrawList");
+
+	gps::LodSettings settings = lodSettings;
+	settings.fullDetailSize *= governedLodBias.load();
+
+	glm::mat4 sceneRotation = glm::rotate(glm::mat4(1.0f), glm::radians(angleY), glm::vec3(0.0f, 1.0f, 0.0f));
+	std::vector<gps::DrawItem>& drawList = frame.drawList;
+	frame.impostorInstances.clear();
+	frame.impostorRotation = glm::mat3(sceneRotation);
+	frame.placeholders.clear();
+
+	glm::mat4 treeModel = sceneRotation;
+	treeModel = glm::translate(treeModel, glm::vec3(6.25f, 1.44f, -12.48f));
+	treeModel = glm::scale(treeModel, glm::vec3(treeScale, treeScale, treeScale));
+	treeModel = glm::translate(treeModel, glm::vec3(-6.25f, -1.44f, 12.48f));
+
+	// objects and near trees get a draw item each; far trees only add an impostor instance
+	std::vector<std::vector<unsigned char>*> lodHistories;
+	size_t drawCount = 0;
+	auto addItem = [&](gps::Model3D* object, const glm::mat4& model, std::vector<unsigned char>* lodHistory) {
+		if (drawCount == drawList.size())
+			drawList.resize(drawCount + 1);
+		drawList[drawCount].object = object;
+		drawList[drawCount].model = model;
+		lodHistories.push_back(lodHistory);
+		drawCount++;
+	};
+	// models still streaming in show their bounding box once it is known
+	auto addObject = [&](gps::Model3D* object, const glm::mat4& model) {
+		if (object->IsReady())
+			addItem(object, model, NULL);
+		else if (object->GetLoadState() != gps::MODEL_UNLOADED)
+			frame.placeholders.push_back(model * placeholderMatrix(object));
+	};
+
+	glm::vec4 instance;
+	addObject(&farm, sceneRotation);
+	if (isFarTree(treeModel, frame.cameraPosition, pixelScale, instance))
+		frame.impostorInstances.push_back(instance);
+	else
+		addObject(&tree, treeModel);
+	glm::mat4 scarecrowModel = glm::translate(sceneRotation, glm::vec3(10.29, 0, 13.808));
+	scarecrowModel = glm::rotate(scarecrowModel, scarecrowRotation, glm::vec3(0, 1, 0));
+	addObject(&scarecrow, glm::translate(scarecrowModel, glm::vec3(-10.29, 0, -13.808)));
+	addObject(&racoon, glm::translate(sceneRotation, glm::vec3(moveRacoonX, 0, moveRacoonX)));
+
+	// the forest is static, so its trees are also dropped when their bounding sphere leaves the frustum
+	// it appears all at once when the tree is uploaded, without a placeholder per copy
+	gps::ClusterCullView frustum = gps::MeshletBuilder::MakeCullView(frame.projection * frame.view, glm::mat4(1.0f), frame.cameraPosition);
+	for (size_t i = 0; i < forest.size() && tree.IsReady(); i++) {
+		glm::mat4 model = sceneRotation * forest[i];
+		bool far = isFarTree(model, frame.cameraPosition, pixelScale, instance);
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+			outside = glm::dot(glm::vec3(frustum.planes[p]), glm::vec3(instance)) + frustum.planes[p].w < -treeRadius * instance.w;
+		if (outside)
+			continue;
+		if (far)
+			frame.impostorInstances.push_back(instance);
+		else
+			addItem(&tree, model, &forestLodHistory[i]);
+	}
+	drawList.resize(drawCount);
+
+	jobSystem.ParallelFor(drawList.size(), 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			gps::DrawItem& item = drawList[i];
+			item.normalMatrix = glm::mat3(glm::inverseTranspose(frame.view * item.model));
+			item.object->SelectLods(item.model, frame.cameraPosition, pixelScale, settings, item.lods, item.shadowLods, lodHistories[i]);
+			item.object->RequestTextureLevels(item.model, frame.cameraPosition, pixelScale);
+			if (clusterCulling)
+				item.object->CullClusters(item.model, frame.projection * frame.view, frame.cameraPosition, item.lods, item.clusters);
+			else
+				item.clusters.meshRanges.clear();
+		}
+	});
+}
+
+// Simulation side of a frame - runs on the main thread, no GL calls
+void buildFramePacket(gps::FramePacket& frame) {
+	PROFILE_ZONE("buildFramePacket");
 
-	model = glm::rotate(glm::mat4(1.0f), glm::radians(angleY), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 modelCopy = model;
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-	if (!depthPass) {
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	}
-	farm.Draw(shader);
-
-	model = glm::translate(model, glm::vec3(6.25f, 1.44f, -12.48f));
-	model = glm::scale(model, glm::vec3(treeScale, treeScale, treeScale));
-	model = glm::translate(model, glm::vec3(-6.25f, -1.44f, 12.48f));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	tree.Draw(shader);
-	if (treeScale >= 2.0f) {
-		scale = -0.01f;
-	}
-	if (treeScale <= 0.5f) {
-		scale = 0.01f;
-	}
-	treeScale += scale;
-
-	//rotate scarecrow
-	model = glm::translate(modelCopy, glm::vec3(10.29, 0, 13.808));
-	model = glm::rotate(model, scarecrowRotation, glm::vec3(0, 1, 0));
-	model = glm::translate(model, glm::vec3(-10.29, 0, -13.808));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	scarecrow.Draw(shader);
-	scarecrowRotation += 0.01f;
-
-	//moveRacoon
-	model = glm::translate(modelCopy, glm::vec3(moveRacoonX, 0, moveRacoonX));
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-	if (moveRacoonX >= 10.0f)
-		move = -0.01f;
-	if (moveRacoonX <= 0.0f)
-		move = 0.01f;
-	moveRacoonX += move;
-	racoon.Draw(shader);
-}
-
-void renderScene() {
 	//camera preview
 	cameraPreviewFunction();
+	updateAnimation();
 
-	depthMapShader.useShaderProgram();
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
-	drawObjects(depthMapShader, true);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	frame.frameIndex = frameIndex++;
+	frame.framebufferWidth = retina_width;
+	frame.framebufferHeight = retina_height;
+	frame.renderScale = governedRenderScale.load();
+	frame.renderWidth = glm::max((int)(retina_width * frame.renderScale + 0.5f), 1);
+	frame.renderHeight = glm::max((int)(retina_height * frame.renderScale + 0.5f), 1);
+
+	view = myCamera.getViewMatrix();
+	frame.view = view;
+	const float fieldOfView = glm::radians(45.0f);
+	frame.projection = glm::perspective(fieldOfView, (float)retina_width / (float)glm::max(retina_height, 1), 0.1f, 1000.0f);
+	frame.cameraPosition = myCamera.cameraPosition;
+
+	lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+	frame.lightColor = lightColor;
+	frame.lightDirEye = glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir;
+	frame.lightSpaceTrMatrix = computeLightSpaceTrMatrix();
+	frame.lightCubeModel = glm::translate(lightRotation, glm::vec3(0.0f, 20.0f, 0.0f));
+	frame.lightCubeModel = glm::scale(frame.lightCubeModel, glm::vec3(0.5f, 0.5f, 0.5f));
+
+	// the lamps turn with the scene
+	glm::mat4 sceneRotation = glm::rotate(glm::mat4(1.0f), glm::radians(angleY), glm::vec3(0.0f, 1.0f, 0.0f));
+	if (!streamedModels.empty()) {
+		std::lock_guard<std::mutex> lock(streamingCameraMutex);
+		streamingCameraPosition = glm::transpose(glm::mat3(sceneRotation)) * frame.cameraPosition;
+	}
+	placeScatteredObjects();
+	gps::ClusteredLights::Build(lamps, view * sceneRotation, frame.projection, 0.1f, 1000.0f, jobSystem, frame.lightClusters);
+
+	frame.showDepthMap = showDepthMap;
+	frame.initFog = initFog;
+	frame.fogDensity = initFogDensity;
+	frame.initSpotLight = initSpotLight;
+	frame.shaderFeatures = (shadowsEnabled ? gps::SHADER_FEATURE_SHADOWS : 0) | (initFog ? gps::SHADER_FEATURE_FOG : 0) |
+		(initSpotLight ? gps::SHADER_FEATURE_SPOT_LIGHT : 0) | (lamps.empty() ? 0 : gps::SHADER_FEATURE_CLUSTERED_LIGHTS);
+	frame.polygonMode = polygonMode;
+	frame.multisample = multisample;
+	frame.deferredShading = deferredShading;
+
+	buildDrawList(frame, glm::max(retina_height, 1) / (2.0f * tanf(fieldOfView * 0.5f)));
+}
+
+// Render passes are timed on the GPU and have their GL work counted under the same name
+void beginPass(const char* name) {
+	gpuTimer.BeginPass(name);
+	gps::RenderStats::BeginPass(name);
+}
+
+void endPass() {
+	gps::RenderStats::EndPass();
+	gpuTimer.EndPass();
+}
+
+// depthOnly passes draw from the meshes' position-only stream
+void drawObjects(const gps::FramePacket& frame, gps::Shader shader, GLint drawDataOffset, bool shadowPass, bool depthOnly) {
+	shader.useShaderProgram();
+
+	glActiveTexture(GL_TEXTURE0 + DRAW_DATA_TEXTURE_UNIT);
+	gps::gl::BindTexture(GL_TEXTURE_BUFFER, drawDataTexture);
+	gps::gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "drawData"), DRAW_DATA_TEXTURE_UNIT);
+	gps::gl::Uniform1i(glGetUniformLocation(shader.shaderProgram, "drawDataOffset"), drawDataOffset);
+
+	// the matrices are already on the GPU; only the draw index changes between objects
+	GLint drawIdLocation = glGetUniformLocation(shader.shaderProgram, "drawId");
+	for (size_t i = 0; i < frame.drawList.size(); i++) {
+		gps::gl::Uniform1i(drawIdLocation, (GLint)i);
+		const gps::DrawItem& item = frame.drawList[i];
+		// the clusters were culled against the camera, the light sees the other side
+		if (shadowPass)
+			item.object->Draw(shader, &item.shadowLods, NULL, depthOnly);
+		else
+			item.object->Draw(shader, &item.lods, &item.clusters, depthOnly);
+	}
+}
+
+// Streams this frame's impostor instances and draws them in one instanced call
+void drawImpostors(const gps::FramePacket& frame) {
+	GLsizeiptr size = frame.impostorInstances.size() * sizeof(glm::vec4);
+	impostorInstanceRing.BeginFrame(size);
+	void* pointer;
+	GLintptr offset = impostorInstanceRing.Allocate(size, sizeof(glm::vec4), &pointer);
+	if (pointer)
+		memcpy(pointer, &frame.impostorInstances[0], size);
+	impostorInstanceRing.FinishWrites();
+	gps::RenderStats::Current().bufferBytesUploaded += size;
+
+	if (offset >= 0) {
+		impostorShader.useShaderProgram();
+		GLuint program = impostorShader.shaderProgram;
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection));
+		gps::gl::Uniform3fv(glGetUniformLocation(program, "cameraPosition"), 1, glm::value_ptr(frame.cameraPosition));
+		glUniformMatrix3fv(glGetUniformLocation(program, "objectRotation"), 1, GL_FALSE, glm::value_ptr(frame.impostorRotation));
+		gps::gl::Uniform3fv(glGetUniformLocation(program, "lightDir"), 1, glm::value_ptr(frame.lightDirEye));
+		gps::gl::Uniform3fv(glGetUniformLocation(program, "lightColor"), 1, glm::value_ptr(frame.lightColor));
+		gps::gl::Uniform1i(glGetUniformLocation(program, "initFog"), frame.initFog);
+		gps::gl::Uniform1f(glGetUniformLocation(program, "initFogDensity"), frame.fogDensity);
+
+		glBindBuffer(GL_ARRAY_BUFFER, impostorInstanceRing.GetBuffer());
+		treeImpostor.Draw(impostorShader, offset, (GLsizei)frame.impostorInstances.size());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	impostorInstanceRing.EndFrame();
+}
+
+// Render thread side of the pre-pass decision, from the overdraw measured a few frames ago
+bool useDepthPrepass() {
+	if (depthPrepassMode != DEPTH_PREPASS_AUTO)
+		return depthPrepassMode == DEPTH_PREPASS_ON;
+
+	float overdraw = overdrawMeter.GetOverdraw();
+	bool active = depthPrepassActive;
+	if (overdraw > overdrawThreshold)
+		active = true;
+	else if (overdraw < overdrawThreshold * 0.8f)
+		active = false;
+	if (active != depthPrepassActive)
+		printf("Depth pre-pass: %s (overdraw %.2f)\n", active ? "on" : "off", overdraw);
+	depthPrepassActive = active;
+	return active;
+}
+
+// Lays down the depth of the main-pass geometry with color writes off; counts its samples for the overdraw
+void drawDepthPrepass(const gps::FramePacket& frame, GLint drawDataOffset) {
+	depthPrepassShader.useShaderProgram();
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(depthPrepassShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(depthPrepassShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection));
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	drawObjects(frame, depthPrepassShader, drawDataOffset, false, true);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Sun, spotlight, shadow map and lamps for a lit shader in use; a variant only gets the uniforms of its features
+void setLightingUniforms(const gps::FramePacket& frame, gps::Shader& shader) {
+	GLuint program = shader.shaderProgram;
+	gps::gl::Uniform3fv(glGetUniformLocation(program, "lightDir"), 1, glm::value_ptr(frame.lightDirEye));
+	gps::gl::Uniform3fv(glGetUniformLocation(program, "lightColor"), 1, glm::value_ptr(frame.lightColor));
+
+	if (frame.shaderFeatures & gps::SHADER_FEATURE_SHADOWS) {
+		glActiveTexture(GL_TEXTURE3);
+		gps::gl::BindTexture(GL_TEXTURE_2D, depthMapTexture);
+		gps::gl::Uniform1i(glGetUniformLocation(program, "shadowMap"), 3);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	if (frame.shaderFeatures & gps::SHADER_FEATURE_FOG)
+		gps::gl::Uniform1f(glGetUniformLocation(program, "initFogDensity"), frame.fogDensity);
+	if (frame.shaderFeatures & gps::SHADER_FEATURE_SPOT_LIGHT) {
+		gps::gl::Uniform1f(glGetUniformLocation(program, "spotLight"), spotLight);
+		gps::gl::Uniform1f(glGetUniformLocation(program, "spotLight1"), spotLight1);
+		gps::gl::Uniform3fv(glGetUniformLocation(program, "spotLightDirection"), 1, glm::value_ptr(spotLightDirection));
+		gps::gl::Uniform3fv(glGetUniformLocation(program, "spotLightPosition"), 1, glm::value_ptr(spotLightPosition));
+	}
+	if (frame.shaderFeatures & gps::SHADER_FEATURE_CLUSTERED_LIGHTS)
+		clusteredLights.Bind(shader, LIGHT_DATA_TEXTURE_UNIT, LIGHT_GRID_TEXTURE_UNIT, frame.renderWidth, frame.renderHeight);
+}
+
+// Starts compiling the variants one toggle away from this frame's, so flipping fog or the spotlight does not stall
+void prefetchShaderVariants(const gps::FramePacket& frame) {
+	gps::ShaderVariants& variants = frame.deferredShading ? deferredLightingVariants : mainShaderVariants;
+	variants.Prefetch(frame.shaderFeatures ^ gps::SHADER_FEATURE_FOG);
+	variants.Prefetch(frame.shaderFeatures ^ gps::SHADER_FEATURE_SPOT_LIGHT);
+}
+
+// Forward path: every fragment of the main pass is lit, optionally after a depth pre-pass
+void drawForward(const gps::FramePacket& frame, GLint drawDataOffset) {
+	// whichever pass resolves visibility with depth writes on is the one that measures overdraw
+	uint64_t targetSamples = (uint64_t)frame.renderWidth * frame.renderHeight * (mainFramebuffer == sceneFramebuffer ? framebufferSamples : 1);
+	bool prepass = useDepthPrepass();
+	if (prepass) {
+		beginPass("depth prepass");
+		overdrawMeter.Begin(targetSamples);
+		drawDepthPrepass(frame, drawDataOffset);
+		overdrawMeter.End();
+		endPass();
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+	}
 
-	if (showDepthMap) {
-		glViewport(0, 0, retina_width, retina_height);
+	beginPass("main");
+	gps::Shader& mainShader = mainShaderVariants.Get(frame.shaderFeatures);
+	GLuint program = mainShader.shaderProgram;
+	mainShader.useShaderProgram();
+
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection));
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(frame.lightSpaceTrMatrix));
+	setLightingUniforms(frame, mainShader);
+
+	if (!prepass)
+		overdrawMeter.Begin(targetSamples);
+	drawObjects(frame, mainShader, drawDataOffset, false, false);
+	if (prepass) {
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+	else
+		overdrawMeter.End();
+	endPass();
+}
+
+// Deferred path: the geometry only fills the g-buffer, then one fullscreen pass lights every pixel once
+void drawDeferred(const gps::FramePacket& frame, GLint drawDataOffset) {
+	if (gBuffer.GetWidth() != frame.framebufferWidth || gBuffer.GetHeight() != frame.framebufferHeight) {
+		gBuffer.Destroy();
+		gBuffer.Create(frame.framebufferWidth, frame.framebufferHeight);
+	}
+
+	beginPass("gbuffer");
+	gps::gl::BindFramebuffer(GL_FRAMEBUFFER, gBuffer.GetFramebuffer());
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gBufferShader.useShaderProgram();
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(gBufferShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(gBufferShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection));
+	drawObjects(frame, gBufferShader, drawDataOffset, false, false);
+	gps::gl::BindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
+	endPass();
+
+	beginPass("deferred lighting");
+	gps::Shader& lightingShader = deferredLightingVariants.Get(frame.shaderFeatures);
+	GLuint program = lightingShader.shaderProgram;
+	lightingShader.useShaderProgram();
+	gBuffer.BindTextures(lightingShader, GBUFFER_TEXTURE_UNIT);
+	// the g-buffer keeps the framebuffer size, a scaled frame only fills its lower left corner
+	glUniform2f(glGetUniformLocation(program, "gBufferScale"),
+		(float)frame.renderWidth / gBuffer.GetWidth(), (float)frame.renderHeight / gBuffer.GetHeight());
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "inverseProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(frame.projection)));
+	glm::mat4 eyeToLightSpace = frame.lightSpaceTrMatrix * glm::inverse(frame.view);
+	gps::gl::UniformMatrix4fv(glGetUniformLocation(program, "eyeToLightSpace"), 1, GL_FALSE, glm::value_ptr(eyeToLightSpace));
+	setLightingUniforms(frame, lightingShader);
+
+	// the quad writes the g-buffer depth, so whatever is drawn forward afterwards still sorts against the scene
+	glDepthFunc(GL_ALWAYS);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	screenQuad.Draw(lightingShader);
+	glPolygonMode(GL_FRONT_AND_BACK, frame.polygonMode);
+	glDepthFunc(GL_LESS);
+	endPass();
+}
+
+// Feeds the resolved GPU frame times to the governor and publishes its settings to the simulation
+void updateGovernor(const std::vector<gps::GpuTimerSample>& samples) {
+	for (size_t i = 0; i < samples.size(); i++) {
+		if (samples[i].pass != "frame" || !frameGovernor.Update((samples[i].endNs - samples[i].beginNs) * 1e-6))
+			continue;
+		const gps::GovernorLevel& level = frameGovernor.GetLevel();
+		governedRenderScale = level.renderScale;
+		governedLodBias = level.lodBias;
+		printf("Governor: level %d at %.2f ms - render scale %.2f, shadow map %d, LOD bias %.1f\n", frameGovernor.GetLevelIndex(),
+			frameGovernor.GetSmoothedMs(), level.renderScale, level.shadowMapSize, level.lodBias);
+	}
+}
+
+// Picks where the main passes draw: the scene framebuffer, or the offscreen target at a reduced scale
+void selectMainFramebuffer(const gps::FramePacket& frame) {
+	mainFramebuffer = sceneFramebuffer;
+	if (frame.renderWidth == frame.framebufferWidth && frame.renderHeight == frame.framebufferHeight)
+		return;
+	// full size, so changing the scale never reallocates
+	if (scaledTarget.GetWidth() != frame.framebufferWidth || scaledTarget.GetHeight() != frame.framebufferHeight) {
+		scaledTarget.Destroy();
+		scaledTarget.Create(frame.framebufferWidth, frame.framebufferHeight, true);
+	}
+	mainFramebuffer = scaledTarget.GetFramebuffer();
+}
+
+// Stretches the scaled frame over the scene framebuffer with bilinear filtering
+void upscaleFrame(const gps::FramePacket& frame) {
+	gps::gl::BindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glViewport(0, 0, frame.framebufferWidth, frame.framebufferHeight);
+	upscaleShader.useShaderProgram();
+	glActiveTexture(GL_TEXTURE0);
+	gps::gl::BindTexture(GL_TEXTURE_2D, scaledTarget.GetColorTexture());
+	gps::gl::Uniform1i(glGetUniformLocation(upscaleShader.shaderProgram, "sceneColor"), 0);
+	glUniform2f(glGetUniformLocation(upscaleShader.shaderProgram, "uvScale"),
+		(float)frame.renderWidth / scaledTarget.GetWidth(), (float)frame.renderHeight / scaledTarget.GetHeight());
+
+	glDisable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	screenQuad.Draw(upscaleShader);
+	glPolygonMode(GL_FRONT_AND_BACK, frame.polygonMode);
+	glEnable(GL_DEPTH_TEST);
+	gps::gl::BindTexture(GL_TEXTURE_2D, 0);
+}
+
+// GL side of a frame - runs on the thread that owns the context
+void renderScene(const gps::FramePacket& frame) {
+	PROFILE_ZONE("renderScene");
+
+	gpuTimer.BeginFrame(frame.frameIndex);
+	gps::RenderStats::BeginFrame(frame.frameIndex);
+	// resolved GPU passes drive the governor and join the CPU zones on the trace timeline
+	std::vector<gps::GpuTimerSample> gpuSamples = gpuTimer.TakeSamples();
+	updateGovernor(gpuSamples);
+	gps::Profiler::AddGpuSamples(gpuSamples);
+	beginPass("frame");
+
+	resizeShadowMap(frameGovernor.GetLevel().shadowMapSize);
+	selectMainFramebuffer(frame);
+	prefetchShaderVariants(frame);
+
+	GLint drawDataOffset = uploadDrawData(frame);
+
+	glPolygonMode(GL_FRONT_AND_BACK, frame.polygonMode);
+	if (frame.multisample)
+		glEnable(GL_MULTISAMPLE);
+	else
+		glDisable(GL_MULTISAMPLE);
+
+	// the depth map view still needs the shadow map when the lit shaders have the lookup compiled out
+	if ((frame.shaderFeatures & gps::SHADER_FEATURE_SHADOWS) || frame.showDepthMap) {
+		beginPass("shadow");
+		depthMapShader.useShaderProgram();
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(frame.lightSpaceTrMatrix));
+		glViewport(0, 0, shadowMapSize, shadowMapSize);
+		gps::gl::BindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		drawObjects(frame, depthMapShader, drawDataOffset, true, true);
+		endPass();
+	}
+	gps::gl::BindFramebuffer(GL_FRAMEBUFFER, mainFramebuffer);
+
+	if (frame.showDepthMap) {
+		beginPass("depth map view");
+		glViewport(0, 0, frame.renderWidth, frame.renderHeight);
 		glClear(GL_COLOR_BUFFER_BIT);
 		screenQuadShader.useShaderProgram();
 
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+		gps::gl::BindTexture(GL_TEXTURE_2D, depthMapTexture);
+		gps::gl::Uniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
 
 		glDisable(GL_DEPTH_TEST);
 		screenQuad.Draw(screenQuadShader);
 		glEnable(GL_DEPTH_TEST);
+		endPass();
 	}
 	else {
-		glViewport(0, 0, retina_width, retina_height);
+		glViewport(0, 0, frame.renderWidth, frame.renderHeight);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		myCustomShader.useShaderProgram();
-		glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
-		glViewport(0, 0, retina_width, retina_height);
-		myCustomShader.useShaderProgram();
 
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-		lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(lightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-		glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
-
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
-		glUniform1f(glGetUniformLocation(myCustomShader.shaderProgram, "initFogDensity"), initFogDensity);
-		glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+		clusteredLights.Upload(frame.lightClusters);
+		if (frame.deferredShading)
+			drawDeferred(frame, drawDataOffset);
+		else
+			drawForward(frame, drawDataOffset);
 
-		drawObjects(myCustomShader, false);
+		if (!frame.impostorInstances.empty()) {
+			beginPass("impostors");
+			drawImpostors(frame);
+			endPass();
+		}
 
+		beginPass("light cube");
 		lightShader.useShaderProgram();
-		glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		model = lightRotation;
-		model = glm::translate(model, glm::vec3(0.0f, 20.0f, 0.0f) );
-		model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-		glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(frame.view));
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(frame.projection));
+		gps::gl::UniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(frame.lightCubeModel));
 		lightCube.Draw(lightShader);
+		endPass();
+
+		if (!frame.placeholders.empty()) {
+			beginPass("placeholders");
+			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			for (size_t i = 0; i < frame.placeholders.size(); i++) {
+				gps::gl::UniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(frame.placeholders[i]));
+				lightCube.Draw(lightShader);
+			}
+			glPolygonMode(GL_FRONT_AND_BACK, frame.polygonMode);
+			endPass();
+		}
 	}
-	mySkyBox.Draw(skyboxShader, view, projection);
+
+	beginPass("skybox");
+	mySkyBox.Draw(skyboxShader, frame.view, frame.projection);
+	endPass();
+
+	if (mainFramebuffer != sceneFramebuffer) {
+		beginPass("upscale");
+		upscaleFrame(frame);
+		endPass();
+	}
+
+	drawDataRing.EndFrame();
+	clusteredLights.EndFrame();
+
+	endPass();
+	gpuTimer.EndFrame();
+	gps::RenderStats::EndFrame();
+
+	if (printGpuTimings.exchange(false))
+		gpuTimer.PrintStats();
+}
+
+// Ends a frame: swap on the window, or just submit and time it when benchmarking offscreen
+void presentFrame() {
+	PROFILE_ZONE("presentFrame");
+	if (benchMode) {
+		glFlush();
+		benchmark.FrameFinished();
+	}
+	else
+		glfwSwapBuffers(glWindow);
+}
+
+double millisecondsSinceStart() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Render thread, before each frame: uploads at most one parsed model, so no frame pays for all of them
+void uploadStreamedModels() {
+	if (allModelsReady)
+		return;
+	PROFILE_ZONE("uploadStreamedModels");
+
+	bool uploaded = false;
+	size_t readyCount = 0;
+	for (size_t i = 0; i < streamedModels.size(); i++) {
+		gps::Model3D* model = streamedModels[i].model;
+		if (!uploaded && model->GetLoadState() == gps::MODEL_PARSED) {
+			model->UploadModel();
+			uploaded = true;
+		}
+		if (model->IsReady())
+			readyCount++;
+	}
+	bakeTreeImpostor();
+
+	if (readyCount == streamedModels.size()) {
+		allModelsReady = true;
+		printf("All models streamed in after %.0f ms\n", millisecondsSinceStart());
+	}
+}
+
+void renderThreadFunction() {
+	makeContextCurrent();
+	// GL jobs queued from the workers now run here
+	jobSystem.SetMainThread();
+	PROFILE_THREAD("render");
+	gps::Profiler::CalibrateGpuClock();
+
+	const gps::FramePacket* frame;
+	while ((frame = framePackets.BeginRead()) != NULL) {
+		jobSystem.ExecuteMainThreadJobs();
+		uploadStreamedModels();
+		gps::TextureStreaming::Update();
+		renderScene(*frame);
+		presentFrame();
+		framePackets.EndRead();
+		if (!firstFramePresented) {
+			firstFramePresented = true;
+			printf("First frame after %.0f ms\n", millisecondsSinceStart());
+		}
+	}
+
+	releaseContext();
+}
+
+// One fixed simulation step: replayed or live input, scripted camera, then the frame packet
+// Returns the number of draws queued for the frame
+size_t simulateTick() {
+	if (replaying && inputRecording.GetMode() == gps::RECORD_INPUT)
+		replayInput();
+
+	processMovement();
+
+	if (replaying && inputRecording.GetMode() == gps::RECORD_CAMERA_POSE) {
+		if (simulationTick < inputRecording.GetPoses().size()) {
+			const gps::CameraPose& pose = inputRecording.GetPoses()[simulationTick];
+			myCamera.setPose(pose.position, pose.frontDirection);
+		}
+	}
+	else if (!cameraSpline.IsEmpty()) {
+		glm::vec3 position, target;
+		cameraSpline.Evaluate(simulationTick * cameraSplineSpeed, position, target);
+		myCamera.setPose(position, target - position);
+	}
+
+	gps::FramePacket* frame = framePackets.BeginWrite();
+	buildFramePacket(*frame);
+	size_t drawCount = frame->drawList.size();
+	framePackets.EndWrite();
+
+	if (recordFile && recordPoses) {
+		gps::CameraPose pose;
+		pose.position = myCamera.cameraPosition;
+		pose.frontDirection = myCamera.cameraFrontDirection;
+		inputRecording.AddPose(pose);
+	}
+
+	simulationTick++;
+	return drawCount;
+}
+
+// true once a replay or camera spline has run out
+bool scriptFinished() {
+	if (replaying)
+		return simulationTick >= inputRecording.GetTickCount();
+	if (!cameraSpline.IsEmpty())
+		return simulationTick * cameraSplineSpeed > cameraSpline.GetLength();
+	return false;
+}
+
+// Scripted --bench run, no input and no vsync: a replay for its recorded length,
+// a camera spline stretched over the run, or one orbit along the scene preview path
+void runBenchmark() {
+	if (replaying)
+		benchFrames = glm::max((int)inputRecording.GetTickCount() - benchWarmupFrames, 1);
+	int totalFrames = benchWarmupFrames + benchFrames;
+	if (!cameraSpline.IsEmpty())
+		cameraSplineSpeed = cameraSpline.GetLength() / glm::max(totalFrames - 1, 1);
+
+	size_t drawCount = 0;
+	for (int i = 0; i < totalFrames; i++) {
+		if (!replaying && cameraSpline.IsEmpty())
+			myCamera.scenePreview(360.0f * i / totalFrames);
+		drawCount = simulateTick();
+	}
+	benchmark.SetCounter("draws_per_frame", (double)drawCount);
+}
+
+void writeBenchmarkReport() {
+	glFinish();
+	benchmark.SetInfo("mode", "bench");
+	benchmark.SetCounter("width", retina_width);
+	benchmark.SetCounter("height", retina_height);
+	benchmark.SetCounter("worker_threads", jobSystem.GetWorkerCount());
+
+	gps::RenderCounters counters = gps::RenderStats::GetAverageFrameTotals();
+	benchmark.SetCounter("draw_calls", (double)counters.drawCalls);
+	benchmark.SetCounter("triangles", (double)counters.triangles);
+	benchmark.SetCounter("vertices", (double)counters.vertices);
+	benchmark.SetCounter("program_binds", (double)counters.programBinds);
+	benchmark.SetCounter("texture_binds", (double)counters.textureBinds);
+	benchmark.SetCounter("vao_binds", (double)counters.vertexArrayBinds);
+	benchmark.SetCounter("uniform_uploads", (double)counters.uniformUploads);
+	benchmark.SetCounter("buffer_bytes_uploaded", (double)counters.bufferBytesUploaded);
+	benchmark.SetCounter("fbo_binds", (double)counters.framebufferBinds);
+	benchmark.SetInfo("shading", deferredShading ? "deferred" : "forward");
+	benchmark.SetInfo("textures", bindlessTextures ? "bindless" : "bound");
+	benchmark.SetInfo("assets", gps::AssetArchive::IsMounted() ? archiveFile : "loose");
+	benchmark.SetInfo("depth_stream", depthStream == gps::DEPTH_STREAM_WELDED ? "welded" : depthStream == gps::DEPTH_STREAM_POSITIONS ? "positions" : "none");
+	benchmark.SetCounter("overdraw", overdrawMeter.GetOverdraw());
+	benchmark.SetCounter("governor_level", frameGovernor.GetLevelIndex());
+	benchmark.SetCounter("render_scale", frameGovernor.GetLevel().renderScale);
+	benchmark.SetCounter("shader_variants", mainShaderVariants.GetVariantCount() + deferredLightingVariants.GetVariantCount());
+	benchmark.SetCounter("depth_prepass", depthPrepassMode == DEPTH_PREPASS_AUTO ? depthPrepassActive : depthPrepassMode == DEPTH_PREPASS_ON);
+
+	benchmark.SetCounter("gpu_memory_bytes", (double)gps::GpuMemory::GetTotal());
+	benchmark.SetCounter("gpu_memory_high_water_bytes", (double)gps::GpuMemory::GetHighWaterMark());
+	benchmark.SetCounter("texture_budget_bytes", (double)gps::TextureStreaming::GetBudget());
+	benchmark.SetCounter("texture_resident_bytes", (double)gps::TextureStreaming::GetResidentBytes());
+	benchmark.SetCounter("texture_array_max_size", textureArrayMaxSize);
+	for (int c = 0; c < gps::GPU_MEMORY_CATEGORY_COUNT; c++) {
+		gps::GPU_MEMORY_CATEGORY category = (gps::GPU_MEMORY_CATEGORY)c;
+		benchmark.SetCounter(std::string("gpu_memory_bytes.") + gps::GpuMemory::GetCategoryName(category),
+			(double)gps::GpuMemory::GetCategoryTotal(category));
+	}
+	benchmark.PrintSummary();
+	benchmark.WriteReport(benchReportFile, gpuTimer);
 }
 
 void cleanup() {
+	jobSystem.PrintUtilization();
+	jobSystem.Shutdown();
+	gps::AssetArchive::Unmount();
+
+	gpuTimer.PrintStats();
+	gps::Profiler::AddGpuSamples(gpuTimer.TakeSamples());
+	gpuTimer.Destroy();
+	// while the context is current, and before the summaries would count the models as live
+	farm.Destroy();
+	lightCube.Destroy();
+	screenQuad.Destroy();
+	racoon.Destroy();
+	scarecrow.Destroy();
+	tree.Destroy();
+	gps::RenderStats::PrintSummary();
+	gps::GpuMemory::PrintSummary();
+	gps::TextureStreaming::PrintSummary();
+	gps::RenderStats::CloseFrameLog();
+	if (renderStatsFile)
+		gps::RenderStats::WriteSummary(renderStatsFile);
+	if (profilerTraceFile) {
+		if (gps::Profiler::IsEnabled())
+			gps::Profiler::ExportChromeTrace(profilerTraceFile);
+		else
+			std::cout << "Profiler: built without GPS_PROFILER, no trace written" << std::endl;
+	}
+	drawDataRing.Destroy();
+	glDeleteTextures(1, &drawDataTexture);
+	treeImpostor.Destroy();
+	impostorInstanceRing.Destroy();
+	clusteredLights.Destroy();
+	overdrawMeter.Destroy();
+	gBuffer.Destroy();
+	scaledTarget.Destroy();
+	mainShaderVariants.Destroy();
+	deferredLightingVariants.Destroy();
+	gps::GpuMemory::Release(GL_TEXTURE, depthMapTexture);
 	glDeleteTextures(1, &depthMapTexture);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glDeleteFramebuffers(1, &shadowMapFBO);
+	if (benchMode) {
+		benchTarget.Destroy();
+		headlessContext.Destroy();
+		return;
+	}
 	glfwDestroyWindow(glWindow);
 	glfwTerminate();
 }
 
 int main(int argc, const char* argv[]) {
+	PROFILE_THREAD("main");
+	startTime = std::chrono::steady_clock::now();
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--gpu-timer-log") == 0 && i + 1 < argc)
+			gpuTimerLogFile = argv[++i];
+		else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc)
+			profilerTraceFile = argv[++i];
+		else if (strcmp(argv[i], "--render-stats") == 0 && i + 1 < argc)
+			renderStatsFile = argv[++i];
+		else if (strcmp(argv[i], "--render-stats-frames") == 0 && i + 1 < argc)
+			renderStatsFrameLogFile = argv[++i];
+		else if (strcmp(argv[i], "--bench") == 0) {
+			benchMode = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				benchFrames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--bench-warmup") == 0 && i + 1 < argc)
+			benchWarmupFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bench-size") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%dx%d", &glWindowWidth, &glWindowHeight);
+		else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+			benchReportFile = argv[++i];
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (strcmp(argv[i], "--record-pose") == 0)
+			recordPoses = true;
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			if (!inputRecording.Load(argv[++i]))
+				return 1;
+			replaying = true;
+		}
+		else if (strcmp(argv[i], "--camera-spline") == 0 && i + 1 < argc) {
+			if (!cameraSpline.Load(argv[++i]))
+				return 1;
+		}
+		else if (strcmp(argv[i], "--spline-speed") == 0 && i + 1 < argc)
+			cameraSplineSpeed = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--float-vertices") == 0)
+			floatVertices = true;
+		else if (strcmp(argv[i], "--no-shadows") == 0)
+			shadowsEnabled = false;
+		else if (strcmp(argv[i], "--depth-stream") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "none") == 0)
+				depthStream = gps::DEPTH_STREAM_NONE;
+			else if (strcmp(argv[i], "positions") == 0)
+				depthStream = gps::DEPTH_STREAM_POSITIONS;
+			else
+				depthStream = gps::DEPTH_STREAM_WELDED;
+		}
+		else if (strcmp(argv[i], "--no-cluster-culling") == 0)
+			clusterCulling = false;
+		else if (strcmp(argv[i], "--lod-count") == 0 && i + 1 < argc)
+			lodCount = glm::clamp(atoi(argv[++i]), 1, 8);
+		else if (strcmp(argv[i], "--lod-size") == 0 && i + 1 < argc)
+			lodSettings.fullDetailSize = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--lod-shadow-bias") == 0 && i + 1 < argc)
+			lodSettings.shadowBias = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-impostors") == 0)
+			impostorsEnabled = false;
+		else if (strcmp(argv[i], "--impostor-size") == 0 && i + 1 < argc)
+			impostorSize = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--forest") == 0 && i + 1 < argc)
+			forestCount = glm::max(atoi(argv[++i]), 0);
+		else if (strcmp(argv[i], "--depth-prepass") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "on") == 0)
+				depthPrepassMode = DEPTH_PREPASS_ON;
+			else if (strcmp(argv[i], "off") == 0)
+				depthPrepassMode = DEPTH_PREPASS_OFF;
+			else
+				depthPrepassMode = DEPTH_PREPASS_AUTO;
+		}
+		else if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc)
+			targetFps = glm::max(atof(argv[++i]), 0.0);
+		else if (strcmp(argv[i], "--deferred") == 0)
+			deferredShading = true;
+		else if (strcmp(argv[i], "--overdraw-threshold") == 0 && i + 1 < argc)
+			overdrawThreshold = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--lamps") == 0 && i + 1 < argc)
+			lampCount = glm::max(atoi(argv[++i]), 0);
+		else if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+			archiveFile = argv[++i];
+			archiveRequired = true;
+		}
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+			textureBudgetMegabytes = glm::max(atof(argv[++i]), 0.0);
+		else if (strcmp(argv[i], "--texture-array-size") == 0 && i + 1 < argc)
+			textureArrayMaxSize = glm::max(atoi(argv[++i]), 0);
+		else if (strcmp(argv[i], "--no-bindless") == 0)
+			bindlessTextures = false;
+		else if (strcmp(argv[i], "--sync-load") == 0)
+			streamingLoads = false;
+		else if (strcmp(argv[i], "--no-archive") == 0)
+			archiveFile = NULL;
+		else if (strcmp(argv[i], "--pack-assets") == 0 && i + 1 < argc)
+			packArchiveFile = argv[++i];
+	}
+	// packing is an offline step, it needs no context
+	if (packArchiveFile) {
+		std::vector<std::string> directories;
+		directories.push_back("objects");
+		directories.push_back("skybox");
+		directories.push_back("shaders");
+		return gps::AssetArchive::Pack(packArchiveFile, directories) ? 0 : 1;
+	}
+	if (recordFile && replaying) {
+		fprintf(stderr, "ERROR: --record and --replay cannot be combined\n");
+		return 1;
+	}
+	gps::TextureStreaming::SetBudget((size_t)(textureBudgetMegabytes * 1024.0 * 1024.0));
+	// benchmarks measure the whole scene from their first frame on
+	if (benchMode)
+		streamingLoads = false;
+	// benchmarks measure fixed settings unless a target is asked for
+	if (targetFps < 0.0)
+		targetFps = benchMode ? 0.0 : 60.0;
+	frameGovernor.Configure(targetFps > 0.0 ? 1000.0 / targetFps : 0.0);
+	if (recordFile)
+		inputRecording.Clear(recordPoses ? gps::RECORD_CAMERA_POSE : gps::RECORD_INPUT);
+	// before any loader runs; the default archive is optional, one asked for by name is not
+	if (archiveFile && !gps::AssetArchive::Mount(archiveFile) && archiveRequired) {
+		fprintf(stderr, "ERROR: could not mount asset archive %s\n", archiveFile);
+		return 1;
+	}
 
-	if (!initOpenGLWindow()) {
-		glfwTerminate();
+	benchmark.BeginPhase("context");
+	if (benchMode ? !initHeadlessContext() : !initOpenGLWindow()) {
+		if (benchMode)
+			headlessContext.Destroy();
+		else
+			glfwTerminate();
 		return 1;
 	}
 
 	initOpenGLState();
+	jobSystem.Init();
+	benchmark.BeginPhase("initObjects");
 	initObjects();
+	benchmark.BeginPhase("initShaders");
 	initShaders();
+	benchmark.BeginPhase("initImpostors");
+	initImpostors();
+	benchmark.BeginPhase("initUniforms");
 	initUniforms();
+	benchmark.BeginPhase("initFBO");
 	initFBO();
+	initDrawData();
+	benchmark.BeginPhase("loadSkyBox");
 	initSkyBox();
+	gpuTimer.Create();
+	if (gpuTimerLogFile)
+		gpuTimer.OpenLog(gpuTimerLogFile);
+	if (renderStatsFrameLogFile)
+		gps::RenderStats::OpenFrameLog(renderStatsFrameLogFile);
 	loadSkyBox();
+	benchmark.EndPhase();
 
 	glCheckError();
 
-	while (!glfwWindowShouldClose(glWindow)) {
-		processMovement();
-		renderScene();
+	// hand the context over to the render thread; from here on the main thread only simulates
+	// GL jobs queued before the render thread claims them wait for it rather than run here without a context
+	releaseContext();
+	jobSystem.SetMainThread(std::thread::id());
+	benchmark.Start(benchWarmupFrames);
+	renderThread = std::thread(renderThreadFunction);
+
+	if (benchMode)
+		runBenchmark();
 
+	while (!benchMode && !glfwWindowShouldClose(glWindow) && !scriptFinished()) {
+		simulateTick();
 		glfwPollEvents();
-		glfwSwapBuffers(glWindow);
 	}
 
+	if (recordFile) {
+		inputRecording.SetTickCount(simulationTick);
+		inputRecording.Save(recordFile);
+	}
+
+	framePackets.Close();
+	renderThread.join();
+	// a model still parsing finishes first, the ones after it are skipped
+	stopLoading = true;
+	if (loaderThread.joinable())
+		loaderThread.join();
+	makeContextCurrent();
+	jobSystem.SetMainThread();
+
+	if (benchMode)
+		writeBenchmarkReport();
 	cleanup();
 	return 0;
 }
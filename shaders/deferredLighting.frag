@@ -0,0 +1,270 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+//g-buffer
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+//render size over g-buffer size; the frame fills the lower left corner when scaled down
+uniform vec2 gBufferScale;
+//eye space to the light's clip space, for the shadow lookup
+uniform mat4 eyeToLightSpace;
+
+#ifdef SHADOWS
+uniform sampler2D shadowMap;
+#endif
+
+//lighting
+uniform	vec3 lightDir;
+uniform	vec3 lightColor;
+
+vec3 ambient;
+float ambientStrength = 0.5f;
+vec3 diffuse;
+vec3 specular;
+float specularStrength = 0.5f;
+float shininess = 32.0f;
+
+// optional features are compiled in through #defines, see ShaderVariants.hpp
+#ifdef FOG
+uniform float initFogDensity;
+#endif
+
+#ifdef SPOT_LIGHT
+uniform float spotLight;
+uniform float spotLight1;
+
+uniform vec3 spotLightDirection;
+uniform vec3 spotLightPosition;
+
+vec3 spotLightColor = vec3(15,0,0);
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+// clustered point and spot lights, view space - see ClusteredLights.hpp for the layout
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform int lightDataOffset;
+uniform int lightGridOffset;
+uniform vec2 clusterTileSize;
+uniform float clusterNear;
+uniform float clusterDepthScale;
+
+const ivec3 clusterCounts = ivec3(16, 9, 24);
+#endif
+
+//the surface read from the g-buffer, named like the varyings of shaderStart.frag
+vec4 fPosEye;
+vec3 fNormal;
+vec4 fPosEyeLightSpace;
+vec3 albedo;
+vec3 specularColor;
+
+vec2 signNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+vec3 decodeOctahedron(vec2 e)
+{
+	e = e * 2.0f - 1.0f;
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	if (n.z < 0.0f)
+		n.xy = (1.0f - abs(n.yx)) * signNotZero(n.xy);
+	return normalize(n);
+}
+
+//the lighting below is the one of shaderStart.frag, with the texture lookups replaced by the g-buffer
+
+#ifdef SHADOWS
+float computeShadow()
+{
+	// perform perspective divide
+	vec3 normalizedCoords = fPosEyeLightSpace.xyz / fPosEyeLightSpace.w;
+	if (normalizedCoords.z > 1.0f)
+		return 0.0f;
+
+	// Transform to [0,1] range
+	normalizedCoords = normalizedCoords * 0.5 + 0.5;
+
+	// Get closest depth value from light's perspective
+	float closestDepth = texture(shadowMap, normalizedCoords.xy).r;
+
+	// Get depth of current fragment from light's perspective
+	float currentDepth = normalizedCoords.z;
+
+	// Check whether current frag pos is in shadow
+	float bias = 0.005f;
+	float shadow = currentDepth -bias > closestDepth ? 1.0f:0.0f;
+
+	return shadow;
+}
+#endif
+
+vec3 computeLightComponents()
+{
+	vec3 cameraPosEye = vec3(0.0f);//in eye coordinates, the viewer is situated at the origin
+
+	//transform normal
+	vec3 normalEye = normalize(fNormal);
+
+	//compute light direction
+	vec3 lightDirN = normalize(lightDir);
+
+	//compute view direction
+	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+
+	//compute ambient light
+	ambient = ambientStrength * lightColor;
+
+	//compute diffuse light
+	diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+
+	//compute specular light
+	vec3 reflection = reflect(-lightDirN, normalEye);
+	float specCoeff = pow(max(dot(viewDirN, reflection), 0.0f), shininess);
+	specular = specularStrength * specCoeff * lightColor;
+
+	return (ambient + diffuse + specular);
+}
+
+#ifdef FOG
+float computeFog()
+{
+	float fragmentDistance = length(fPosEye);
+	float fogFactor = exp(-pow(fragmentDistance * initFogDensity, 2));
+	return clamp(fogFactor, 0.0f, 1.0f);
+}
+#endif
+
+#ifdef SPOT_LIGHT
+vec3 computeLightSpotComponents() {
+	vec3 cameraPosEye = vec3(0.0f);//in eye coordinates, the viewer is situated at the origin
+
+	//transform normal
+	vec3 lightDir = normalize(spotLightPosition-fPosEye.xyz);
+	vec3 normalEye = normalize(fNormal);
+
+	//compute light direction
+	vec3 lightDirN = normalize(lightDir);
+
+	//compute view direction
+	vec3 viewDirN = normalize(cameraPosEye - fPosEye.xyz);
+	vec3 halfVector = normalize(lightDirN + viewDirN);
+
+	float spotLightAttenuation = 1.0f / (1.0f + 0.09f * length(spotLightPosition - fPosEye.xyz) + 0.02f * length(spotLightPosition - fPosEye.xyz) * length(spotLightPosition - fPosEye.xyz));
+
+	float spotLightIntensity = clamp((dot(lightDir, normalize(-spotLightDirection)) - spotLight1)/(spotLight - spotLight1), 0.0, 5.0);
+
+	//compute ambient light
+	vec3 ambient = spotLightColor * vec3(0.2f, 0.2f, 0.2f) * albedo;
+
+	//compute difuse light
+	vec3 diffuse = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * max(dot(normalEye, lightDir), 0.0f) * albedo;
+
+	//compute specular
+	vec3 specular = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * pow(max(dot(normalEye, halfVector), 0.0f), shininess) * specularColor;
+
+	ambient *= spotLightAttenuation * spotLightIntensity;
+	diffuse *= spotLightAttenuation * spotLightIntensity;
+	specular *= spotLightAttenuation * spotLightIntensity;
+
+	return ambient + diffuse + specular;
+}
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+vec3 computeClusteredLights()
+{
+	//find the froxel of the fragment
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterCounts.xy - 1);
+	int slice = clamp(int(log(-fPosEye.z / clusterNear) * clusterDepthScale), 0, clusterCounts.z - 1);
+	int cluster = (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+	int offset = int(texelFetch(lightGrid, lightGridOffset + cluster * 2).r);
+	int count = int(texelFetch(lightGrid, lightGridOffset + cluster * 2 + 1).r);
+
+	vec3 normalEye = normalize(fNormal);
+	vec3 viewDirN = normalize(-fPosEye.xyz);
+
+	vec3 result = vec3(0.0f);
+	for (int i = 0; i < count; i++) {
+		int light = lightDataOffset + int(texelFetch(lightGrid, lightGridOffset + offset + i).r) * 3;
+		vec4 positionRange = texelFetch(lightData, light);
+		vec4 colorOuterCone = texelFetch(lightData, light + 1);
+		vec4 directionInnerCone = texelFetch(lightData, light + 2);
+
+		vec3 toLight = positionRange.xyz - fPosEye.xyz;
+		float distance = length(toLight);
+		if (distance >= positionRange.w)
+			continue;
+		vec3 lightDirN = toLight / distance;
+
+		//inverse square falloff, windowed to reach zero at the range
+		float window = clamp(1.0f - pow(distance / positionRange.w, 4.0f), 0.0f, 1.0f);
+		float attenuation = window * window / (distance * distance + 1.0f);
+		//point lights have cones of -2 and -1, so this stays 1
+		attenuation *= smoothstep(colorOuterCone.w, directionInnerCone.w, dot(-lightDirN, directionInnerCone.xyz));
+
+		vec3 halfVector = normalize(lightDirN + viewDirN);
+		float diffuseCoeff = max(dot(normalEye, lightDirN), 0.0f);
+		float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+		result += colorOuterCone.rgb * attenuation * (diffuseCoeff * albedo + specularStrength * specCoeff * specularColor);
+	}
+	return result;
+}
+#endif
+
+void main()
+{
+	vec2 gBufferCoords = fTexCoords * gBufferScale;
+	float depth = texture(gDepth, gBufferCoords).r;
+	//nothing was drawn here; the skybox fills it later
+	if (depth == 1.0f)
+		discard;
+	//the forward passes that follow test against the scene depth
+	gl_FragDepth = depth;
+
+	vec4 clip = vec4(vec3(fTexCoords, depth) * 2.0f - 1.0f, 1.0f);
+	vec4 eye = inverseProjection * clip;
+	fPosEye = vec4(eye.xyz / eye.w, 1.0f);
+	fNormal = decodeOctahedron(texture(gNormal, gBufferCoords).rg);
+	fPosEyeLightSpace = eyeToLightSpace * fPosEye;
+	vec4 albedoSpecular = texture(gAlbedoSpecular, gBufferCoords);
+	albedo = albedoSpecular.rgb;
+	specularColor = vec3(albedoSpecular.a);
+
+	vec3 light = computeLightComponents();
+
+	ambient *= albedo;
+	diffuse *= albedo;
+	specular *= specularColor;
+
+#ifdef SPOT_LIGHT
+	light += computeLightSpotComponents();
+#endif
+
+#ifdef SHADOWS
+	float shadow = computeShadow();
+#else
+	float shadow = 0.0f;
+#endif
+	vec3 color = min((ambient + (1.0f - shadow)*diffuse) + (1.0f - shadow)*specular, 1.0f);
+
+	vec4 drawShadow = vec4(color,1.0f);
+#ifdef CLUSTERED_LIGHTS
+	vec4 lamps = vec4(computeClusteredLights(), 0.0f);
+#else
+	vec4 lamps = vec4(0.0f);
+#endif
+#ifdef FOG
+	float fogFactor = computeFog();
+	vec4 fogColor = vec4(0.5f,0.5f,0.5f,1.0f);
+	fColor = (fogColor * (1 - fogFactor)) + ((drawShadow + lamps) * fogFactor);
+#else
+	fColor = min(drawShadow * vec4(light, 1.0f) + lamps, 1.0f);
+#endif
+}
\ No newline at end of file
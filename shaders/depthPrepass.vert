@@ -0,0 +1,26 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+//per-draw data - 8 texels per draw in the frame's ring buffer partition
+uniform samplerBuffer drawData;
+uniform int drawDataOffset;
+uniform int drawId;
+
+//dequantization for packed vertices - identity for float meshes
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+//must produce bit-identical depth to shaderStart.vert, which the main pass tests against with GL_LEQUAL
+invariant gl_Position;
+
+void main()
+{
+	int base = drawDataOffset + drawId * 8;
+	mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+	vec3 position = positionOffset + vPosition * positionScale;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+}
\ No newline at end of file
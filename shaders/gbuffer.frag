@@ -0,0 +1,83 @@
+#version 410 core
+
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+in vec3 fNormal;
+in vec4 fPosEye;
+in vec2 fTexCoords;
+in vec4 fPosEyeLightSpace;
+
+//albedo with specular intensity, octahedral eye space normal; the position comes back from the depth buffer
+layout(location=0) out vec4 gAlbedoSpecular;
+layout(location=1) out vec2 gNormal;
+
+//texture
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+//small textures are packed into arrays at load; the layer is -1 when the mesh samples its own 2D texture
+uniform sampler2DArray diffuseTextureArray;
+uniform sampler2DArray specularTextureArray;
+uniform int diffuseTextureLayer;
+uniform int specularTextureLayer;
+
+#ifdef BINDLESS_TEXTURES
+//resident handles of each mesh of the model, MaterialData in Model3D.cpp; a zero handle falls back to the bound texture
+struct Material
+{
+	uvec2 diffuse;
+	uvec2 specular;
+	ivec2 layers;
+};
+layout(std140) uniform Materials
+{
+	//MAX_MATERIALS in Model3D.cpp
+	Material materials[512];
+};
+//false for models drawn without a table
+uniform bool materialTable;
+flat in uint fMaterial;
+#endif
+
+vec4 sampleDiffuse()
+{
+#ifdef BINDLESS_TEXTURES
+	if (materialTable && materials[fMaterial].diffuse != uvec2(0)) {
+		Material material = materials[fMaterial];
+		return material.layers.x >= 0 ? texture(sampler2DArray(material.diffuse), vec3(fTexCoords, material.layers.x)) : texture(sampler2D(material.diffuse), fTexCoords);
+	}
+#endif
+	return diffuseTextureLayer >= 0 ? texture(diffuseTextureArray, vec3(fTexCoords, diffuseTextureLayer)) : texture(diffuseTexture, fTexCoords);
+}
+
+vec4 sampleSpecular()
+{
+#ifdef BINDLESS_TEXTURES
+	if (materialTable && materials[fMaterial].specular != uvec2(0)) {
+		Material material = materials[fMaterial];
+		return material.layers.y >= 0 ? texture(sampler2DArray(material.specular), vec3(fTexCoords, material.layers.y)) : texture(sampler2D(material.specular), fTexCoords);
+	}
+#endif
+	return specularTextureLayer >= 0 ? texture(specularTextureArray, vec3(fTexCoords, specularTextureLayer)) : texture(specularTexture, fTexCoords);
+}
+
+vec2 signNotZero(vec2 v)
+{
+	return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+//must match decodeOctahedron in deferredLighting.frag
+vec2 encodeOctahedron(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.z >= 0.0f ? n.xy : (1.0f - abs(n.yx)) * signNotZero(n.xy);
+	return e * 0.5f + 0.5f;
+}
+
+void main()
+{
+	vec3 specular = sampleSpecular().rgb;
+	gAlbedoSpecular = vec4(sampleDiffuse().rgb, dot(specular, vec3(1.0f / 3.0f)));
+	gNormal = encodeOctahedron(normalize(fNormal));
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#version 410 core
+
+in vec2 fLocalCoords;
+flat in vec2 fFrame;
+flat in vec2 fBlend;
+in vec4 fPosEye;
+in vec3 fPosWorld;
+flat in vec3 fTowardCamera;
+flat in float fRadius;
+
+out vec4 fColor;
+
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+uniform int framesPerSide;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat3 objectRotation;
+
+//lighting
+uniform	vec3 lightDir;
+uniform	vec3 lightColor;
+float ambientStrength = 0.5f;
+
+// fog
+uniform int initFog;
+uniform float initFogDensity;
+
+void main()
+{
+	//blend the four nearest views, weighted by their coverage
+	vec2 offsets[4] = vec2[](vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f));
+	float weights[4] = float[]((1.0f - fBlend.x) * (1.0f - fBlend.y), fBlend.x * (1.0f - fBlend.y), (1.0f - fBlend.x) * fBlend.y, fBlend.x * fBlend.y);
+
+	vec4 albedo = vec4(0.0f);
+	vec4 normalDepth = vec4(0.0f);
+	float coverage = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		vec2 uv = (fFrame + offsets[i] + fLocalCoords) / float(framesPerSide);
+		vec4 frameAlbedo = texture(albedoAtlas, uv);
+		float w = weights[i] * frameAlbedo.a;
+		albedo += w * frameAlbedo;
+		normalDepth += w * texture(normalDepthAtlas, uv);
+		coverage += weights[i] * frameAlbedo.a;
+	}
+	if (coverage < 0.5f)
+		discard;
+	albedo /= coverage;
+	normalDepth /= coverage;
+
+	//push the quad to the baked surface so impostors intersect the scene correctly
+	vec3 surface = fPosWorld + fTowardCamera * (1.0f - 2.0f * normalDepth.a) * fRadius;
+	vec4 clip = projection * view * vec4(surface, 1.0f);
+	gl_FragDepth = clip.z / clip.w * 0.5f + 0.5f;
+
+	vec3 normalEye = normalize(mat3(view) * objectRotation * (normalDepth.rgb * 2.0f - 1.0f));
+	vec3 ambient = ambientStrength * lightColor;
+	vec3 diffuse = max(dot(normalEye, normalize(lightDir)), 0.0f) * lightColor;
+	vec3 color = min((ambient + diffuse) * albedo.rgb, 1.0f);
+
+	if (initFog == 0) {
+		fColor = vec4(color, 1.0f);
+	}
+	else {
+		float fogFactor = clamp(exp(-pow(length(fPosEye) * initFogDensity, 2)), 0.0f, 1.0f);
+		vec4 fogColor = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+		fColor = (fogColor * (1 - fogFactor)) + (vec4(color, 1.0f) * fogFactor);
+	}
+}
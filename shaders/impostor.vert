@@ -0,0 +1,65 @@
+#version 410 core
+
+//per instance: bounds center in world space, uniform scale
+layout(location=0) in vec4 instanceData;
+
+out vec2 fLocalCoords;
+flat out vec2 fFrame;
+flat out vec2 fBlend;
+out vec4 fPosEye;
+out vec3 fPosWorld;
+flat out vec3 fTowardCamera;
+flat out float fRadius;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 cameraPosition;
+//rotation shared by every instance, object to world
+uniform mat3 objectRotation;
+
+uniform int framesPerSide;
+uniform float radius;
+
+//hemi-octahedral mapping with y up; must match the baker
+vec2 encodeHemiOctahedron(vec3 direction)
+{
+	vec2 p = direction.xz / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+	return vec2(p.x + p.y, p.x - p.y);
+}
+
+vec3 frameUp(vec3 direction)
+{
+	return abs(direction.y) > 0.999f ? vec3(0.0f, 0.0f, -1.0f) : vec3(0.0f, 1.0f, 0.0f);
+}
+
+void main()
+{
+	vec3 center = instanceData.xyz;
+	float worldRadius = radius * instanceData.w;
+
+	//viewing direction in object space, kept on the baked hemisphere
+	vec3 towardCamera = normalize(cameraPosition - center);
+	vec3 direction = transpose(objectRotation) * towardCamera;
+	direction.y = max(direction.y, 0.0f);
+	direction = normalize(direction + vec3(0.0f, 1e-4f, 0.0f));
+
+	//the four frames around the direction and their bilinear weights
+	vec2 grid = (encodeHemiOctahedron(direction) * 0.5f + 0.5f) * float(framesPerSide - 1);
+	fFrame = min(floor(grid), vec2(framesPerSide - 2));
+	fBlend = grid - fFrame;
+
+	//same basis as the baking camera: lookAt(center + direction, center, frameUp)
+	vec3 forward = -direction;
+	vec3 right = normalize(cross(forward, frameUp(direction)));
+	vec3 up = cross(right, forward);
+
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0f - 1.0f;
+	vec3 world = center + objectRotation * (right * corner.x + up * corner.y) * worldRadius;
+
+	fLocalCoords = corner * 0.5f + 0.5f;
+	fPosWorld = world;
+	fPosEye = view * vec4(world, 1.0f);
+	fTowardCamera = towardCamera;
+	fRadius = worldRadius;
+	gl_Position = projection * fPosEye;
+}
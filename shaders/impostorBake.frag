@@ -0,0 +1,57 @@
+#version 410 core
+
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
+in vec3 fNormal;
+in vec2 fTexCoords;
+
+layout(location=0) out vec4 fAlbedo;
+layout(location=1) out vec4 fNormalDepth;
+
+uniform sampler2D diffuseTexture;
+//small textures are packed into an array at load; the layer is -1 when the mesh samples its own 2D texture
+uniform sampler2DArray diffuseTextureArray;
+uniform int diffuseTextureLayer;
+
+#ifdef BINDLESS_TEXTURES
+//resident handles of each mesh of the model, MaterialData in Model3D.cpp; a zero handle falls back to the bound texture
+struct Material
+{
+	uvec2 diffuse;
+	uvec2 specular;
+	ivec2 layers;
+};
+layout(std140) uniform Materials
+{
+	//MAX_MATERIALS in Model3D.cpp
+	Material materials[512];
+};
+//false for models drawn without a table
+uniform bool materialTable;
+flat in uint fMaterial;
+#endif
+
+vec4 sampleDiffuse()
+{
+#ifdef BINDLESS_TEXTURES
+	if (materialTable && materials[fMaterial].diffuse != uvec2(0)) {
+		Material material = materials[fMaterial];
+		return material.layers.x >= 0 ? texture(sampler2DArray(material.diffuse), vec3(fTexCoords, material.layers.x)) : texture(sampler2D(material.diffuse), fTexCoords);
+	}
+#endif
+	return diffuseTextureLayer >= 0 ? texture(diffuseTextureArray, vec3(fTexCoords, diffuseTextureLayer)) : texture(diffuseTexture, fTexCoords);
+}
+
+void main()
+{
+	vec4 albedo = sampleDiffuse();
+	//leaves and other cut-outs
+	if (albedo.a < 0.5f)
+		discard;
+
+	fAlbedo = vec4(albedo.rgb, 1.0f);
+	//the projection is orthographic, so window depth is linear through the bounding sphere
+	fNormalDepth = vec4(normalize(fNormal) * 0.5f + 0.5f, gl_FragCoord.z);
+}
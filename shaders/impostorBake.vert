@@ -0,0 +1,33 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+
+out vec3 fNormal;
+out vec2 fTexCoords;
+
+#ifdef BINDLESS_TEXTURES
+//entry of the mesh in the material table, the same for every vertex through the VAO's instance divisor
+layout(location=3) in uint vMaterial;
+flat out uint fMaterial;
+#endif
+
+uniform mat4 view;
+uniform mat4 projection;
+
+//dequantization for packed vertices - identity for float meshes
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+void main()
+{
+	vec3 position = positionOffset + vPosition * positionScale;
+	//object space, the impostor is lit at runtime
+	fNormal = vNormal;
+	fTexCoords = vTexCoords;
+#ifdef BINDLESS_TEXTURES
+	fMaterial = vMaterial;
+#endif
+	gl_Position = projection * view * vec4(position, 1.0f);
+}
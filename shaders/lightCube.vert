@@ -8,7 +8,12 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+//dequantization for packed vertices - identity for float meshes
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
+	vec3 position = positionOffset + vPosition * positionScale;
+	gl_Position = projection * view * model * vec4(position, 1.0f);
 }
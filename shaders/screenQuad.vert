@@ -6,8 +6,12 @@ layout(location=2) in vec2 vTexCoords;
 
 out vec2 fTexCoords;
 
+//dequantization for packed vertices - identity for float meshes
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
 void main() 
 {
 	fTexCoords = vTexCoords;
-	gl_Position = vec4(vPosition, 1.0f);
+	gl_Position = vec4(positionOffset + vPosition * positionScale, 1.0f);
 }
@@ -1,10 +1,16 @@
 #version 410 core
 
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
+
 in vec3 fNormal;
 in vec4 fPosEye;
 in vec2 fTexCoords;
 in vec4 fPosEyeLightSpace;
+#ifdef SHADOWS
 uniform sampler2D shadowMap;
+#endif
 out vec4 fColor;
 
 //lighting
@@ -14,6 +20,51 @@ uniform	vec3 lightColor;
 //texture
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
+//small textures are packed into arrays at load; the layer is -1 when the mesh samples its own 2D texture
+uniform sampler2DArray diffuseTextureArray;
+uniform sampler2DArray specularTextureArray;
+uniform int diffuseTextureLayer;
+uniform int specularTextureLayer;
+
+#ifdef BINDLESS_TEXTURES
+//resident handles of each mesh of the model, MaterialData in Model3D.cpp; a zero handle falls back to the bound texture
+struct Material
+{
+	uvec2 diffuse;
+	uvec2 specular;
+	ivec2 layers;
+};
+layout(std140) uniform Materials
+{
+	//MAX_MATERIALS in Model3D.cpp
+	Material materials[512];
+};
+//false for models drawn without a table
+uniform bool materialTable;
+flat in uint fMaterial;
+#endif
+
+vec4 sampleDiffuse()
+{
+#ifdef BINDLESS_TEXTURES
+	if (materialTable && materials[fMaterial].diffuse != uvec2(0)) {
+		Material material = materials[fMaterial];
+		return material.layers.x >= 0 ? texture(sampler2DArray(material.diffuse), vec3(fTexCoords, material.layers.x)) : texture(sampler2D(material.diffuse), fTexCoords);
+	}
+#endif
+	return diffuseTextureLayer >= 0 ? texture(diffuseTextureArray, vec3(fTexCoords, diffuseTextureLayer)) : texture(diffuseTexture, fTexCoords);
+}
+
+vec4 sampleSpecular()
+{
+#ifdef BINDLESS_TEXTURES
+	if (materialTable && materials[fMaterial].specular != uvec2(0)) {
+		Material material = materials[fMaterial];
+		return material.layers.y >= 0 ? texture(sampler2DArray(material.specular), vec3(fTexCoords, material.layers.y)) : texture(sampler2D(material.specular), fTexCoords);
+	}
+#endif
+	return specularTextureLayer >= 0 ? texture(specularTextureArray, vec3(fTexCoords, specularTextureLayer)) : texture(specularTexture, fTexCoords);
+}
 
 vec3 ambient;
 float ambientStrength = 0.5f;
@@ -22,12 +73,12 @@ vec3 specular;
 float specularStrength = 0.5f;
 float shininess = 32.0f;
 
-// fog
-uniform int initFog;
+// optional features are compiled in through #defines, see ShaderVariants.hpp
+#ifdef FOG
 uniform float initFogDensity;
+#endif
 
-// spot light
-uniform int initSpotLight;
+#ifdef SPOT_LIGHT
 uniform float spotLight;
 uniform float spotLight1;
 
@@ -35,7 +86,22 @@ uniform vec3 spotLightDirection;
 uniform vec3 spotLightPosition;
 
 vec3 spotLightColor = vec3(15,0,0);
+#endif
 
+#ifdef CLUSTERED_LIGHTS
+// clustered point and spot lights, view space - see ClusteredLights.hpp for the layout
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform int lightDataOffset;
+uniform int lightGridOffset;
+uniform vec2 clusterTileSize;
+uniform float clusterNear;
+uniform float clusterDepthScale;
+
+const ivec3 clusterCounts = ivec3(16, 9, 24);
+#endif
+
+#ifdef SHADOWS
 float computeShadow()
 {
 	// perform perspective divide
@@ -58,6 +124,7 @@ float computeShadow()
 
 	return shadow;
 }
+#endif
 
 vec3 computeLightComponents()
 {		
@@ -86,13 +153,16 @@ vec3 computeLightComponents()
 	return (ambient + diffuse + specular);
 }
 
+#ifdef FOG
 float computeFog()
 {
 	float fragmentDistance = length(fPosEye);
 	float fogFactor = exp(-pow(fragmentDistance * initFogDensity, 2));
 	return clamp(fogFactor, 0.0f, 1.0f);
 }
+#endif
 
+#ifdef SPOT_LIGHT
 vec3 computeLightSpotComponents() {
 	vec3 cameraPosEye = vec3(0.0f);//in eye coordinates, the viewer is situated at the origin
 	
@@ -112,13 +182,13 @@ vec3 computeLightSpotComponents() {
 	float spotLightIntensity = clamp((dot(lightDir, normalize(-spotLightDirection)) - spotLight1)/(spotLight - spotLight1), 0.0, 5.0);
 	
 	//compute ambient light
-	vec3 ambient = spotLightColor * vec3(0.2f, 0.2f, 0.2f) * vec3(texture(diffuseTexture, fTexCoords));
+	vec3 ambient = spotLightColor * vec3(0.2f, 0.2f, 0.2f) * vec3(sampleDiffuse());
 	
 	//compute difuse light
-	vec3 diffuse = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * max(dot(normalEye, lightDir), 0.0f) * vec3(texture(diffuseTexture, fTexCoords));
+	vec3 diffuse = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * max(dot(normalEye, lightDir), 0.0f) * vec3(sampleDiffuse());
 	
 	//compute specular
-	vec3 specular = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * pow(max(dot(normalEye, halfVector), 0.0f), shininess) * vec3(texture(specularTexture, fTexCoords));
+	vec3 specular = spotLightColor * vec3(50.0f, 50.0f, 50.0f) * pow(max(dot(normalEye, halfVector), 0.0f), shininess) * vec3(sampleSpecular());
 	
 	ambient *= spotLightAttenuation * spotLightIntensity;
 	diffuse *= spotLightAttenuation * spotLightIntensity;
@@ -126,31 +196,82 @@ vec3 computeLightSpotComponents() {
 	
 	return ambient + diffuse + specular;
 }
+#endif
+
+#ifdef CLUSTERED_LIGHTS
+vec3 computeClusteredLights()
+{
+	//find the froxel of the fragment
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterCounts.xy - 1);
+	int slice = clamp(int(log(-fPosEye.z / clusterNear) * clusterDepthScale), 0, clusterCounts.z - 1);
+	int cluster = (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+	int offset = int(texelFetch(lightGrid, lightGridOffset + cluster * 2).r);
+	int count = int(texelFetch(lightGrid, lightGridOffset + cluster * 2 + 1).r);
+
+	vec3 normalEye = normalize(fNormal);
+	vec3 viewDirN = normalize(-fPosEye.xyz);
+	vec3 albedo = sampleDiffuse().rgb;
+	vec3 specularColor = sampleSpecular().rgb;
+
+	vec3 result = vec3(0.0f);
+	for (int i = 0; i < count; i++) {
+		int light = lightDataOffset + int(texelFetch(lightGrid, lightGridOffset + offset + i).r) * 3;
+		vec4 positionRange = texelFetch(lightData, light);
+		vec4 colorOuterCone = texelFetch(lightData, light + 1);
+		vec4 directionInnerCone = texelFetch(lightData, light + 2);
+
+		vec3 toLight = positionRange.xyz - fPosEye.xyz;
+		float distance = length(toLight);
+		if (distance >= positionRange.w)
+			continue;
+		vec3 lightDirN = toLight / distance;
+
+		//inverse square falloff, windowed to reach zero at the range
+		float window = clamp(1.0f - pow(distance / positionRange.w, 4.0f), 0.0f, 1.0f);
+		float attenuation = window * window / (distance * distance + 1.0f);
+		//point lights have cones of -2 and -1, so this stays 1
+		attenuation *= smoothstep(colorOuterCone.w, directionInnerCone.w, dot(-lightDirN, directionInnerCone.xyz));
+
+		vec3 halfVector = normalize(lightDirN + viewDirN);
+		float diffuseCoeff = max(dot(normalEye, lightDirN), 0.0f);
+		float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+		result += colorOuterCone.rgb * attenuation * (diffuseCoeff * albedo + specularStrength * specCoeff * specularColor);
+	}
+	return result;
+}
+#endif
 
 void main() 
 {
 	vec3 light = computeLightComponents();
 	vec3 baseColor = vec3(0.9f, 0.35f, 0.0f);//orange
 	
-	ambient *= texture(diffuseTexture, fTexCoords).rgb;
-	diffuse *= texture(diffuseTexture, fTexCoords).rgb;
-	specular *= texture(specularTexture, fTexCoords).rgb;
+	ambient *= sampleDiffuse().rgb;
+	diffuse *= sampleDiffuse().rgb;
+	specular *= sampleSpecular().rgb;
 	
-	// spotlight
-	if (initSpotLight == 1){
-		light += computeLightSpotComponents();
-	}
+#ifdef SPOT_LIGHT
+	light += computeLightSpotComponents();
+#endif
 	
+#ifdef SHADOWS
 	float shadow = computeShadow();
+#else
+	float shadow = 0.0f;
+#endif
 	vec3 color = min((ambient + (1.0f - shadow)*diffuse) + (1.0f - shadow)*specular, 1.0f);
 	
-    float fogFactor = computeFog();
-	vec4 fogColor = vec4(0.5f,0.5f,0.5f,1.0f);
 	vec4 drawShadow = vec4(color,1.0f);
-	if (initFog == 0) {
-		fColor = min(drawShadow * vec4(light, 1.0f), 1.0f);
-	}
-	else {
-		fColor = (fogColor * (1 - fogFactor)) + (drawShadow * fogFactor);
-	}
+#ifdef CLUSTERED_LIGHTS
+	vec4 lamps = vec4(computeClusteredLights(), 0.0f);
+#else
+	vec4 lamps = vec4(0.0f);
+#endif
+#ifdef FOG
+	float fogFactor = computeFog();
+	vec4 fogColor = vec4(0.5f,0.5f,0.5f,1.0f);
+	fColor = (fogColor * (1 - fogFactor)) + ((drawShadow + lamps) * fogFactor);
+#else
+	fColor = min(drawShadow * vec4(light, 1.0f) + lamps, 1.0f);
+#endif
 }
@@ -9,18 +9,43 @@ out vec4 fPosEye;
 out vec2 fTexCoords;
 out vec4 fPosEyeLightSpace;
 
+#ifdef BINDLESS_TEXTURES
+//entry of the mesh in the material table, the same for every vertex through the VAO's instance divisor
+layout(location=3) in uint vMaterial;
+flat out uint fMaterial;
+#endif
+
 uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat3 normalMatrix;
+
+//per-draw data - 8 texels per draw in the frame's ring buffer partition
+uniform samplerBuffer drawData;
+uniform int drawDataOffset;
+uniform int drawId;
+
+//dequantization for packed vertices - identity for float meshes
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+//the depth pre-pass runs the same transform in depthPrepass.vert
+invariant gl_Position;
 
 void main() 
 {
+	int base = drawDataOffset + drawId * 8;
+	mat4 model = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1), texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+	mat3 normalMatrix = mat3(texelFetch(drawData, base + 4).xyz, texelFetch(drawData, base + 5).xyz, texelFetch(drawData, base + 6).xyz);
+
+	vec3 position = positionOffset + vPosition * positionScale;
+
 	//compute eye space coordinates
-	fPosEye = view * model * vec4(vPosition, 1.0f);
+	fPosEye = view * model * vec4(position, 1.0f);
 	fNormal = normalize(normalMatrix * vNormal);
 	fTexCoords = vTexCoords;
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosEyeLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+#ifdef BINDLESS_TEXTURES
+	fMaterial = vMaterial;
+#endif
+	gl_Position = projection * view * model * vec4(position, 1.0f);
+	fPosEyeLightSpace = lightSpaceTrMatrix * model * vec4(position, 1.0f);
 }
@@ -0,0 +1,14 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+//frame drawn at a reduced render scale into the lower left corner of the texture
+uniform sampler2D sceneColor;
+uniform vec2 uvScale;
+
+void main()
+{
+	fColor = texture(sceneColor, fTexCoords * uvScale);
+}
\ No newline at end of file